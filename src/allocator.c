@@ -0,0 +1,202 @@
+#include "allocator.h"
+#include <errno.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+const allocator_t std_allocator = STD_ALLOCATOR;
+
+static inline int is_aligned(void* ptr, size_t align)
+{
+    return ((uintptr_t)ptr & (align - 1)) == 0;
+}
+
+void* std_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    if (align <= alignof(max_align_t))
+    {
+        return malloc(size);
+    }
+
+    void* ptr;
+
+    if (posix_memalign(&ptr, align, size))
+    {
+        return NULL;
+    }
+
+    return ptr;
+}
+
+void std_allocator_free(void* ctx, void* ptr, size_t size) { free(ptr); }
+
+static void* pool_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    mem_pool_t* pool = ctx;
+
+    if (size > pool->obj_size)
+    {
+        return NULL;
+    }
+
+    void* ptr = mem_pool_alloc(pool);
+
+    if (ptr != NULL && !is_aligned(ptr, align))
+    {
+        mem_pool_free(pool, ptr);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+static void pool_allocator_free(void* ctx, void* ptr, size_t size) { mem_pool_free(ctx, ptr); }
+
+static void* pool_set_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    pool_set_t* set = ctx;
+    mem_pool_t* best = NULL;
+
+    for (size_t i = 0; i < set->count; ++i)
+    {
+        if (set->pools[i]->obj_size >= size
+            && (best == NULL || set->pools[i]->obj_size < best->obj_size))
+        {
+            best = set->pools[i];
+        }
+    }
+
+    if (best == NULL)
+    {
+        return NULL;
+    }
+
+    return pool_allocator_alloc(best, size, align);
+}
+
+static void pool_set_allocator_free(void* ctx, void* ptr, size_t size)
+{
+    pool_set_t* set = ctx;
+
+    for (size_t i = 0; i < set->count; ++i)
+    {
+        uint8_t* start = set->pools[i]->pool_start;
+
+        if ((uint8_t*)ptr >= start && (uint8_t*)ptr < start + set->pools[i]->pool_size)
+        {
+            mem_pool_free(set->pools[i], ptr);
+            return;
+        }
+    }
+}
+
+static void* heap_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    heap_t* heap = ctx;
+
+    if (align <= heap->alignment)
+    {
+        return heap_alloc(heap, size);
+    }
+
+    return heap_aligned_alloc(heap, size, align);
+}
+
+static void heap_allocator_free(void* ctx, void* ptr, size_t size) { heap_free(ctx, ptr); }
+
+static void* slab_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    void* ptr = slab_alloc(ctx, size);
+
+    if (ptr != NULL && !is_aligned(ptr, align))
+    {
+        slab_free(ctx, ptr);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+static void slab_allocator_free(void* ctx, void* ptr, size_t size) { slab_free(ctx, ptr); }
+
+static void* arena_allocator_alloc(void* ctx, size_t size, size_t align)
+{
+    return arena_alloc(ctx, size, align);
+}
+
+static void arena_allocator_free(void* ctx, void* ptr, size_t size) { }
+
+int init_pool_allocator(allocator_t* allocator, mem_pool_t* pool)
+{
+    if (allocator == NULL || pool == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    allocator->alloc = pool_allocator_alloc;
+    allocator->free = pool_allocator_free;
+    allocator->ctx = pool;
+
+    return 0;
+}
+
+int init_pool_set_allocator(allocator_t* allocator, pool_set_t* set)
+{
+    if (allocator == NULL || set == NULL || (set->pools == NULL && set->count > 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    allocator->alloc = pool_set_allocator_alloc;
+    allocator->free = pool_set_allocator_free;
+    allocator->ctx = set;
+
+    return 0;
+}
+
+int init_heap_allocator(allocator_t* allocator, heap_t* heap)
+{
+    if (allocator == NULL || heap == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    allocator->alloc = heap_allocator_alloc;
+    allocator->free = heap_allocator_free;
+    allocator->ctx = heap;
+
+    return 0;
+}
+
+int init_slab_allocator(allocator_t* allocator, slab_t* slab)
+{
+    if (allocator == NULL || slab == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    allocator->alloc = slab_allocator_alloc;
+    allocator->free = slab_allocator_free;
+    allocator->ctx = slab;
+
+    return 0;
+}
+
+int init_arena_allocator(allocator_t* allocator, arena_t* arena)
+{
+    if (allocator == NULL || arena == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    allocator->alloc = arena_allocator_alloc;
+    allocator->free = arena_allocator_free;
+    allocator->ctx = arena;
+
+    return 0;
+}
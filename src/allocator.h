@@ -0,0 +1,105 @@
+#pragma once
+
+#include "arena.h"
+#include "heap.h"
+#include "mem_pool.h"
+#include "slab.h"
+#include <stddef.h>
+
+/**
+ * Allocator interface, every allocation carries the context of the allocator so pools, heaps and
+ * arenas can be owned by a single server, shard or device instead of living in global state.
+ */
+typedef struct allocator
+{
+    /**
+     * @brief Allocate memory.
+     * @param ctx, The context of the allocator.
+     * @param size, Number of bytes to allocate.
+     * @param align, Required alignment of the memory, a power of two.
+     * @return void*, pointer to the allocated memory, or NULL if no memory was free.
+     */
+    void* (*alloc)(void* ctx, size_t size, size_t align);
+    /**
+     * @brief Free memory allocated by alloc.
+     * @param ctx, The context of the allocator.
+     * @param ptr, Pointer that will be freed.
+     * @param size, The size passed to alloc for this pointer.
+     */
+    void (*free)(void* ctx, void* ptr, size_t size);
+    void* ctx;
+} allocator_t;
+
+/**
+ * Set of memory pools with different object sizes, a request is served by the pool with the
+ * smallest object size that fits. An exhausted pool fails the request instead of spilling into a
+ * larger pool so every pool keeps its budget.
+ */
+typedef struct pool_set
+{
+    mem_pool_t** pools;
+    size_t count;
+} pool_set_t;
+
+void* std_allocator_alloc(void* ctx, size_t size, size_t align);
+void std_allocator_free(void* ctx, void* ptr, size_t size);
+
+#define STD_ALLOCATOR                                                                              \
+    {                                                                                              \
+        .alloc = std_allocator_alloc, .free = std_allocator_free, .ctx = NULL                      \
+    }
+
+// Allocator backed by the C library heap.
+extern const allocator_t std_allocator;
+
+static inline void* allocator_alloc(const allocator_t* allocator, size_t size, size_t align)
+{
+    return allocator->alloc(allocator->ctx, size, align);
+}
+
+static inline void allocator_free(const allocator_t* allocator, void* ptr, size_t size)
+{
+    allocator->free(allocator->ctx, ptr, size);
+}
+
+/**
+ * @brief Initialize an allocator that hands out objects of a memory pool, allocations larger than
+ * the object size of the pool fail.
+ * @param allocator, The allocator to initialize.
+ * @param pool, The pool to allocate from.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_pool_allocator(allocator_t* allocator, mem_pool_t* pool);
+
+/**
+ * @brief Initialize an allocator that hands out objects of a set of memory pools.
+ * @param allocator, The allocator to initialize.
+ * @param set, The pools to allocate from, must outlive the allocator.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_pool_set_allocator(allocator_t* allocator, pool_set_t* set);
+
+/**
+ * @brief Initialize an allocator on top of a heap.
+ * @param allocator, The allocator to initialize.
+ * @param heap, The heap to allocate from.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_heap_allocator(allocator_t* allocator, heap_t* heap);
+
+/**
+ * @brief Initialize an allocator on top of a size class allocator.
+ * @param allocator, The allocator to initialize.
+ * @param slab, The size class allocator to allocate from.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_slab_allocator(allocator_t* allocator, slab_t* slab);
+
+/**
+ * @brief Initialize an allocator on top of an arena, free is a no-op and memory is only released
+ * by resetting the arena.
+ * @param allocator, The allocator to initialize.
+ * @param arena, The arena to allocate from.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_arena_allocator(allocator_t* allocator, arena_t* arena);
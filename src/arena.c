@@ -0,0 +1,44 @@
+#include "arena.h"
+#include <errno.h>
+
+int init_arena(arena_t* arena, void* mem, size_t size)
+{
+    if (arena == NULL || mem == NULL || size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    arena->start = mem;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->failures = 0;
+
+    return 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size, size_t align)
+{
+    uintptr_t cur = (uintptr_t)arena->start + arena->used;
+    size_t pad = (align - (cur & (align - 1))) & (align - 1);
+
+    if (size > arena->size - arena->used || pad > arena->size - arena->used - size)
+    {
+        arena->failures++;
+        return NULL;
+    }
+
+    void* ptr = arena->start + arena->used + pad;
+
+    arena->used += pad + size;
+
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+
+    return ptr;
+}
+
+void arena_reset(arena_t* arena) { arena->used = 0; }
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bump pointer allocator for short lived scratch memory, an allocation only moves the offset
+ * forward and all allocations are released at once by arena_reset.
+ */
+typedef struct arena
+{
+    uint8_t* start;
+    size_t size;
+    size_t used;
+    size_t peak;
+    // Allocations that did not fit the arena.
+    size_t failures;
+} arena_t;
+
+#define INIT_ARENA(name, size)                                                                     \
+    static _Alignas(sizeof(void*)) uint8_t _##name##_arena[size];                                  \
+    static arena_t name                                                                            \
+        = { .start = _##name##_arena, .size = size, .used = 0, .peak = 0, .failures = 0 };
+
+/**
+ * @brief Initialize an arena.
+ * @param arena, The arena to initialize.
+ * @param mem, Memory to use for this arena.
+ * @param size, Size of the given memory in bytes.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_arena(arena_t* arena, void* mem, size_t size);
+
+/**
+ * @brief Allocate scratch memory from the arena, valid until the next arena_reset.
+ * @param arena, The arena to allocate from.
+ * @param size, Number of bytes to allocate.
+ * @param align, Required alignment of the memory, a power of two.
+ * @return void*, pointer to the allocated memory, or NULL if the arena is exhausted.
+ */
+void* arena_alloc(arena_t* arena, size_t size, size_t align);
+
+/**
+ * @brief Release all allocations of the arena at once.
+ * @param arena, The arena to reset.
+ */
+void arena_reset(arena_t* arena);
@@ -0,0 +1,229 @@
+#ifdef __linux__
+
+#include "chunk_pool.h"
+#include <errno.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CHUNK_HDR_SIZE ((sizeof(chunk_t) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static inline chunk_t* chunk_of(chunk_pool_t* pool, void* obj)
+{
+    return (chunk_t*)((uintptr_t)obj & ~(uintptr_t)(pool->chunk_size - 1));
+}
+
+static void* chunk_map_aligned(size_t chunk_size, int flags)
+{
+    // Map twice the chunk size and cut off the unaligned head and tail.
+    uint8_t* mem = mmap(
+        NULL, chunk_size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+
+    if (mem == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    uint8_t* aligned = (uint8_t*)(((uintptr_t)mem + chunk_size - 1) & ~(uintptr_t)(chunk_size - 1));
+    size_t head = aligned - mem;
+
+    if (head > 0)
+    {
+        munmap(mem, head);
+    }
+
+    if (chunk_size - head > 0)
+    {
+        munmap(aligned + chunk_size, chunk_size - head);
+    }
+
+    return aligned;
+}
+
+static chunk_t* chunk_map(chunk_pool_t* pool)
+{
+    void* mem = NULL;
+
+    if ((pool->flags & CHUNK_POOL_HUGETLB) && pool->chunk_size % CHUNK_POOL_HUGE_PAGE_SIZE == 0)
+    {
+        mem = chunk_map_aligned(pool->chunk_size, MAP_HUGETLB);
+    }
+
+    if (mem == NULL)
+    {
+        mem = chunk_map_aligned(pool->chunk_size, 0);
+
+        if (mem == NULL)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+        if (pool->flags & (CHUNK_POOL_HUGETLB | CHUNK_POOL_THP))
+        {
+            madvise(mem, pool->chunk_size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    chunk_t* chunk = mem;
+
+    init_mem_pool(pool->obj_size, (uint8_t*)mem + CHUNK_HDR_SIZE, pool->chunk_size - CHUNK_HDR_SIZE,
+        &chunk->objs);
+
+    chunk->in_use = 0;
+    chunk->capacity = chunk->objs.pool_size / chunk->objs.obj_size;
+
+    ilist_push_front(&pool->chunks, &chunk->link);
+
+    if (pool->chunks.size > pool->peak_chunks)
+    {
+        pool->peak_chunks = pool->chunks.size;
+    }
+
+    return chunk;
+}
+
+static void chunk_unmap(chunk_pool_t* pool, chunk_t* chunk)
+{
+    ilist_rem(&pool->chunks, &chunk->link);
+
+    if (pool->current == chunk)
+    {
+        pool->current = NULL;
+    }
+
+    munmap(chunk, pool->chunk_size);
+}
+
+int init_chunk_pool(
+    size_t obj_size, size_t chunk_size, size_t max_chunks, int flags, chunk_pool_t* out_pool)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (sizeof(void*) > obj_size)
+    {
+        obj_size = sizeof(void*);
+    }
+
+    if (out_pool == NULL || chunk_size == 0 || (chunk_size & (chunk_size - 1)) != 0
+        || chunk_size % page_size != 0 || chunk_size < CHUNK_HDR_SIZE + obj_size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    out_pool->obj_size = obj_size;
+    out_pool->chunk_size = chunk_size;
+    out_pool->max_chunks = max_chunks;
+    out_pool->flags = flags;
+    out_pool->current = NULL;
+    out_pool->in_use = 0;
+    out_pool->high_watermark = 0;
+    out_pool->peak_chunks = 0;
+
+    return ilist_init(&out_pool->chunks);
+}
+
+void* chunk_pool_alloc(chunk_pool_t* pool)
+{
+    chunk_t* chunk = pool->current;
+
+    if (chunk == NULL || chunk->in_use == chunk->capacity)
+    {
+        ilist_node_t* cur;
+
+        chunk = NULL;
+
+        ILIST_FOREACH(&pool->chunks, cur)
+        {
+            chunk_t* candidate = ILIST_ENTRY(cur, chunk_t, link);
+
+            if (candidate->in_use < candidate->capacity)
+            {
+                chunk = candidate;
+                break;
+            }
+        }
+
+        if (chunk == NULL)
+        {
+            if (pool->max_chunks != 0 && pool->chunks.size >= pool->max_chunks)
+            {
+                return NULL;
+            }
+
+            chunk = chunk_map(pool);
+
+            if (chunk == NULL)
+            {
+                return NULL;
+            }
+        }
+
+        pool->current = chunk;
+    }
+
+    chunk->in_use++;
+    pool->in_use++;
+
+    if (pool->in_use > pool->high_watermark)
+    {
+        pool->high_watermark = pool->in_use;
+    }
+
+    return mem_pool_alloc(&chunk->objs);
+}
+
+void chunk_pool_free(chunk_pool_t* pool, void* obj)
+{
+    chunk_t* chunk = chunk_of(pool, obj);
+
+    mem_pool_free(&chunk->objs, obj);
+
+    chunk->in_use--;
+    pool->in_use--;
+}
+
+size_t chunk_pool_trim(chunk_pool_t* pool, size_t keep)
+{
+    ilist_node_t *cur, *tmp;
+    size_t count = 0;
+
+    ILIST_FOREACH_SAFE(&pool->chunks, cur, tmp)
+    {
+        chunk_t* chunk = ILIST_ENTRY(cur, chunk_t, link);
+
+        if (chunk->in_use != 0)
+        {
+            continue;
+        }
+
+        if (keep > 0)
+        {
+            keep--;
+            continue;
+        }
+
+        chunk_unmap(pool, chunk);
+        count++;
+    }
+
+    return count;
+}
+
+void chunk_pool_destroy(chunk_pool_t* pool)
+{
+    ilist_node_t *cur, *tmp;
+
+    ILIST_FOREACH_SAFE(&pool->chunks, cur, tmp)
+    {
+        chunk_unmap(pool, ILIST_ENTRY(cur, chunk_t, link));
+    }
+
+    pool->in_use = 0;
+}
+
+#endif
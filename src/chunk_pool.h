@@ -0,0 +1,87 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "ilist.h"
+#include "mem_pool.h"
+#include <stddef.h>
+
+// Back chunks with explicit huge pages, falls back to normal pages when none are reserved.
+#define CHUNK_POOL_HUGETLB 0x1
+// Advise the kernel to back chunks with transparent huge pages.
+#define CHUNK_POOL_THP 0x2
+
+#define CHUNK_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * A chunk mapped for a chunk pool, the header is stored at the start of the chunk and the rest is
+ * handed out as objects by a regular mem_pool_t.
+ */
+typedef struct chunk
+{
+    ilist_node_t link;
+    mem_pool_t objs;
+    size_t in_use;
+    size_t capacity;
+} chunk_t;
+
+/**
+ * Growable object pool for Linux, an exhausted pool maps a new chunk instead of failing. Chunks are
+ * aligned to their size so the chunk owning an object is found from its address.
+ */
+typedef struct chunk_pool
+{
+    size_t obj_size;
+    size_t chunk_size;
+    size_t max_chunks;
+    int flags;
+    ilist_t chunks;
+    chunk_t* current;
+    size_t in_use;
+    size_t high_watermark;
+    size_t peak_chunks;
+} chunk_pool_t;
+
+/**
+ * @brief Initialize a growable chunk pool, no memory is mapped until the first allocation.
+ * @param obj_size, The size of the objects being allocated in this pool, the real size will be at
+ * minimum the size of pointers.
+ * @param chunk_size, Size of every chunk in bytes, must be a power of two and a multiple of the page
+ * size. Use a multiple of CHUNK_POOL_HUGE_PAGE_SIZE for CHUNK_POOL_HUGETLB.
+ * @param max_chunks, Maximum number of chunks mapped at once, 0 for no limit.
+ * @param flags, Combination of CHUNK_POOL_HUGETLB and CHUNK_POOL_THP, or 0.
+ * @param out_pool, Object into which pool will be initialized.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_chunk_pool(
+    size_t obj_size, size_t chunk_size, size_t max_chunks, int flags, chunk_pool_t* out_pool);
+
+/**
+ * @brief Allocate an object, maps a new chunk if all chunks are full.
+ * @param pool, The pool from which memory will be allocated.
+ * @return void*, pointer to the newly allocated memory, or NULL if no chunk could be mapped.
+ */
+void* chunk_pool_alloc(chunk_pool_t* pool);
+
+/**
+ * @brief Free an object, the chunk stays mapped until the pool is trimmed.
+ * @param pool, The pool to which memory will be returned.
+ * @param obj, Pointer that will be freed.
+ */
+void chunk_pool_free(chunk_pool_t* pool, void* obj);
+
+/**
+ * @brief Unmap empty chunks, intended to be called when the pool is idle.
+ * @param pool, The pool to trim.
+ * @param keep, Number of empty chunks to keep mapped.
+ * @return size_t, number of chunks unmapped.
+ */
+size_t chunk_pool_trim(chunk_pool_t* pool, size_t keep);
+
+/**
+ * @brief Unmap all chunks of the pool, objects still in use become invalid.
+ * @param pool, The pool to destroy.
+ */
+void chunk_pool_destroy(chunk_pool_t* pool);
+
+#endif
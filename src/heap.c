@@ -1,21 +1,296 @@
 #include "heap.h"
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
+
+#define BLOCK_FREE     ((size_t)0x1)
+#define BLOCK_HDR_SIZE sizeof(heap_node_t)
+// A free block must be able to hold the free list links.
+#define BLOCK_MIN_SIZE (sizeof(heap_free_node_t) - sizeof(heap_node_t))
+#define BLOCK_MAX_SIZE (((size_t)1 << HEAP_FL_INDEX_MAX) - 1)
+#define SMALL_BLOCK    ((size_t)1 << HEAP_FL_INDEX_SHIFT)
 
 static inline int is_aligned(void* ptr, size_t alignment)
 {
     return ((uintptr_t)ptr & (alignment - 1)) == 0;
 }
 
-static inline int is_allocated(void* ptr) { return ((uintptr_t)ptr) & 0x1; }
+static inline uintptr_t align_up(uintptr_t val, size_t alignment)
+{
+    return (val + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+}
+
+static inline uintptr_t align_down(uintptr_t val, size_t alignment)
+{
+    return val & ~(uintptr_t)(alignment - 1);
+}
+
+// Index of the most significant set bit.
+static inline int heap_fls(size_t val)
+{
+#if defined(__GNUC__)
+    return (int)(sizeof(unsigned long long) * 8) - 1 - __builtin_clzll(val);
+#else
+    int bit = -1;
+    while (val)
+    {
+        val >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// Index of the least significant set bit.
+static inline int heap_ffs(uint32_t val)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(val);
+#else
+    int bit = 0;
+    while (!(val & 1))
+    {
+        val >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static inline size_t heap_unit(heap_t* heap)
+{
+    return (heap->alignment > sizeof(void*)) ? heap->alignment : sizeof(void*);
+}
+
+static inline size_t block_size(heap_node_t* block) { return block->size & ~BLOCK_FREE; }
+
+static inline int block_is_free(heap_node_t* block) { return block->size & BLOCK_FREE; }
+
+static inline void* block_to_ptr(heap_node_t* block) { return (uint8_t*)block + BLOCK_HDR_SIZE; }
+
+static inline heap_node_t* ptr_to_block(void* ptr)
+{
+    return (heap_node_t*)((uint8_t*)ptr - BLOCK_HDR_SIZE);
+}
+
+static inline heap_node_t* block_next(heap_node_t* block)
+{
+    return (heap_node_t*)((uint8_t*)block_to_ptr(block) + block_size(block));
+}
+
+// Round a requested size so header and payload together are a multiple of the heap alignment,
+// this keeps the payload of every block aligned.
+static inline size_t adjust_size(heap_t* heap, size_t size)
+{
+    size_t unit = heap_unit(heap);
+
+    if (size < BLOCK_MIN_SIZE)
+    {
+        size = BLOCK_MIN_SIZE;
+    }
+
+    return align_up(size + BLOCK_HDR_SIZE, unit) - BLOCK_HDR_SIZE;
+}
+
+static inline void mapping_insert(size_t size, int* fl, int* sl)
+{
+    if (size < SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK / HEAP_SL_INDEX_COUNT));
+    }
+    else
+    {
+        int msb = heap_fls(size);
+        *sl = (int)(size >> (msb - HEAP_SL_INDEX_COUNT_LOG2)) ^ HEAP_SL_INDEX_COUNT;
+        *fl = msb - (HEAP_FL_INDEX_SHIFT - 1);
+    }
+}
+
+// Map a size to the first list whose blocks are all at least that size.
+static inline void mapping_search(size_t size, int* fl, int* sl)
+{
+    if (size >= SMALL_BLOCK)
+    {
+        size += ((size_t)1 << (heap_fls(size) - HEAP_SL_INDEX_COUNT_LOG2)) - 1;
+    }
+
+    mapping_insert(size, fl, sl);
+}
+
+static void insert_free_block(heap_t* heap, heap_node_t* block)
+{
+    int fl, sl;
+    heap_free_node_t* node = (heap_free_node_t*)block;
 
-static inline void* set_allocated(void* ptr) { return (void*)(((uintptr_t)ptr) | 0x1); }
+    mapping_insert(block_size(block), &fl, &sl);
 
-static inline void* clear_allocated(void* ptr) { return (void*)(((uintptr_t)ptr) & ~0x1); }
+    node->prev_free = NULL;
+    node->next_free = heap->free_blocks[fl][sl];
+
+    if (node->next_free != NULL)
+    {
+        node->next_free->prev_free = node;
+    }
+
+    heap->free_blocks[fl][sl] = node;
+    heap->fl_bitmap |= (uint32_t)1 << fl;
+    heap->sl_bitmap[fl] |= (uint32_t)1 << sl;
+    heap->free += block_size(block);
+
+    block->size |= BLOCK_FREE;
+}
+
+static void remove_free_block(heap_t* heap, heap_node_t* block)
+{
+    int fl, sl;
+    heap_free_node_t* node = (heap_free_node_t*)block;
+
+    mapping_insert(block_size(block), &fl, &sl);
+
+    if (node->next_free != NULL)
+    {
+        node->next_free->prev_free = node->prev_free;
+    }
+
+    if (node->prev_free != NULL)
+    {
+        node->prev_free->next_free = node->next_free;
+    }
+    else
+    {
+        heap->free_blocks[fl][sl] = node->next_free;
+
+        // Clear the bitmaps when the list became empty.
+        if (node->next_free == NULL)
+        {
+            heap->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+
+            if (heap->sl_bitmap[fl] == 0)
+            {
+                heap->fl_bitmap &= ~((uint32_t)1 << fl);
+            }
+        }
+    }
+
+    heap->free -= block_size(block);
+    block->size &= ~BLOCK_FREE;
+}
+
+// Find a block in the list the size itself maps to, only needed when the rounded up search
+// failed, for instance when the whole pool is requested.
+static heap_node_t* find_free_block_exact(heap_t* heap, size_t size)
+{
+    int fl, sl;
+
+    mapping_insert(size, &fl, &sl);
+
+    if (fl >= HEAP_FL_INDEX_COUNT)
+    {
+        return NULL;
+    }
+
+    heap_free_node_t* cur = heap->free_blocks[fl][sl];
+
+    while (cur != NULL && block_size(&cur->hdr) < size)
+    {
+        cur = cur->next_free;
+    }
+
+    return (cur != NULL) ? &cur->hdr : NULL;
+}
+
+static heap_node_t* find_free_block(heap_t* heap, size_t size)
+{
+    int fl, sl;
+
+    mapping_search(size, &fl, &sl);
+
+    if (fl >= HEAP_FL_INDEX_COUNT)
+    {
+        return find_free_block_exact(heap, size);
+    }
+
+    uint32_t sl_map = heap->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+
+    // No block in this first level is large enough, take the next non-empty first level.
+    if (sl_map == 0)
+    {
+        uint32_t fl_map = (fl + 1 < 32) ? heap->fl_bitmap & (~(uint32_t)0 << (fl + 1)) : 0;
+
+        if (fl_map == 0)
+        {
+            return find_free_block_exact(heap, size);
+        }
+
+        fl = heap_ffs(fl_map);
+        sl_map = heap->sl_bitmap[fl];
+    }
+
+    sl = heap_ffs(sl_map);
+
+    return &heap->free_blocks[fl][sl]->hdr;
+}
+
+// Split off the tail of a block beyond size as a new free block if it is large enough.
+static void split_block(heap_t* heap, heap_node_t* block, size_t size)
+{
+    size_t cur_size = block_size(block);
+
+    if (cur_size < size + BLOCK_HDR_SIZE + BLOCK_MIN_SIZE)
+    {
+        return;
+    }
+
+    heap_node_t* rest = (heap_node_t*)((uint8_t*)block_to_ptr(block) + size);
+    rest->prev_phys = block;
+    rest->size = cur_size - size - BLOCK_HDR_SIZE;
+    block->size = size | (block->size & BLOCK_FREE);
+
+    block_next(rest)->prev_phys = rest;
+
+    insert_free_block(heap, rest);
+}
+
+// Merge a block with its free physical neighbours, the block itself must not be in a free list.
+static heap_node_t* merge_block(heap_t* heap, heap_node_t* block)
+{
+    heap_node_t* prev = block->prev_phys;
+
+    if (prev != NULL && block_is_free(prev))
+    {
+        remove_free_block(heap, prev);
+        prev->size += block_size(block) + BLOCK_HDR_SIZE;
+        block = prev;
+        block_next(block)->prev_phys = block;
+    }
+
+    heap_node_t* next = block_next(block);
+
+    if (block_is_free(next))
+    {
+        remove_free_block(heap, next);
+        block->size += block_size(next) + BLOCK_HDR_SIZE;
+        block_next(block)->prev_phys = block;
+    }
+
+    return block;
+}
+
+static inline void mark_used(heap_t* heap, heap_node_t* block)
+{
+    heap->used += block_size(block);
+
+    if (heap->used > heap->peak)
+    {
+        heap->peak = heap->used;
+    }
+}
 
 int init_heap(heap_t* heap, void* pool, size_t pool_size, size_t alignment)
 {
-    if (heap == NULL || pool == NULL || alignment < 2 || !(is_aligned(pool, alignment)))
+    if (heap == NULL || pool == NULL || alignment < 2 || (alignment & (alignment - 1))
+        || !(is_aligned(pool, alignment)))
     {
         errno = EINVAL;
         return -1;
@@ -24,11 +299,59 @@ int init_heap(heap_t* heap, void* pool, size_t pool_size, size_t alignment)
     heap->pool_start = pool;
     heap->pool_size = pool_size;
     heap->alignment = alignment;
-    heap->blocks = pool;
+    heap->used = 0;
+    heap->peak = 0;
+    heap->free = 0;
+    heap->fl_bitmap = 0;
+
+    for (int fl = 0; fl < HEAP_FL_INDEX_COUNT; ++fl)
+    {
+        heap->sl_bitmap[fl] = 0;
+
+        for (int sl = 0; sl < HEAP_SL_INDEX_COUNT; ++sl)
+        {
+            heap->free_blocks[fl][sl] = NULL;
+        }
+    }
+
+    size_t unit = heap_unit(heap);
+    uintptr_t start = (uintptr_t)pool;
+    uintptr_t end = start + pool_size;
+
+    // Place the first block so its payload is aligned.
+    uintptr_t first = align_up(start + BLOCK_HDR_SIZE, unit) - BLOCK_HDR_SIZE;
 
-    heap_node_t* block = heap->blocks;
-    block->size = pool_size - sizeof(heap_node_t);
-    block->next = NULL;
+    heap->blocks = (void*)first;
+
+    // The pool must hold one minimal block and the used sentinel block that ends the pool.
+    if (first + 2 * BLOCK_HDR_SIZE + BLOCK_MIN_SIZE > end)
+    {
+        heap->blocks = pool;
+        return 0;
+    }
+
+    size_t stride = align_down(end - BLOCK_HDR_SIZE - first, unit);
+
+    if (stride - BLOCK_HDR_SIZE > BLOCK_MAX_SIZE)
+    {
+        stride = align_down(BLOCK_MAX_SIZE + BLOCK_HDR_SIZE, unit);
+    }
+
+    if (stride < BLOCK_HDR_SIZE + BLOCK_MIN_SIZE)
+    {
+        heap->blocks = pool;
+        return 0;
+    }
+
+    heap_node_t* block = (heap_node_t*)first;
+    block->prev_phys = NULL;
+    block->size = stride - BLOCK_HDR_SIZE;
+
+    heap_node_t* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    insert_free_block(heap, block);
 
     return 0;
 }
@@ -41,67 +364,222 @@ void* heap_alloc(heap_t* heap, size_t size)
         return NULL;
     }
 
-    size_t aligned_size = (is_aligned((void*)size, heap->alignment))
-        ? size
-        : size + (heap->alignment - (size % heap->alignment));
+    if (size > BLOCK_MAX_SIZE)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t aligned_size = adjust_size(heap, size);
 
-    heap_node_t* cur = heap->blocks;
+    heap_node_t* block = find_free_block(heap, aligned_size);
+
+    if (block == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    remove_free_block(heap, block);
+    split_block(heap, block, aligned_size);
+    mark_used(heap, block);
+
+    return block_to_ptr(block);
+}
+
+void heap_free(heap_t* heap, void* obj)
+{
+    if (heap == NULL || obj == NULL)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    heap_node_t* block = ptr_to_block(obj);
+
+    heap->used -= block_size(block);
+    block = merge_block(heap, block);
+
+    insert_free_block(heap, block);
+}
+
+void* heap_realloc(heap_t* heap, void* obj, size_t size)
+{
+    if (heap == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (obj == NULL)
+    {
+        return heap_alloc(heap, size);
+    }
+
+    if (size == 0)
+    {
+        heap_free(heap, obj);
+        return NULL;
+    }
+
+    if (size > BLOCK_MAX_SIZE)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    heap_node_t* block = ptr_to_block(obj);
+    size_t cur_size = block_size(block);
+    size_t aligned_size = adjust_size(heap, size);
+    heap_node_t* next = block_next(block);
+
+    // Grow in place by taking over the following free block.
+    if (aligned_size > cur_size && block_is_free(next)
+        && cur_size + BLOCK_HDR_SIZE + block_size(next) >= aligned_size)
+    {
+        remove_free_block(heap, next);
+        block->size += block_size(next) + BLOCK_HDR_SIZE;
+        block_next(block)->prev_phys = block;
+    }
 
-    while (cur != NULL)
+    if (block_size(block) >= aligned_size)
     {
-        // Merge with the next block if it is free
-        while (!is_allocated(cur->next) && cur->next != NULL && !is_allocated(cur->next->next))
+        heap->used -= cur_size;
+        split_block(heap, block, aligned_size);
+
+        // Merge a split off tail with a free block behind it.
+        heap_node_t* rest = block_next(block);
+
+        if (block_is_free(rest))
         {
-            cur->size += cur->next->size + sizeof(heap_node_t);
-            cur->next = cur->next->next;
+            remove_free_block(heap, rest);
+            insert_free_block(heap, merge_block(heap, rest));
         }
 
-        // Check if this block is large enough and not already allocated
-        if (cur->size >= aligned_size && !is_allocated(cur->next))
-        {
-            // Check if we can split the block
-            if (cur->size - aligned_size > sizeof(heap_node_t))
-            {
-                // Create a new block
-                heap_node_t* new_block
-                    = (heap_node_t*)((uintptr_t)cur + aligned_size + sizeof(heap_node_t));
-                // Set the new block size
-                new_block->size = cur->size - aligned_size - sizeof(heap_node_t);
-                // Set the new block next pointer
-                new_block->next = cur->next;
-
-                cur->size = aligned_size;
-                cur->next = new_block;
-            }
+        mark_used(heap, block);
 
-            cur->next = set_allocated(cur->next);
+        return obj;
+    }
 
-            return (void*)((uintptr_t)cur + sizeof(heap_node_t));
-        }
+    void* new_obj = heap_alloc(heap, size);
 
-        cur = clear_allocated(cur->next);
+    if (new_obj == NULL)
+    {
+        return NULL;
     }
 
-    errno = ENOMEM;
-    return NULL;
+    memcpy(new_obj, obj, cur_size);
+    heap_free(heap, obj);
+
+    return new_obj;
 }
 
-void heap_free(heap_t* heap, void* obj)
+void* heap_aligned_alloc(heap_t* heap, size_t size, size_t alignment)
 {
-    if (heap == NULL || obj == NULL)
+    if (heap == NULL || size == 0 || alignment == 0 || (alignment & (alignment - 1)))
     {
         errno = EINVAL;
-        return;
+        return NULL;
     }
 
-    // Get the block to free
-    heap_node_t* cur = obj - sizeof(heap_node_t);
-    cur->next = clear_allocated(cur->next);
+    if (alignment <= heap_unit(heap))
+    {
+        return heap_alloc(heap, size);
+    }
+
+    if (size > BLOCK_MAX_SIZE - alignment - BLOCK_HDR_SIZE - BLOCK_MIN_SIZE)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t aligned_size = adjust_size(heap, size);
+
+    // Leave room to split off a leading free block that moves the payload onto the alignment.
+    heap_node_t* block
+        = find_free_block(heap, aligned_size + alignment + BLOCK_HDR_SIZE + BLOCK_MIN_SIZE);
+
+    if (block == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    remove_free_block(heap, block);
 
-    // Merge with the next block if it is free
-    if (cur->next != NULL && !is_allocated(cur->next->next))
+    uintptr_t payload = (uintptr_t)block_to_ptr(block);
+    uintptr_t aligned = align_up(payload, alignment);
+
+    // A leading gap must fit a block of its own.
+    if (aligned != payload && aligned - payload < BLOCK_HDR_SIZE + BLOCK_MIN_SIZE)
     {
-        cur->size += cur->next->size + sizeof(heap_node_t);
-        cur->next = cur->next->next;
+        aligned = align_up(payload + BLOCK_HDR_SIZE + BLOCK_MIN_SIZE, alignment);
     }
-}
\ No newline at end of file
+
+    if (aligned != payload)
+    {
+        size_t gap = aligned - payload;
+        heap_node_t* aligned_block = ptr_to_block((void*)aligned);
+
+        aligned_block->prev_phys = block;
+        aligned_block->size = block_size(block) - gap;
+        block->size = gap - BLOCK_HDR_SIZE;
+        block_next(aligned_block)->prev_phys = aligned_block;
+
+        // The previous physical block of a free block is always in use, no merge is needed.
+        insert_free_block(heap, block);
+        block = aligned_block;
+    }
+
+    split_block(heap, block, aligned_size);
+    mark_used(heap, block);
+
+    return block_to_ptr(block);
+}
+
+int heap_get_stats(heap_t* heap, heap_stats_t* stats)
+{
+    if (heap == NULL || stats == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    stats->used = heap->used;
+    stats->peak = heap->peak;
+    stats->free = heap->free;
+    stats->free_blocks = 0;
+    stats->largest_free = 0;
+    stats->fragmentation = 0.0f;
+
+    // A pool too small for a single block holds no blocks to walk.
+    if (heap->used == 0 && heap->free == 0)
+    {
+        return 0;
+    }
+
+    heap_node_t* cur = heap->blocks;
+
+    // The used sentinel ending the pool is the only block with a size of 0.
+    while (block_size(cur) != 0)
+    {
+        if (block_is_free(cur))
+        {
+            stats->free_blocks++;
+
+            if (block_size(cur) > stats->largest_free)
+            {
+                stats->largest_free = block_size(cur);
+            }
+        }
+
+        cur = block_next(cur);
+    }
+
+    if (stats->free > 0)
+    {
+        stats->fragmentation = 1.0f - (float)stats->largest_free / (float)stats->free;
+    }
+
+    return 0;
+}
@@ -1,6 +1,44 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Two-level segregated fit (TLSF) heap. Free blocks are kept in size segregated lists indexed by
+ * a first level (power of two) and a second level (linear subdivision), a pair of bitmaps makes
+ * finding a suitable block O(1). Every block carries a boundary tag to its physical predecessor so
+ * freed blocks are merged with both neighbours in O(1).
+ */
+
+// Number of second level subdivisions per power of two, log2.
+#ifndef HEAP_SL_INDEX_COUNT_LOG2
+#define HEAP_SL_INDEX_COUNT_LOG2 4
+#endif
+
+// Largest supported block size, log2.
+#ifndef HEAP_FL_INDEX_MAX
+#define HEAP_FL_INDEX_MAX 30
+#endif
+
+#define HEAP_SL_INDEX_COUNT (1 << HEAP_SL_INDEX_COUNT_LOG2)
+#define HEAP_ALIGN_SIZE_LOG2 ((sizeof(void*) == 8) ? 3 : 2)
+#define HEAP_FL_INDEX_SHIFT  (HEAP_SL_INDEX_COUNT_LOG2 + HEAP_ALIGN_SIZE_LOG2)
+#define HEAP_FL_INDEX_COUNT  (HEAP_FL_INDEX_MAX - HEAP_FL_INDEX_SHIFT + 1)
+
+typedef struct heap_node
+{
+    // Boundary tag, the physically preceding block or NULL for the first block.
+    struct heap_node* prev_phys;
+    // Size of the payload, bit 0 is set when the block is free.
+    size_t size;
+} heap_node_t;
+
+typedef struct heap_free_node
+{
+    heap_node_t hdr;
+    struct heap_free_node* next_free;
+    struct heap_free_node* prev_free;
+} heap_free_node_t;
 
 typedef struct heap
 {
@@ -8,13 +46,27 @@ typedef struct heap
     size_t alignment;
     void* pool_start;
     void* blocks;
+    size_t used;
+    size_t peak;
+    size_t free;
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[HEAP_FL_INDEX_COUNT];
+    heap_free_node_t* free_blocks[HEAP_FL_INDEX_COUNT][HEAP_SL_INDEX_COUNT];
 } heap_t;
 
-typedef struct heap_node
+typedef struct heap_stats
 {
-    size_t size;
-    struct heap_node* next;
-} heap_node_t;
+    // Payload bytes of allocated blocks.
+    size_t used;
+    // Highest value of used since the heap was initialized.
+    size_t peak;
+    // Payload bytes of free blocks.
+    size_t free;
+    size_t free_blocks;
+    size_t largest_free;
+    // External fragmentation, 1 - largest_free / free, 0 when all free memory is one block.
+    float fragmentation;
+} heap_stats_t;
 
 /**
  * @brief Initialize a heap.
@@ -41,3 +93,32 @@ void* heap_alloc(heap_t* heap, size_t size);
  * @param obj, Pointer that will be freed.
  */
 void heap_free(heap_t* heap, void* obj);
+
+/**
+ * @brief Resize an allocation, grows in place when the following block is free.
+ * @param heap, The heap the memory was allocated from.
+ * @param obj, The allocation to resize, when NULL this behaves like heap_alloc.
+ * @param size, The new size, when 0 the memory is freed and NULL is returned.
+ * @return void*, pointer to the resized memory, or NULL if no memory was free in which case obj is
+ * left untouched.
+ * @note When the allocation has to move only the heap alignment is guaranteed.
+ */
+void* heap_realloc(heap_t* heap, void* obj, size_t size);
+
+/**
+ * @brief Allocate some memory from the heap with an alignment larger than the heap alignment.
+ * @param heap, The heap from which memory will be allocated.
+ * @param size, The size of the memory to allocate.
+ * @param alignment, The alignment of the memory, must be a power of 2.
+ * @return void*, pointer to the newly allocated memory, or NULL if no memory was free. The memory
+ * is freed with heap_free.
+ */
+void* heap_aligned_alloc(heap_t* heap, size_t size, size_t alignment);
+
+/**
+ * @brief Get usage statistics of the heap, walks all blocks of the heap.
+ * @param heap, The heap to get the statistics of.
+ * @param stats, Object into which the statistics are written.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int heap_get_stats(heap_t* heap, heap_stats_t* stats);
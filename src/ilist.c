@@ -0,0 +1,94 @@
+#include <errno.h>
+
+#include "ilist.h"
+
+int ilist_init(ilist_t* list)
+{
+    if (list == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    list->size = 0;
+    list->first = NULL;
+    list->last = NULL;
+
+    return 0;
+}
+
+void ilist_push(ilist_t* list, ilist_node_t* node)
+{
+    node->next = NULL;
+    node->prev = list->last;
+
+    if (list->last != NULL)
+    {
+        list->last->next = node;
+    }
+    else
+    {
+        list->first = node;
+    }
+
+    list->last = node;
+    list->size++;
+}
+
+void ilist_push_front(ilist_t* list, ilist_node_t* node)
+{
+    node->prev = NULL;
+    node->next = list->first;
+
+    if (list->first != NULL)
+    {
+        list->first->prev = node;
+    }
+    else
+    {
+        list->last = node;
+    }
+
+    list->first = node;
+    list->size++;
+}
+
+void ilist_rem(ilist_t* list, ilist_node_t* node)
+{
+    // Move the previous pointer if set, otherwise this was the first node.
+    if (node->prev != NULL)
+    {
+        node->prev->next = node->next;
+    }
+    else
+    {
+        list->first = node->next;
+    }
+
+    // Move the next pointer if set, otherwise this was the last node.
+    if (node->next != NULL)
+    {
+        node->next->prev = node->prev;
+    }
+    else
+    {
+        list->last = node->prev;
+    }
+
+    node->next = NULL;
+    node->prev = NULL;
+
+    list->size--;
+}
+
+ilist_node_t* ilist_pop_front(ilist_t* list)
+{
+    ilist_node_t* node = list->first;
+
+    if (node != NULL)
+    {
+        ilist_rem(list, node);
+    }
+
+    return node;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Intrusive doubly linked list, the link is embedded into the owning object so no memory is
+ * allocated when an object is added to a list and an object can be unlinked in O(1).
+ */
+typedef struct ilist_node
+{
+    struct ilist_node* next;
+    struct ilist_node* prev;
+} ilist_node_t;
+
+typedef struct ilist
+{
+    size_t size;
+    ilist_node_t* first;
+    ilist_node_t* last;
+} ilist_t;
+
+#define INIT_ILIST(name) static ilist_t name = { .size = 0, .first = NULL, .last = NULL };
+
+/**
+ * @brief Get the object that embeds a list node.
+ * @param node, Pointer to the embedded node.
+ * @param type, Type of the object that embeds the node.
+ * @param member, Name of the node member in the object.
+ */
+#define ILIST_ENTRY(node, type, member) ((type*)((char*)(node)-offsetof(type, member)))
+
+/**
+ * @brief Iterate through a list, the current node may be unlinked (and freed) during iteration.
+ * @param list, Pointer to the list to iterate.
+ * @param cur, ilist_node_t* variable that holds the current node.
+ * @param tmp, ilist_node_t* variable used to store the next node.
+ */
+#define ILIST_FOREACH_SAFE(list, cur, tmp)                                                         \
+    for ((cur) = (list)->first, (tmp) = ((cur) != NULL) ? (cur)->next : NULL; (cur) != NULL;       \
+         (cur) = (tmp), (tmp) = ((cur) != NULL) ? (cur)->next : NULL)
+
+/**
+ * @brief Iterate through a list, the current node must not be unlinked during iteration.
+ * @param list, Pointer to the list to iterate.
+ * @param cur, ilist_node_t* variable that holds the current node.
+ */
+#define ILIST_FOREACH(list, cur) for ((cur) = (list)->first; (cur) != NULL; (cur) = (cur)->next)
+
+/**
+ * @brief Initialize an empty intrusive list.
+ * @param list, The list to initialize.
+ * @return int, -1 on failure and sets errno, otherwise 0
+ */
+int ilist_init(ilist_t* list);
+
+/**
+ * @brief Append a node to the end of the list.
+ * @param list, The list to append the node to.
+ * @param node, The node to append, must not be part of any list.
+ */
+void ilist_push(ilist_t* list, ilist_node_t* node);
+
+/**
+ * @brief Prepend a node to the start of the list.
+ * @param list, The list to prepend the node to.
+ * @param node, The node to prepend, must not be part of any list.
+ */
+void ilist_push_front(ilist_t* list, ilist_node_t* node);
+
+/**
+ * @brief Remove a node from the list.
+ * @param list, The list that contains the node.
+ * @param node, The node to remove.
+ */
+void ilist_rem(ilist_t* list, ilist_node_t* node);
+
+/**
+ * @brief Remove the first node from the list.
+ * @param list, The list to remove the first node from.
+ * @return ilist_node_t*, The removed node or NULL if the list was empty.
+ */
+ilist_node_t* ilist_pop_front(ilist_t* list);
@@ -1,26 +1,28 @@
 #pragma once
 
-#include "types.h"
+#include "ilist.h"
+#include "allocator.h"
 
+/**
+ * Index based list that stores pointers to objects, each element allocates a node through the
+ * allocator of the list. Kept as a compatibility layer on top of the intrusive list, prefer
+ * embedding an ilist_node_t in the object itself.
+ */
 typedef struct node
 {
+    ilist_node_t link;
     void* data;
-    struct node* next;
-    struct node* prev;
 } node_t;
 
 typedef struct linked_list
 {
-    size_t size;
-    node_t* first;
-    node_t* last;
-    alloc_fn allocator;
-    free_fn free;
+    ilist_t nodes;
+    allocator_t allocator;
 } linked_list_t;
 
-#define INIT_LINKED_LIST(name, alloc, free_fn)                                                     \
-    static linked_list_t name                                                                      \
-        = { .size = 0, .first = NULL, .last = NULL, .allocator = alloc, .free = free_fn };
+#define INIT_LINKED_LIST(name, alloc)                                                              \
+    static linked_list_t name = { .nodes = { .size = 0, .first = NULL, .last = NULL },             \
+        .allocator = alloc };
 
 /**
  * @brief Iterator callback
@@ -34,12 +36,11 @@ typedef int (*iter_cb_t)(void* obj, size_t i, void* ctx);
 
 /**
  * @brief Initialize a linked list using an allocator.
- * @param allocator, Pointer to function to use for allocating nodes in the linked list.
- * @param free, Pointer to function to free allocated memory with.
+ * @param allocator, Allocator used for the nodes of the linked list, copied into the list.
  * @param list, Pointer to the linked list object that should be initialized
  * @return int, -1 on failure and sets errno, otherwise 0
  */
-int linked_list_init(alloc_fn allocator, free_fn free, linked_list_t* list);
+int linked_list_init(const allocator_t* allocator, linked_list_t* list);
 
 /**
  * @brief Push an element to the end of the linked list.
@@ -67,7 +68,8 @@ void* linked_list_get(linked_list_t* list, size_t i);
 void* linked_list_rem(linked_list_t* list, size_t i);
 
 /**
- * @brief Iterate through a linked list using a callback function with a given context.
+ * @brief Iterate through a linked list using a callback function with a given context, the current
+ * object may be removed by the callback.
  * @param list, The list to iterate through.
  * @param iter_cb, The function to call for every iterated object.
  * @param ctx, A context passed into the function which may point to some relevant object.
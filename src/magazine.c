@@ -0,0 +1,191 @@
+#include "magazine.h"
+#include <errno.h>
+
+static inline void depot_lock(mag_depot_t* depot)
+{
+    while (atomic_flag_test_and_set_explicit(&depot->lock, memory_order_acquire))
+        ;
+}
+
+static inline void depot_unlock(mag_depot_t* depot)
+{
+    atomic_flag_clear_explicit(&depot->lock, memory_order_release);
+}
+
+static inline magazine_t* mag_pop(magazine_t** list)
+{
+    magazine_t* mag = *list;
+
+    if (mag != NULL)
+    {
+        *list = mag->next;
+    }
+
+    return mag;
+}
+
+static inline void mag_push(magazine_t** list, magazine_t* mag)
+{
+    mag->next = *list;
+    *list = mag;
+}
+
+static inline void mag_swap(mag_cache_t* cache)
+{
+    magazine_t* tmp = cache->loaded;
+    cache->loaded = cache->previous;
+    cache->previous = tmp;
+}
+
+int init_mag_depot(mag_depot_t* depot, mem_pool_mt_t* pool, magazine_t* mags, size_t mag_count)
+{
+    if (depot == NULL || pool == NULL || (mags == NULL && mag_count > 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    depot->pool = pool;
+    depot->full = NULL;
+    depot->empty = NULL;
+    atomic_flag_clear(&depot->lock);
+
+    for (size_t i = 0; i < mag_count; ++i)
+    {
+        mags[i].rounds = 0;
+        mag_push(&depot->empty, &mags[i]);
+    }
+
+    return 0;
+}
+
+int init_mag_cache(mag_cache_t* cache, mag_depot_t* depot)
+{
+    if (cache == NULL || depot == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    depot_lock(depot);
+
+    cache->loaded = mag_pop(&depot->empty);
+    cache->previous = mag_pop(&depot->empty);
+
+    if (cache->previous == NULL)
+    {
+        if (cache->loaded != NULL)
+        {
+            mag_push(&depot->empty, cache->loaded);
+        }
+
+        depot_unlock(depot);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    depot_unlock(depot);
+
+    cache->depot = depot;
+
+    return 0;
+}
+
+void mag_cache_release(mag_cache_t* cache)
+{
+    mag_depot_t* depot = cache->depot;
+    magazine_t* mags[2] = { cache->loaded, cache->previous };
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        while (mags[i]->rounds > 0)
+        {
+            mem_pool_mt_free(depot->pool, mags[i]->objs[--mags[i]->rounds]);
+        }
+    }
+
+    depot_lock(depot);
+    mag_push(&depot->empty, mags[0]);
+    mag_push(&depot->empty, mags[1]);
+    depot_unlock(depot);
+
+    cache->loaded = NULL;
+    cache->previous = NULL;
+}
+
+void* mag_cache_alloc(mag_cache_t* cache)
+{
+    if (cache->loaded->rounds > 0)
+    {
+        return cache->loaded->objs[--cache->loaded->rounds];
+    }
+
+    if (cache->previous->rounds > 0)
+    {
+        mag_swap(cache);
+        return cache->loaded->objs[--cache->loaded->rounds];
+    }
+
+    // Both magazines are empty, trade one of them for a full magazine from the depot.
+    mag_depot_t* depot = cache->depot;
+
+    depot_lock(depot);
+
+    magazine_t* full = mag_pop(&depot->full);
+
+    if (full != NULL)
+    {
+        mag_push(&depot->empty, cache->previous);
+        cache->previous = cache->loaded;
+        cache->loaded = full;
+    }
+
+    depot_unlock(depot);
+
+    if (full != NULL)
+    {
+        return cache->loaded->objs[--cache->loaded->rounds];
+    }
+
+    return mem_pool_mt_alloc(depot->pool);
+}
+
+void mag_cache_free(mag_cache_t* cache, void* obj)
+{
+    if (cache->loaded->rounds < MAGAZINE_SIZE)
+    {
+        cache->loaded->objs[cache->loaded->rounds++] = obj;
+        return;
+    }
+
+    if (cache->previous->rounds < MAGAZINE_SIZE)
+    {
+        mag_swap(cache);
+        cache->loaded->objs[cache->loaded->rounds++] = obj;
+        return;
+    }
+
+    // Both magazines are full, trade one of them for an empty magazine from the depot.
+    mag_depot_t* depot = cache->depot;
+
+    depot_lock(depot);
+
+    magazine_t* empty = mag_pop(&depot->empty);
+
+    if (empty != NULL)
+    {
+        mag_push(&depot->full, cache->previous);
+        cache->previous = cache->loaded;
+        cache->loaded = empty;
+    }
+
+    depot_unlock(depot);
+
+    if (empty != NULL)
+    {
+        cache->loaded->objs[cache->loaded->rounds++] = obj;
+        return;
+    }
+
+    mem_pool_mt_free(depot->pool, obj);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "mem_pool_mt.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define MAGAZINE_SIZE 16
+
+/**
+ * A fixed size stack of free objects, magazines move between thread caches and the depot as a
+ * whole.
+ */
+typedef struct magazine
+{
+    struct magazine* next;
+    size_t rounds;
+    void* objs[MAGAZINE_SIZE];
+} magazine_t;
+
+/**
+ * Shared exchange of full and empty magazines in front of a thread safe pool. The depot lock is
+ * only taken once every MAGAZINE_SIZE operations of a thread.
+ */
+typedef struct mag_depot
+{
+    mem_pool_mt_t* pool;
+    atomic_flag lock;
+    magazine_t* full;
+    magazine_t* empty;
+} mag_depot_t;
+
+/**
+ * Per thread object cache, must only be used by one thread at a time.
+ */
+typedef struct mag_cache
+{
+    mag_depot_t* depot;
+    magazine_t* loaded;
+    magazine_t* previous;
+} mag_cache_t;
+
+/**
+ * @brief Initialize a magazine depot.
+ * @param depot, Depot to initialize.
+ * @param pool, Pool from which objects are allocated when no full magazine is available.
+ * @param mags, Magazines owned by the depot, every thread cache takes two of them.
+ * @param mag_count, Number of magazines in mags.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_mag_depot(mag_depot_t* depot, mem_pool_mt_t* pool, magazine_t* mags, size_t mag_count);
+
+/**
+ * @brief Initialize a thread cache and take two empty magazines from the depot.
+ * @param cache, Cache to initialize.
+ * @param depot, Depot the cache exchanges magazines with.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int init_mag_cache(mag_cache_t* cache, mag_depot_t* depot);
+
+/**
+ * @brief Return all cached objects to the pool and the magazines of the cache to the depot.
+ * @param cache, Cache to release, must be initialized again before further use.
+ */
+void mag_cache_release(mag_cache_t* cache);
+
+/**
+ * @brief Allocate an object through the thread cache.
+ * @param cache, The cache of the calling thread.
+ * @return void*, pointer to the newly allocated memory, or NULL if no memory was free.
+ */
+void* mag_cache_alloc(mag_cache_t* cache);
+
+/**
+ * @brief Free an object through the thread cache.
+ * @param cache, The cache of the calling thread.
+ * @param obj, Pointer that will be freed, may have been allocated by any cache of the same depot.
+ */
+void mag_cache_free(mag_cache_t* cache, void* obj);
@@ -1,17 +1,36 @@
 #include <stdint.h>
 
 #include "usbip.h"
+#include <stdio.h>
 #include <unistd.h>
 
+#ifdef USBIP_STATIC_POOLS
+#include "usbip_static.h"
+#endif
+
 void cb(uint8_t* ptr) { }
 
 int main(int argc, char** argv)
 {
-    usbip_server_t usbip_server;
-    vhci_handle_t usb_handle;
+    static usbip_server_t usbip_server;
+    static vhci_handle_t usb_handle;
+
+#ifdef USBIP_STATIC_POOLS
+    const allocator_t* allocator = usbip_static_allocator();
+    usbip_static_footprint_t footprint;
+
+    usbip_static_footprint(&footprint);
+
+    printf("Static footprint: %zu bytes (clients %zu, imports %zu, devices %zu, server %zu, "
+           "vhci %zu, URB buffers per vhci %zu)\n",
+        footprint.total, footprint.clients, footprint.imported_devs, footprint.devices,
+        footprint.server, footprint.vhci, footprint.urb_bufs);
+#else
+    const allocator_t* allocator = &std_allocator;
+#endif
 
     // Initialize Virtual Host Controller
-    if (vhci_init(&usb_handle))
+    if (vhci_init(&usb_handle, allocator))
     {
         return 1;
     }
@@ -115,7 +134,7 @@ int main(int argc, char** argv)
     }
 
     // Start USBIP server
-    if (usbip_server_setup(&usbip_server, &usb_handle))
+    if (usbip_server_setup(&usbip_server, &usb_handle, allocator))
     {
         return 1;
     }
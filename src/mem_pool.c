@@ -77,4 +77,63 @@ void mem_pool_free(mem_pool_t* pool, void* obj)
 
     // Set the freed object as the new free block.
     pool->free_block = obj;
-}
\ No newline at end of file
+}
+
+size_t mem_pool_alloc_n(mem_pool_t* pool, void** out, size_t n)
+{
+    void* end = pool->pool_start + pool->pool_size;
+    void* block = pool->free_block;
+    size_t count = 0;
+
+    // Take previously freed blocks from the free list until the untouched tail is reached.
+    while (count < n && block != end && !(*(uintptr_t*)block & 0x1))
+    {
+        out[count++] = block;
+        block = *((void**)block);
+    }
+
+    // Carve the remaining objects as one contiguous run from the untouched tail.
+    if (count < n && block != end)
+    {
+        size_t run = (end - block) / pool->obj_size;
+
+        if (run > n - count)
+        {
+            run = n - count;
+        }
+
+        for (size_t i = 0; i < run; ++i)
+        {
+            out[count++] = block + i * pool->obj_size;
+        }
+
+        block += run * pool->obj_size;
+
+        if (block != end)
+        {
+            *((uintptr_t*)block) = 0x1;
+        }
+    }
+
+    pool->free_block = block;
+
+    return count;
+}
+
+void mem_pool_free_n(mem_pool_t* pool, void** objs, size_t n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    // Chain the objects together and splice the chain in front of the free list.
+    for (size_t i = 0; i + 1 < n; ++i)
+    {
+        *((void**)objs[i]) = objs[i + 1];
+    }
+
+    *((void**)objs[n - 1]) = pool->free_block;
+
+    pool->free_block = objs[0];
+}
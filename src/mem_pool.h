@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct mem_pool
 {
@@ -10,12 +11,24 @@ typedef struct mem_pool
     void* free_block;
 } mem_pool_t;
 
+// Size of a pool object of the given type, free objects store a pointer.
+#define MEM_POOL_OBJ_SIZE(type) (sizeof(type) < sizeof(void*) ? sizeof(void*) : sizeof(type))
+
+// Bytes of memory used by a pool of count objects of the given type.
+#define MEM_POOL_SIZE(type, count) (MEM_POOL_OBJ_SIZE(type) * (count))
+
+// The first object is marked as untouched, like init_mem_pool does at runtime.
 #define INIT_MEM_POOL(name, type, size)                                                            \
-    static type _##name##_pool[size];                                                              \
-    static mem_pool_t name = { .pool_size = size,                                                  \
-        .obj_size = sizeof(type),                                                                  \
-        .pool_start = _##name##_pool,                                                              \
-        .free_block = _##name##_pool };
+    static union                                                                                   \
+    {                                                                                              \
+        _Alignas(type) _Alignas(void*) uint8_t mem[MEM_POOL_SIZE(type, size)];                     \
+        uintptr_t marker;                                                                          \
+    } _##name##_pool                                                                               \
+        = { .marker = 0x1 };                                                                       \
+    static mem_pool_t name = { .pool_size = MEM_POOL_SIZE(type, size),                             \
+        .obj_size = MEM_POOL_OBJ_SIZE(type),                                                       \
+        .pool_start = &_##name##_pool,                                                             \
+        .free_block = &_##name##_pool };
 
 /**
  * @brief Initialize a memory pool.
@@ -40,4 +53,23 @@ void* mem_pool_alloc(mem_pool_t* pool);
  * @param pool, The pool to which memory will be returned.
  * @param obj, Pointer that will be freed.
  */
-void mem_pool_free(mem_pool_t* pool, void* obj);
\ No newline at end of file
+void mem_pool_free(mem_pool_t* pool, void* obj);
+
+/**
+ * @brief Allocate multiple objects from the memory pool at once, runs from the untouched part of
+ * the pool are carved in a single step.
+ * @param pool, The pool from which memory will be allocated.
+ * @param out, Array that receives the allocated objects.
+ * @param n, Number of objects to allocate.
+ * @return size_t, number of objects allocated, less than n if the pool ran out of memory.
+ */
+size_t mem_pool_alloc_n(mem_pool_t* pool, void** out, size_t n);
+
+/**
+ * @brief Free multiple objects associated with this memory pool at once, the objects are chained
+ * and spliced onto the free list in a single update.
+ * @param pool, The pool to which memory will be returned.
+ * @param objs, Array of pointers that will be freed, objs[0] is reused first.
+ * @param n, Number of objects in objs.
+ */
+void mem_pool_free_n(mem_pool_t* pool, void** objs, size_t n);
@@ -0,0 +1,111 @@
+#include "mem_pool_mt.h"
+#include <errno.h>
+
+#define HEAD_INDEX(head) ((uint32_t)(head))
+#define HEAD_TAG(head)   ((uint32_t)((head) >> 32))
+#define HEAD(tag, index) (((uint64_t)(tag) << 32) | (uint32_t)(index))
+
+static inline _Atomic uint32_t* obj_next(void* obj) { return (_Atomic uint32_t*)obj; }
+
+int init_mem_pool_mt(size_t obj_size, void* pool, size_t pool_size, mem_pool_mt_t* out_pool)
+{
+    if (out_pool == NULL || pool == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Minimum element size is pointer size, free objects store the index of the next free object.
+    if (sizeof(void*) > obj_size)
+    {
+        obj_size = sizeof(void*);
+    }
+
+    // Limit the real pool size to the maximum allowable object.
+    pool_size -= pool_size % obj_size;
+
+    // The index of an object must fit the lower half of the stack head.
+    if (pool_size == 0 || pool_size / obj_size >= UINT32_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    out_pool->pool_start = pool;
+    out_pool->obj_size = obj_size;
+    out_pool->pool_size = pool_size;
+    out_pool->obj_count = pool_size / obj_size;
+
+    atomic_init(&out_pool->free_head, HEAD(0, 0));
+    atomic_init(&out_pool->carved, 0);
+
+    return 0;
+}
+
+static inline void* mem_pool_mt_pop(mem_pool_mt_t* pool)
+{
+    uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+
+    while (HEAD_INDEX(head) != 0)
+    {
+        void* obj = (uint8_t*)pool->pool_start + (size_t)(HEAD_INDEX(head) - 1) * pool->obj_size;
+
+        // The object may be popped and reused by another thread meanwhile, the tag makes the
+        // exchange fail in that case so a stale next index is never installed.
+        uint32_t next = atomic_load_explicit(obj_next(obj), memory_order_relaxed);
+
+        if (atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                HEAD(HEAD_TAG(head) + 1, next), memory_order_acq_rel, memory_order_acquire))
+        {
+            return obj;
+        }
+    }
+
+    return NULL;
+}
+
+static inline void* mem_pool_mt_carve(mem_pool_mt_t* pool)
+{
+    size_t carved = atomic_load_explicit(&pool->carved, memory_order_relaxed);
+
+    while (carved < pool->obj_count)
+    {
+        if (atomic_compare_exchange_weak_explicit(
+                &pool->carved, &carved, carved + 1, memory_order_relaxed, memory_order_relaxed))
+        {
+            return (uint8_t*)pool->pool_start + carved * pool->obj_size;
+        }
+    }
+
+    return NULL;
+}
+
+void* mem_pool_mt_alloc(mem_pool_mt_t* pool)
+{
+    void* obj = mem_pool_mt_pop(pool);
+
+    if (obj == NULL)
+    {
+        obj = mem_pool_mt_carve(pool);
+    }
+
+    // The tail is exhausted, objects may have been freed since the first attempt.
+    if (obj == NULL)
+    {
+        obj = mem_pool_mt_pop(pool);
+    }
+
+    return obj;
+}
+
+void mem_pool_mt_free(mem_pool_mt_t* pool, void* obj)
+{
+    uint32_t index = ((uint8_t*)obj - (uint8_t*)pool->pool_start) / pool->obj_size + 1;
+    uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+
+    do
+    {
+        atomic_store_explicit(obj_next(obj), HEAD_INDEX(head), memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+        HEAD(HEAD_TAG(head) + 1, index), memory_order_release, memory_order_relaxed));
+}
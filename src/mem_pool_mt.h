@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Thread safe variant of mem_pool_t, objects may be allocated and freed from any thread without
+ * locks. Free objects form a Treiber stack, the stack head holds the index of the first free
+ * object together with a tag that is incremented on every update to defeat ABA. Like mem_pool_t the
+ * untouched tail of the pool is only carved into objects when the free stack runs empty.
+ * @note The head is a 64-bit atomic, on targets without 64-bit compare and swap it is not lock-free.
+ */
+typedef struct mem_pool_mt
+{
+    size_t pool_size;
+    size_t obj_size;
+    size_t obj_count;
+    void* pool_start;
+    // Tag in the upper 32 bits, index + 1 of the first free object in the lower 32 bits.
+    _Atomic uint64_t free_head;
+    // Number of objects carved from the untouched tail.
+    _Atomic size_t carved;
+} mem_pool_mt_t;
+
+/**
+ * @brief Initialize a thread safe memory pool.
+ * @param obj_size, The size of the objects being allocated in this pool, the real size will be at
+ * minimum the size of pointers.
+ * @param pool, Memory to use for this pool.
+ * @param pool_size, Size of the given memory in bytes.
+ * @param out_pool, Object into which pool will be initialized.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ * @note Must not be called while other threads use the pool.
+ */
+int init_mem_pool_mt(size_t obj_size, void* pool, size_t pool_size, mem_pool_mt_t* out_pool);
+
+/**
+ * @brief Allocate some memory from the memory pool, safe to call from any thread.
+ * @param pool, The pool from which memory will be allocated.
+ * @return void*, pointer to the newly allocated memory, or NULL if no memory was free.
+ */
+void* mem_pool_mt_alloc(mem_pool_mt_t* pool);
+
+/**
+ * @brief Free some memory associated with this memory pool, safe to call from any thread.
+ * @param pool, The pool to which memory will be returned.
+ * @param obj, Pointer that will be freed.
+ */
+void mem_pool_mt_free(mem_pool_mt_t* pool, void* obj);
@@ -3,6 +3,7 @@
 #include "errno.h"
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #pragma pack(push, 1)
 typedef struct fifo_item
@@ -188,136 +189,142 @@ int stream_fifo_init(stream_fifo_t* queue, uint8_t* buf, size_t buf_len)
     queue->head = buf;
     queue->tail = buf;
     queue->buffer_len = buf_len;
+    queue->length = 0;
 
     return 0;
 }
 
-ssize_t stream_fifo_push(stream_fifo_t* queue, void* msg, size_t msg_len)
+static inline void* stream_fifo_advance(stream_fifo_t* queue, void* ptr, size_t len)
 {
-    int remaining = queue->tail - queue->head;
-    if (queue->head == queue->tail)
-    {
-        remaining = queue->buffer_len;
-    }
+    ptr += len;
 
-    // Check if the queue has wrapped around.
-    if (remaining < 0)
+    if (ptr >= queue->start + queue->buffer_len)
     {
-        remaining = queue->buffer_len + -remaining;
+        ptr -= queue->buffer_len;
     }
 
+    return ptr;
+}
+
+ssize_t stream_fifo_push(stream_fifo_t* queue, void* msg, size_t msg_len)
+{
     // Check if we have enough space in the buffer.
-    if (remaining < msg_len)
+    if (msg_len > queue->buffer_len - queue->length)
     {
         return -ENOBUFS;
     }
 
+    size_t first_len = queue->start + queue->buffer_len - queue->tail;
+
     // Check if the message wraps around.
-    if (queue->tail + msg_len > queue->start + queue->buffer_len)
+    if (msg_len > first_len)
     {
-        // Copy the first part of the message.
-        int first_len = queue->start + queue->buffer_len - queue->tail;
         memcpy(queue->tail, msg, first_len);
-        queue->tail = queue->start;
-
-        // Copy the second part of the message.
-        memcpy(queue->tail, msg + first_len, msg_len - first_len);
-        queue->tail += msg_len - first_len;
+        memcpy(queue->start, msg + first_len, msg_len - first_len);
     }
     else
     {
         memcpy(queue->tail, msg, msg_len);
-        queue->tail += msg_len;
     }
 
+    queue->tail = stream_fifo_advance(queue, queue->tail, msg_len);
+    queue->length += msg_len;
+
     return msg_len;
 }
 
-size_t stream_fifo_length(stream_fifo_t* queue)
-{
-    int length = queue->tail - queue->head;
-    if (length < 0)
-    {
-        length = queue->buffer_len + length;
-    }
-
-    return length;
-}
+size_t stream_fifo_length(stream_fifo_t* queue) { return queue->length; }
 
 size_t stream_fifo_pop(stream_fifo_t* queue, void* out_msg, size_t out_msg_len)
 {
-    int avail = stream_fifo_length(queue);
-
-    if (avail < out_msg_len)
+    if (out_msg_len > queue->length)
     {
-        out_msg_len = avail;
+        out_msg_len = queue->length;
     }
 
-    void* end = queue->start + queue->buffer_len;
+    size_t first_len = queue->start + queue->buffer_len - queue->head;
 
-    // Check if the queue has wrapped around.
-    if (queue->head + out_msg_len > end)
+    // Check if the data wraps around.
+    if (out_msg_len > first_len)
     {
-        // Copy the first part of the message.
-        int first_len = end - queue->head;
         memcpy(out_msg, queue->head, first_len);
-        queue->head = queue->start;
-
-        // Copy the second part of the message.
-        memcpy(out_msg + first_len, queue->head, out_msg_len - first_len);
-        queue->head += out_msg_len - first_len;
+        memcpy(out_msg + first_len, queue->start, out_msg_len - first_len);
     }
     else
     {
         memcpy(out_msg, queue->head, out_msg_len);
-        queue->head += out_msg_len;
     }
 
+    queue->head = stream_fifo_advance(queue, queue->head, out_msg_len);
+    queue->length -= out_msg_len;
+
     return out_msg_len;
 }
 
-int stream_fifo_send_sock(stream_fifo_t* queue, int sock)
+size_t stream_fifo_space(stream_fifo_t* queue) { return queue->buffer_len - queue->length; }
+
+void* stream_fifo_reserve(stream_fifo_t* queue, size_t* out_len)
 {
-    // Check if the queue has wrapped around.
-    if (queue->tail < queue->head)
-    {
-        void* end = queue->start + queue->buffer_len;
-        int length = end - queue->head;
+    size_t space = queue->buffer_len - queue->length;
+    size_t first_len = queue->start + queue->buffer_len - queue->tail;
 
-        int bytes = send(sock, queue->head, length, 0);
+    // The free space wraps around, only the part up to the end of the buffer is contiguous.
+    *out_len = (space < first_len) ? space : first_len;
 
-        // Check if we sent any bytes.
-        if (bytes > 0)
-        {
-            void* new_head = (uint8_t*)queue->head + bytes;
+    return queue->tail;
+}
 
-            // Check if we have reached the end of the buffer.
-            if (new_head >= end)
-            {
-                bytes -= queue->head - end;
-                queue->head = queue->start + bytes;
-            }
-            else
-            {
-                queue->head = new_head;
-            }
-        }
+void stream_fifo_commit(stream_fifo_t* queue, size_t len)
+{
+    queue->tail = stream_fifo_advance(queue, queue->tail, len);
+    queue->length += len;
+}
 
-        return bytes;
+int stream_fifo_iov(stream_fifo_t* queue, struct iovec iov[2])
+{
+    if (queue->length == 0)
+    {
+        return 0;
     }
-    else if (queue->head < queue->tail)
+
+    size_t first_len = queue->start + queue->buffer_len - queue->head;
+
+    iov[0].iov_base = queue->head;
+    iov[0].iov_len = (first_len < queue->length) ? first_len : queue->length;
+
+    // The wrapped part goes out in the same call.
+    if (first_len < queue->length)
     {
-        size_t length = queue->tail - queue->head;
-        int bytes = send(sock, queue->head, length, 0);
+        iov[1].iov_base = queue->start;
+        iov[1].iov_len = queue->length - first_len;
+        return 2;
+    }
 
-        // Check if we sent any bytes.
-        if (bytes > 0)
-        {
-            queue->head = (uint8_t*)queue->head + bytes;
-        }
+    return 1;
+}
 
-        return bytes;
+void stream_fifo_drop(stream_fifo_t* queue, size_t len)
+{
+    queue->head = stream_fifo_advance(queue, queue->head, len);
+    queue->length -= len;
+}
+
+int stream_fifo_send_sock(stream_fifo_t* queue, int sock, int flags)
+{
+    struct iovec iov[2];
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = stream_fifo_iov(queue, iov) };
+
+    if (msg.msg_iovlen == 0)
+    {
+        return 0;
     }
 
-    return 0;
-}
\ No newline at end of file
+    int bytes = sendmsg(sock, &msg, flags | MSG_NOSIGNAL);
+
+    if (bytes > 0)
+    {
+        stream_fifo_drop(queue, bytes);
+    }
+
+    return bytes;
+}
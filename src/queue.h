@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 typedef struct msg_fifo
 {
@@ -46,6 +47,8 @@ typedef struct stream_fifo
     void* head;
     void* tail;
     size_t buffer_len;
+    // Bytes stored, tells a full FIFO apart from an empty one when head and tail meet.
+    size_t length;
 } stream_fifo_t;
 
 /**
@@ -61,7 +64,7 @@ int stream_fifo_init(stream_fifo_t* queue, uint8_t* buf, size_t buf_len);
  * @param queue The stream FIFO to push to.
  * @param msg The message to push.
  * @param msg_len The length of the message.
- * @return 0 on success, -ENOBUFS on failure.
+ * @return The length of the message on success, -ENOBUFS if it does not fit the free space.
  */
 ssize_t stream_fifo_push(stream_fifo_t* queue, void* msg, size_t msg_len);
 
@@ -82,9 +85,49 @@ size_t stream_fifo_pop(stream_fifo_t* queue, void* out_msg, size_t out_msg_len);
 size_t stream_fifo_length(stream_fifo_t* queue);
 
 /**
- * @brief Send a message over a socket.
+ * @brief Get the free space of the FIFO.
+ * @param queue The stream FIFO to get the free space of.
+ * @return The number of bytes that can be pushed.
+ */
+size_t stream_fifo_space(stream_fifo_t* queue);
+
+/**
+ * @brief Reserve the contiguous free space at the end of the FIFO to write into directly.
+ * @param queue The stream FIFO to reserve space in.
+ * @param out_len Set to the number of bytes that can be written, 0 if the FIFO is full.
+ * @return Pointer to the reserved space, made part of the FIFO with stream_fifo_commit.
+ */
+void* stream_fifo_reserve(stream_fifo_t* queue, size_t* out_len);
+
+/**
+ * @brief Add bytes written into reserved space to the FIFO.
+ * @param queue The stream FIFO the space was reserved in.
+ * @param len The number of bytes written, at most the reserved length.
+ */
+void stream_fifo_commit(stream_fifo_t* queue, size_t len);
+
+/**
+ * @brief Describe the content of the FIFO without removing it, in two parts if it wraps around
+ * the end of the buffer.
+ * @param queue The stream FIFO to describe.
+ * @param iov Set to the parts of the content.
+ * @return The number of parts, 0 if the FIFO is empty.
+ */
+int stream_fifo_iov(stream_fifo_t* queue, struct iovec iov[2]);
+
+/**
+ * @brief Remove bytes from the start of the FIFO without copying them, e.g. after they were sent.
+ * @param queue The stream FIFO to remove from.
+ * @param len The number of bytes to remove, at most the length of the FIFO.
+ */
+void stream_fifo_drop(stream_fifo_t* queue, size_t len);
+
+/**
+ * @brief Send the content of the FIFO over a socket with a single system call, also when it wraps
+ * around the end of the buffer.
  * @param queue The stream FIFO to send from.
  * @param sock The socket to send over.
- * @return The number of bytes sent over the socket.
+ * @param flags Flags passed to sendmsg, MSG_NOSIGNAL is always added.
+ * @return The number of bytes sent over the socket, -1 on error and errno set.
  */
-int stream_fifo_send_sock(stream_fifo_t* queue, int sock);
\ No newline at end of file
+int stream_fifo_send_sock(stream_fifo_t* queue, int sock, int flags);
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "slab.h"
+#include <errno.h>
+#include <stdint.h>
+
+size_t slab_region_size(size_t min_size, const size_t* counts, size_t class_count)
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < class_count; ++i)
+    {
+        size += counts[i] * (min_size << i);
+    }
+
+    return size;
+}
+
+int slab_init(slab_t* slab, void* region, size_t region_size, size_t min_size,
+    const size_t* counts, size_t class_count)
+{
+    if (slab == NULL || region == NULL || counts == NULL || class_count == 0
+        || class_count > SLAB_MAX_CLASSES || min_size < sizeof(void*)
+        || (min_size & (min_size - 1)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (slab_region_size(min_size, counts, class_count) > region_size)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    slab->region = region;
+    slab->region_size = region_size;
+    slab->min_size = min_size;
+    slab->class_count = class_count;
+
+    uint8_t* cur = region;
+
+    for (size_t i = 0; i < class_count; ++i)
+    {
+        size_t obj_size = min_size << i;
+        size_t pool_size = counts[i] * obj_size;
+
+        slab->stats[i] = (slab_class_stats_t) { .obj_size = obj_size, .capacity = counts[i] };
+
+        // An empty class keeps a pool that is always exhausted.
+        if (pool_size == 0)
+        {
+            slab->pools[i] = (mem_pool_t) {
+                .pool_size = 0, .obj_size = obj_size, .pool_start = cur, .free_block = cur
+            };
+            continue;
+        }
+
+        if (init_mem_pool(obj_size, cur, pool_size, &slab->pools[i]) == -1)
+        {
+            return -1;
+        }
+
+        cur += pool_size;
+    }
+
+    return 0;
+}
+
+static inline size_t slab_class_of(slab_t* slab, size_t size)
+{
+    size_t idx = 0;
+
+    while (idx < slab->class_count && (slab->min_size << idx) < size)
+    {
+        idx++;
+    }
+
+    return idx;
+}
+
+void* slab_alloc(slab_t* slab, size_t size)
+{
+    if (slab == NULL || size == 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t first = slab_class_of(slab, size);
+
+    for (size_t i = first; i < slab->class_count; ++i)
+    {
+        void* obj = mem_pool_alloc(&slab->pools[i]);
+
+        if (obj != NULL)
+        {
+            slab_class_stats_t* stats = &slab->stats[i];
+
+            if (++stats->in_use > stats->peak)
+            {
+                stats->peak = stats->in_use;
+            }
+
+            if (i != first)
+            {
+                slab->stats[first].spills++;
+            }
+
+            return obj;
+        }
+    }
+
+    if (first < slab->class_count)
+    {
+        slab->stats[first].failures++;
+    }
+
+    errno = ENOMEM;
+    return NULL;
+}
+
+static inline size_t slab_owner_of(slab_t* slab, void* obj)
+{
+    for (size_t i = 0; i < slab->class_count; ++i)
+    {
+        mem_pool_t* pool = &slab->pools[i];
+
+        if ((uint8_t*)obj >= (uint8_t*)pool->pool_start
+            && (uint8_t*)obj < (uint8_t*)pool->pool_start + pool->pool_size)
+        {
+            return i;
+        }
+    }
+
+    return slab->class_count;
+}
+
+void slab_free(slab_t* slab, void* obj)
+{
+    if (slab == NULL || obj == NULL)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    size_t idx = slab_owner_of(slab, obj);
+
+    if (idx == slab->class_count)
+    {
+        errno = EINVAL;
+        return;
+    }
+
+    mem_pool_free(&slab->pools[idx], obj);
+    slab->stats[idx].in_use--;
+}
+
+size_t slab_obj_size(slab_t* slab, void* obj)
+{
+    size_t idx = slab_owner_of(slab, obj);
+
+    return (idx < slab->class_count) ? slab->stats[idx].obj_size : 0;
+}
+
+int slab_get_stats(slab_t* slab, size_t class_idx, slab_class_stats_t* stats)
+{
+    if (slab == NULL || stats == NULL || class_idx >= slab->class_count)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *stats = slab->stats[class_idx];
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "mem_pool.h"
+
+/**
+ * Size class allocator made of memory pools with power of two object sizes, all pools are carved
+ * from a single region. Class i serves objects of min_size << i bytes, a request is served from
+ * the smallest class that fits and falls back to larger classes when that class is exhausted.
+ */
+
+#ifndef SLAB_MAX_CLASSES
+#define SLAB_MAX_CLASSES 16
+#endif
+
+typedef struct slab_class_stats
+{
+    size_t obj_size;
+    size_t capacity;
+    size_t in_use;
+    size_t peak;
+    // Requests for this class that were served by a larger class.
+    size_t spills;
+    // Requests for this class that could not be served at all.
+    size_t failures;
+} slab_class_stats_t;
+
+typedef struct slab
+{
+    void* region;
+    size_t region_size;
+    size_t min_size;
+    size_t class_count;
+    mem_pool_t pools[SLAB_MAX_CLASSES];
+    slab_class_stats_t stats[SLAB_MAX_CLASSES];
+} slab_t;
+
+/**
+ * @brief Calculate the region size needed for a slab.
+ * @param min_size, Object size of the smallest class, a power of 2.
+ * @param counts, Number of objects in every class.
+ * @param class_count, Number of classes.
+ * @return size_t, The number of bytes needed.
+ */
+size_t slab_region_size(size_t min_size, const size_t* counts, size_t class_count);
+
+/**
+ * @brief Initialize a slab allocator.
+ * @param slab, The slab to initialize.
+ * @param region, Memory from which all classes are carved.
+ * @param region_size, Size of the given memory in bytes.
+ * @param min_size, Object size of the smallest class, a power of 2 and at least pointer size.
+ * @param counts, Number of objects in every class, a count of 0 leaves the class empty.
+ * @param class_count, Number of classes, at most SLAB_MAX_CLASSES.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int slab_init(slab_t* slab, void* region, size_t region_size, size_t min_size,
+    const size_t* counts, size_t class_count);
+
+/**
+ * @brief Allocate memory from the slab.
+ * @param slab, The slab from which memory will be allocated.
+ * @param size, The size of the memory to allocate.
+ * @return void*, pointer to the newly allocated memory, or NULL if no memory was free.
+ */
+void* slab_alloc(slab_t* slab, size_t size);
+
+/**
+ * @brief Free memory associated with this slab.
+ * @param slab, The slab to which memory will be returned.
+ * @param obj, Pointer that will be freed.
+ */
+void slab_free(slab_t* slab, void* obj);
+
+/**
+ * @brief Get the object size of the class that serves an allocation.
+ * @param slab, The slab the memory was allocated from.
+ * @param obj, The allocation.
+ * @return size_t, The usable size of the allocation, 0 if it is not part of this slab.
+ */
+size_t slab_obj_size(slab_t* slab, void* obj);
+
+/**
+ * @brief Get statistics for a size class.
+ * @param slab, The slab to get the statistics of.
+ * @param class_idx, Index of the class.
+ * @param stats, Object into which the statistics are written.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int slab_get_stats(slab_t* slab, size_t class_idx, slab_class_stats_t* stats);
@@ -0,0 +1,126 @@
+#include "slot_map.h"
+#include <errno.h>
+
+#define NO_FREE_SLOT UINT16_MAX
+
+int slot_map_init(slot_map_t* map, slot_map_entry_t* entries, size_t capacity)
+{
+    if (map == NULL || entries == NULL || capacity == 0 || capacity > SLOT_MAP_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Chain all slots into the free list, generation 0 is never used so no valid handle is 0.
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        entries[i].obj = NULL;
+        entries[i].slot = 0;
+        entries[i].gen = 1;
+        entries[i].dense = 0;
+        entries[i].next_free = (i + 1 < capacity) ? i + 1 : NO_FREE_SLOT;
+    }
+
+    map->entries = entries;
+    map->capacity = capacity;
+    map->size = 0;
+    map->free_slot = 0;
+
+    return 0;
+}
+
+slot_handle_t slot_map_insert(slot_map_t* map, void* obj)
+{
+    if (obj == NULL)
+    {
+        errno = EINVAL;
+        return SLOT_HANDLE_INVALID;
+    }
+
+    if (map->free_slot == NO_FREE_SLOT)
+    {
+        errno = ENOMEM;
+        return SLOT_HANDLE_INVALID;
+    }
+
+    uint16_t slot = map->free_slot;
+    slot_map_entry_t* sparse = &map->entries[slot];
+    slot_map_entry_t* dense = &map->entries[map->size];
+
+    map->free_slot = sparse->next_free;
+
+    sparse->dense = map->size;
+    dense->obj = obj;
+    dense->slot = slot;
+
+    map->size++;
+
+    return SLOT_HANDLE(slot, sparse->gen);
+}
+
+static inline slot_map_entry_t* slot_map_lookup(slot_map_t* map, slot_handle_t handle)
+{
+    uint16_t slot = SLOT_HANDLE_INDEX(handle);
+
+    if (slot >= map->capacity)
+    {
+        return NULL;
+    }
+
+    slot_map_entry_t* sparse = &map->entries[slot];
+
+    // A free slot never matches, its generation was bumped on removal.
+    if (sparse->gen != SLOT_HANDLE_GEN(handle) || sparse->dense >= map->size
+        || map->entries[sparse->dense].slot != slot)
+    {
+        return NULL;
+    }
+
+    return sparse;
+}
+
+void* slot_map_get(slot_map_t* map, slot_handle_t handle)
+{
+    slot_map_entry_t* sparse = slot_map_lookup(map, handle);
+
+    if (sparse == NULL)
+    {
+        return NULL;
+    }
+
+    return map->entries[sparse->dense].obj;
+}
+
+void* slot_map_remove(slot_map_t* map, slot_handle_t handle)
+{
+    slot_map_entry_t* sparse = slot_map_lookup(map, handle);
+
+    if (sparse == NULL)
+    {
+        return NULL;
+    }
+
+    uint16_t slot = SLOT_HANDLE_INDEX(handle);
+    slot_map_entry_t* dense = &map->entries[sparse->dense];
+    slot_map_entry_t* last = &map->entries[map->size - 1];
+    void* obj = dense->obj;
+
+    // Move the last live object into the hole to keep the objects packed.
+    dense->obj = last->obj;
+    dense->slot = last->slot;
+    map->entries[dense->slot].dense = sparse->dense;
+
+    last->obj = NULL;
+    map->size--;
+
+    // Bump the generation to invalidate outstanding handles, skipping 0.
+    if (++sparse->gen == 0)
+    {
+        sparse->gen = 1;
+    }
+
+    sparse->next_free = map->free_slot;
+    map->free_slot = slot;
+
+    return obj;
+}
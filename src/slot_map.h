@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Handle based object registry. Objects are referenced by a 32-bit handle that holds the slot
+ * index in the lower 16 bits and a generation counter in the upper 16 bits, the generation is
+ * incremented whenever a slot is released so stale handles are detected on lookup. Live objects
+ * are kept packed at the start of the entry array for contiguous iteration.
+ */
+typedef uint32_t slot_handle_t;
+
+#define SLOT_HANDLE_INVALID    0
+#define SLOT_HANDLE_INDEX(h)   ((uint16_t)((h)&0xFFFF))
+#define SLOT_HANDLE_GEN(h)     ((uint16_t)((h) >> 16))
+#define SLOT_HANDLE(index, gen) (((slot_handle_t)(gen) << 16) | (uint16_t)(index))
+#define SLOT_MAP_MAX_CAPACITY  UINT16_MAX
+
+typedef struct slot_map_entry
+{
+    // Dense part, entry i holds the i-th live object.
+    void* obj;
+    uint16_t slot;
+    // Sparse part, entry i describes slot i.
+    uint16_t gen;
+    uint16_t dense;
+    uint16_t next_free;
+} slot_map_entry_t;
+
+typedef struct slot_map
+{
+    slot_map_entry_t* entries;
+    uint16_t capacity;
+    uint16_t size;
+    uint16_t free_slot;
+} slot_map_t;
+
+/**
+ * @brief Iterate over all live objects of a slot map, the current object may be removed during
+ * iteration.
+ * @param map, Pointer to the slot map to iterate.
+ * @param i, size_t variable that holds the dense index, use slot_map_at to get the object.
+ */
+#define SLOT_MAP_FOREACH(map, i) for ((i) = (map)->size; (i)-- > 0;)
+
+/**
+ * @brief Initialize a slot map.
+ * @param map, The slot map to initialize.
+ * @param entries, Memory for the entries of the slot map.
+ * @param capacity, Number of entries in the given memory, at most SLOT_MAP_MAX_CAPACITY.
+ * @return int, -1 on failure and sets errno, otherwise 0.
+ */
+int slot_map_init(slot_map_t* map, slot_map_entry_t* entries, size_t capacity);
+
+/**
+ * @brief Insert an object into the slot map.
+ * @param map, The slot map to insert into.
+ * @param obj, The object to insert, may not be NULL.
+ * @return slot_handle_t, Handle to the object or SLOT_HANDLE_INVALID on failure and sets errno.
+ */
+slot_handle_t slot_map_insert(slot_map_t* map, void* obj);
+
+/**
+ * @brief Get the object referenced by a handle.
+ * @param map, The slot map to search.
+ * @param handle, The handle of the object.
+ * @return void*, The object or NULL if the handle is stale or invalid.
+ */
+void* slot_map_get(slot_map_t* map, slot_handle_t handle);
+
+/**
+ * @brief Remove the object referenced by a handle, all handles to the object become stale.
+ * @param map, The slot map to remove from.
+ * @param handle, The handle of the object.
+ * @return void*, The removed object or NULL if the handle is stale or invalid.
+ */
+void* slot_map_remove(slot_map_t* map, slot_handle_t handle);
+
+/**
+ * @brief Get the object at a dense index.
+ * @param map, The slot map.
+ * @param i, Dense index, must be smaller than the size of the map.
+ * @return void*, The object at the index.
+ */
+static inline void* slot_map_at(slot_map_t* map, size_t i) { return map->entries[i].obj; }
+
+/**
+ * @brief Get the handle of the object at a dense index.
+ * @param map, The slot map.
+ * @param i, Dense index, must be smaller than the size of the map.
+ * @return slot_handle_t, The handle of the object at the index.
+ */
+static inline slot_handle_t slot_map_handle_at(slot_map_t* map, size_t i)
+{
+    uint16_t slot = map->entries[i].slot;
+    return SLOT_HANDLE(slot, map->entries[slot].gen);
+}
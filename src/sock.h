@@ -1,3 +1,9 @@
 #pragma once
 
-#define NO_SOCK -1
\ No newline at end of file
+#define NO_SOCK -1
+
+/**
+ * @brief Shut down and close a socket.
+ * @param sock, The socket to close.
+ */
+void sock_stop(int sock);
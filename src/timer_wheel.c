@@ -0,0 +1,170 @@
+#include "timer_wheel.h"
+#include <errno.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Timers further ahead are put in the last top level slot, they are moved on when it is reached.
+#define MAX_AHEAD                                                                                  \
+    (TIMER_WHEEL_RANGE - ((uint64_t)1 << (TIMER_WHEEL_BITS * (TIMER_WHEEL_LEVELS - 1))))
+
+/**
+ * @brief Put a timer in the slot for its tick, the lowest level whose slots share the tick with
+ * the current one above that level.
+ */
+static void timer_wheel_place(timer_wheel_t* wheel, wheel_timer_t* timer, uint64_t expires)
+{
+    if (expires - wheel->now > MAX_AHEAD)
+    {
+        expires = wheel->now + MAX_AHEAD;
+    }
+
+    size_t level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1
+        && (expires >> (TIMER_WHEEL_BITS * (level + 1)))
+            != (wheel->now >> (TIMER_WHEEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    ilist_t* slot = &wheel->slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK];
+
+    ilist_push(slot, &timer->node);
+    timer->slot = slot;
+    timer->wheel = wheel;
+    wheel->count++;
+}
+
+/**
+ * @brief Take all timers out of a slot into list, they stay counted and can still be cancelled
+ * until they are taken from list.
+ */
+static void timer_wheel_detach(timer_wheel_t* wheel, ilist_t* slot, ilist_t* list)
+{
+    *list = *slot;
+    ilist_init(slot);
+
+    ilist_node_t* cur;
+
+    ILIST_FOREACH(list, cur)
+    {
+        ILIST_ENTRY(cur, wheel_timer_t, node)->slot = list;
+    }
+}
+
+int timer_wheel_init(timer_wheel_t* wheel, uint64_t now)
+{
+    if (wheel == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    wheel->now = now;
+    wheel->count = 0;
+
+    for (size_t level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        for (size_t i = 0; i < TIMER_WHEEL_SLOTS; ++i)
+        {
+            ilist_init(&wheel->slots[level][i]);
+        }
+    }
+
+    return 0;
+}
+
+void timer_wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer, uint64_t expires)
+{
+    wheel_timer_cancel(timer);
+
+    // The slot of the current tick was already handled.
+    if (expires <= wheel->now)
+    {
+        expires = wheel->now + 1;
+    }
+
+    timer->expires = expires;
+    timer_wheel_place(wheel, timer, expires);
+}
+
+void wheel_timer_cancel(wheel_timer_t* timer)
+{
+    if (timer->slot == NULL)
+    {
+        return;
+    }
+
+    ilist_rem(timer->slot, &timer->node);
+    timer->slot = NULL;
+    timer->wheel->count--;
+}
+
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now)
+{
+    size_t expired = 0;
+
+    while (wheel->now < now)
+    {
+        // Nothing can expire, skip the ticks in between.
+        if (wheel->count == 0)
+        {
+            wheel->now = now;
+            break;
+        }
+
+        uint64_t tick = ++wheel->now;
+        size_t top = 0;
+
+        // Every level whose slot changes with this tick is moved down, highest first so timers
+        // that land in a lower slot that is reached now are moved on as well.
+        while (top < TIMER_WHEEL_LEVELS - 1
+            && (tick & (((uint64_t)1 << (TIMER_WHEEL_BITS * (top + 1))) - 1)) == 0)
+        {
+            top++;
+        }
+
+        for (size_t level = top; level > 0; --level)
+        {
+            ilist_t list;
+            ilist_node_t* node;
+            size_t index = (tick >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK;
+
+            timer_wheel_detach(wheel, &wheel->slots[level][index], &list);
+
+            while ((node = ilist_pop_front(&list)) != NULL)
+            {
+                wheel_timer_t* timer = ILIST_ENTRY(node, wheel_timer_t, node);
+
+                wheel->count--;
+                timer_wheel_place(wheel, timer, timer->expires);
+            }
+        }
+
+        ilist_t list;
+        ilist_node_t* node;
+
+        timer_wheel_detach(wheel, &wheel->slots[0][tick & SLOT_MASK], &list);
+
+        // Callbacks may cancel timers that are still in list.
+        while ((node = ilist_pop_front(&list)) != NULL)
+        {
+            wheel_timer_t* timer = ILIST_ENTRY(node, wheel_timer_t, node);
+
+            timer->slot = NULL;
+            wheel->count--;
+
+            // Timers that were too far ahead wait for their own tick.
+            if (timer->expires > tick)
+            {
+                timer_wheel_place(wheel, timer, timer->expires);
+                continue;
+            }
+
+            expired++;
+            timer->callback(timer);
+        }
+    }
+
+    return expired;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "ilist.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Slots per level are 1 << TIMER_WHEEL_BITS.
+#ifndef TIMER_WHEEL_BITS
+#define TIMER_WHEEL_BITS 6
+#endif
+
+// Levels of the wheel, timers can be TIMER_WHEEL_RANGE ticks ahead (16M ticks by default).
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS 4
+#endif
+
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_RANGE ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+struct wheel_timer;
+struct timer_wheel;
+
+typedef void (*wheel_timer_cb)(struct wheel_timer* timer);
+
+/**
+ * Timer that is embedded into the object it times, it is not armed while zeroed.
+ */
+typedef struct wheel_timer
+{
+    ilist_node_t node;
+    // Tick at which the callback is called.
+    uint64_t expires;
+    wheel_timer_cb callback;
+    void* context;
+    // Slot list holding the timer, NULL if not armed.
+    ilist_t* slot;
+    struct timer_wheel* wheel;
+} wheel_timer_t;
+
+/**
+ * Hierarchical timer wheel, every level has TIMER_WHEEL_SLOTS slots that each cover
+ * TIMER_WHEEL_SLOTS times the ticks of a slot one level lower. Timers are added to and removed
+ * from their slot in O(1), the slots of higher levels are moved down once the wheel reaches them.
+ */
+typedef struct timer_wheel
+{
+    // The last tick that was handled.
+    uint64_t now;
+    // Number of armed timers.
+    size_t count;
+    ilist_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+/**
+ * @brief Get the object that embeds a timer.
+ * @param timer, Pointer to the embedded timer.
+ * @param type, Type of the object that embeds the timer.
+ * @param member, Name of the timer member in the object.
+ */
+#define WHEEL_TIMER_ENTRY(timer, type, member) ((type*)((char*)(timer)-offsetof(type, member)))
+
+/**
+ * @brief Initialize an empty timer wheel.
+ * @param wheel, The wheel to initialize.
+ * @param now, The current tick.
+ * @return int, -1 on failure and sets errno, otherwise 0
+ */
+int timer_wheel_init(timer_wheel_t* wheel, uint64_t now);
+
+/**
+ * @brief Arm a timer, a timer that is already armed is moved to its new tick.
+ * @param wheel, The wheel to add the timer to.
+ * @param timer, The timer to arm, callback and context are set by the caller.
+ * @param expires, Tick at which the timer expires, ticks that already passed expire on the next
+ * timer_wheel_advance.
+ */
+void timer_wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer, uint64_t expires);
+
+/**
+ * @brief Disarm a timer, nothing is done if it is not armed.
+ * @param timer, The timer to disarm.
+ */
+void wheel_timer_cancel(wheel_timer_t* timer);
+
+/**
+ * @brief Check whether a timer is armed.
+ * @param timer, The timer to check.
+ * @return bool, true if the timer is armed.
+ */
+static inline bool wheel_timer_armed(const wheel_timer_t* timer) { return timer->slot != NULL; }
+
+/**
+ * @brief Move the wheel to the current tick and call the callback of every timer that expired, the
+ * timer is disarmed before its callback is called and it may be armed again by the callback.
+ * @param wheel, The wheel to advance.
+ * @param now, The current tick, nothing is done if it is not after the last tick.
+ * @return size_t, Number of expired timers.
+ */
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now);
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Flags of transport_recv.
+#define TRANSPORT_PEEK 0x1 // Leave the data in the connection.
+
+// Flags of transport_writev.
+#define TRANSPORT_MORE     0x1 // More data follows right away, it may be held back to join it.
+#define TRANSPORT_ZEROCOPY 0x2 // Send from the memory itself, see transport_t::reap_zerocopy.
+
+/**
+ * Transport interface of the server, connections are identified by an int chosen by the
+ * transport (e.g. the socket). Every call is non blocking, -1 with errno EAGAIN is returned when
+ * it would block.
+ */
+typedef struct transport
+{
+    /**
+     * @brief Accept a pending connection.
+     * @param ctx, The context of the transport.
+     * @param addr, Set to the IPv4 address of the peer in network order, 0 for other peers.
+     * @return int, The connection, or -1 with errno set, EAGAIN if no connection is pending.
+     */
+    int (*accept)(void* ctx, uint32_t* addr);
+    /**
+     * @brief Receive data from a connection.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection to receive from.
+     * @param buf, Buffer for the data.
+     * @param len, Size of the buffer.
+     * @param flags, TRANSPORT_PEEK or 0.
+     * @return ssize_t, Number of bytes received, 0 if the peer closed the connection, or -1 with
+     * errno set.
+     */
+    ssize_t (*recv)(void* ctx, int conn, void* buf, size_t len, int flags);
+    /**
+     * @brief Send data to a connection, as much as fits.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection to send to.
+     * @param iov, The parts of the data.
+     * @param iovcnt, Number of parts.
+     * @param flags, TRANSPORT_MORE and TRANSPORT_ZEROCOPY.
+     * @return ssize_t, Number of bytes sent, or -1 with errno set.
+     */
+    ssize_t (*writev)(void* ctx, int conn, const struct iovec* iov, int iovcnt, int flags);
+    /**
+     * @brief Send data from a file to a connection, as much as fits.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection to send to.
+     * @param fd, The file to send from.
+     * @param offset, Offset in the file, moved past the data that was sent.
+     * @param len, Number of bytes to send.
+     * @return ssize_t, Number of bytes sent, 0 at the end of the file, or -1 with errno set.
+     */
+    ssize_t (*sendfile)(void* ctx, int conn, int fd, off_t* offset, size_t len);
+    /**
+     * @brief Check the readiness of a connection without waiting.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection to check.
+     * @param events, POLLIN and POLLOUT.
+     * @return int, The requested events that are ready, POLLHUP once the peer closed.
+     */
+    int (*poll)(void* ctx, int conn, int events);
+    /**
+     * @brief Enable TRANSPORT_ZEROCOPY on a connection, NULL if the transport does not support it.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection.
+     * @return int, -1 on error and errno set, otherwise 0
+     */
+    int (*zerocopy)(void* ctx, int conn);
+    /**
+     * @brief Read the next notification for TRANSPORT_ZEROCOPY sends, which are numbered from 0 in
+     * the order they were made.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection.
+     * @param last, Set to the number of the last send whose memory is no longer used.
+     * @param copied, Set to true if the data was copied after all.
+     * @return int, -1 with errno EAGAIN if there is no notification, otherwise 0
+     */
+    int (*reap_zerocopy)(void* ctx, int conn, uint32_t* last, bool* copied);
+    /**
+     * @brief Close a connection.
+     * @param ctx, The context of the transport.
+     * @param conn, The connection to close.
+     */
+    void (*close)(void* ctx, int conn);
+    void* ctx;
+} transport_t;
+
+static inline int transport_accept(const transport_t* transport, uint32_t* addr)
+{
+    return transport->accept(transport->ctx, addr);
+}
+
+static inline ssize_t transport_recv(
+    const transport_t* transport, int conn, void* buf, size_t len, int flags)
+{
+    return transport->recv(transport->ctx, conn, buf, len, flags);
+}
+
+static inline ssize_t transport_writev(
+    const transport_t* transport, int conn, const struct iovec* iov, int iovcnt, int flags)
+{
+    return transport->writev(transport->ctx, conn, iov, iovcnt, flags);
+}
+
+static inline ssize_t transport_sendfile(
+    const transport_t* transport, int conn, int fd, off_t* offset, size_t len)
+{
+    return transport->sendfile(transport->ctx, conn, fd, offset, len);
+}
+
+static inline int transport_poll(const transport_t* transport, int conn, int events)
+{
+    return transport->poll(transport->ctx, conn, events);
+}
+
+static inline void transport_close(const transport_t* transport, int conn)
+{
+    transport->close(transport->ctx, conn);
+}
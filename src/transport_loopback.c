@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "transport_loopback.h"
+
+#define CONN_INDEX(conn) ((conn) >> 1)
+#define CONN_END(conn)   ((conn)&1)
+
+/**
+ * @brief Get the connection of an open end.
+ * @return loopback_conn_t*, The connection, or NULL with errno set to EBADF.
+ */
+static loopback_conn_t* loopback_get(loopback_t* loopback, int conn)
+{
+    if (conn < 0 || CONN_INDEX(conn) >= LOOPBACK_MAX_CONNS
+        || !loopback->conns[CONN_INDEX(conn)].used
+        || !loopback->conns[CONN_INDEX(conn)].open[CONN_END(conn)])
+    {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &loopback->conns[CONN_INDEX(conn)];
+}
+
+static int loopback_accept(void* ctx, uint32_t* addr)
+{
+    loopback_t* loopback = ctx;
+
+    for (int i = 0; i < LOOPBACK_MAX_CONNS; ++i)
+    {
+        if (loopback->conns[i].used && loopback->conns[i].pending)
+        {
+            loopback->conns[i].pending = false;
+            *addr = 0;
+
+            return i << 1;
+        }
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+static ssize_t loopback_recv(void* ctx, int conn, void* buf, size_t len, int flags)
+{
+    loopback_conn_t* lc = loopback_get(ctx, conn);
+
+    if (lc == NULL)
+    {
+        return -1;
+    }
+
+    stream_fifo_t* fifo = &lc->fifo[CONN_END(conn)];
+
+    if (stream_fifo_length(fifo) == 0)
+    {
+        // Everything the peer sent before closing was read.
+        if (!lc->open[!CONN_END(conn)])
+        {
+            return 0;
+        }
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Popping from a copy leaves the data in the FIFO.
+    if (flags & TRANSPORT_PEEK)
+    {
+        stream_fifo_t peek = *fifo;
+        return stream_fifo_pop(&peek, buf, len);
+    }
+
+    return stream_fifo_pop(fifo, buf, len);
+}
+
+static ssize_t loopback_writev(void* ctx, int conn, const struct iovec* iov, int iovcnt, int flags)
+{
+    loopback_conn_t* lc = loopback_get(ctx, conn);
+
+    if (lc == NULL)
+    {
+        return -1;
+    }
+
+    if (!lc->open[!CONN_END(conn)])
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    stream_fifo_t* fifo = &lc->fifo[!CONN_END(conn)];
+    ssize_t total = 0;
+
+    for (int i = 0; i < iovcnt && stream_fifo_space(fifo) > 0; ++i)
+    {
+        size_t space = stream_fifo_space(fifo);
+        size_t len = (iov[i].iov_len < space) ? iov[i].iov_len : space;
+
+        total += stream_fifo_push(fifo, iov[i].iov_base, len);
+    }
+
+    if (total == 0 && iovcnt > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return total;
+}
+
+static ssize_t loopback_sendfile(void* ctx, int conn, int fd, off_t* offset, size_t len)
+{
+    loopback_conn_t* lc = loopback_get(ctx, conn);
+
+    if (lc == NULL)
+    {
+        return -1;
+    }
+
+    if (!lc->open[!CONN_END(conn)])
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    stream_fifo_t* fifo = &lc->fifo[!CONN_END(conn)];
+    size_t space;
+    void* dest = stream_fifo_reserve(fifo, &space);
+
+    if (space == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // The file is read straight into the pipe, the rest follows on the next call.
+    ssize_t bytes = pread(fd, dest, (len < space) ? len : space, *offset);
+
+    if (bytes > 0)
+    {
+        stream_fifo_commit(fifo, bytes);
+        *offset += bytes;
+    }
+
+    return bytes;
+}
+
+static int loopback_poll(void* ctx, int conn, int events)
+{
+    loopback_conn_t* lc = loopback_get(ctx, conn);
+
+    if (lc == NULL)
+    {
+        return POLLNVAL;
+    }
+
+    int revents = 0;
+    bool peer_open = lc->open[!CONN_END(conn)];
+
+    if (!peer_open)
+    {
+        revents |= POLLHUP;
+    }
+
+    if ((events & POLLIN) && (stream_fifo_length(&lc->fifo[CONN_END(conn)]) > 0 || !peer_open))
+    {
+        revents |= POLLIN;
+    }
+
+    if ((events & POLLOUT) && peer_open && stream_fifo_space(&lc->fifo[!CONN_END(conn)]) > 0)
+    {
+        revents |= POLLOUT;
+    }
+
+    return revents;
+}
+
+static void loopback_close(void* ctx, int conn)
+{
+    loopback_conn_t* lc = loopback_get(ctx, conn);
+
+    if (lc == NULL)
+    {
+        return;
+    }
+
+    lc->open[CONN_END(conn)] = false;
+
+    // The connection is free once both ends are closed.
+    if (!lc->open[!CONN_END(conn)])
+    {
+        lc->used = false;
+    }
+}
+
+void loopback_transport_init(transport_t* transport, loopback_t* loopback)
+{
+    for (int i = 0; i < LOOPBACK_MAX_CONNS; ++i)
+    {
+        loopback->conns[i].used = false;
+    }
+
+    transport->accept = loopback_accept;
+    transport->recv = loopback_recv;
+    transport->writev = loopback_writev;
+    transport->sendfile = loopback_sendfile;
+    transport->poll = loopback_poll;
+    transport->zerocopy = NULL;
+    transport->reap_zerocopy = NULL;
+    transport->close = loopback_close;
+    transport->ctx = loopback;
+}
+
+int loopback_connect(loopback_t* loopback)
+{
+    for (int i = 0; i < LOOPBACK_MAX_CONNS; ++i)
+    {
+        loopback_conn_t* lc = &loopback->conns[i];
+
+        if (lc->used)
+        {
+            continue;
+        }
+
+        lc->used = true;
+        lc->pending = true;
+        lc->open[0] = true;
+        lc->open[1] = true;
+        stream_fifo_init(&lc->fifo[0], lc->buf[0], LOOPBACK_BUF_SIZE);
+        stream_fifo_init(&lc->fifo[1], lc->buf[1], LOOPBACK_BUF_SIZE);
+
+        return (i << 1) | 1;
+    }
+
+    errno = ECONNREFUSED;
+    return -1;
+}
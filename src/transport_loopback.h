@@ -0,0 +1,53 @@
+#pragma once
+
+#include "queue.h"
+#include "transport.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Connections a loopback transport can hold at once.
+#ifndef LOOPBACK_MAX_CONNS
+#define LOOPBACK_MAX_CONNS 4
+#endif
+
+// Bytes buffered per direction of a loopback connection.
+#ifndef LOOPBACK_BUF_SIZE
+#define LOOPBACK_BUF_SIZE (64 * 1024)
+#endif
+
+// A pair of in-memory pipes, end 0 is the accepted end and end 1 the connecting end.
+typedef struct loopback_conn
+{
+    bool used;
+    // Connected and not yet accepted.
+    bool pending;
+    bool open[2];
+    // Data that is read by each end.
+    stream_fifo_t fifo[2];
+    uint8_t buf[2][LOOPBACK_BUF_SIZE];
+} loopback_conn_t;
+
+/**
+ * In-process transport, both ends of its connections are used through the same transport. Data
+ * is only copied between memory, so the protocol engine can be benchmarked and fuzzed without the
+ * network stack.
+ */
+typedef struct loopback
+{
+    loopback_conn_t conns[LOOPBACK_MAX_CONNS];
+} loopback_t;
+
+/**
+ * @brief Initialize a loopback transport without connections.
+ * @param transport, The transport to initialize.
+ * @param loopback, The context of the transport, must outlive it.
+ */
+void loopback_transport_init(transport_t* transport, loopback_t* loopback);
+
+/**
+ * @brief Open a connection to be accepted through the transport.
+ * @param loopback, The context of the transport.
+ * @return int, The connecting end, used with the transport functions like the accepted end, or -1
+ * with errno set to ECONNREFUSED if all connections are in use.
+ */
+int loopback_connect(loopback_t* loopback);
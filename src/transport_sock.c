@@ -0,0 +1,282 @@
+// accept4
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "conv.h"
+#include "sock.h"
+#include "transport_sock.h"
+
+void sock_stop(int sock)
+{
+    shutdown(sock, SHUT_RDWR);
+    close(sock);
+}
+
+void sock_transport_stop(sock_transport_t* sock)
+{
+    if (sock->listen_sock != NO_SOCK)
+    {
+        sock_stop(sock->listen_sock);
+        sock->listen_sock = NO_SOCK;
+    }
+}
+
+/**
+ * @brief Set the options of an accepted TCP connection.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+static int sock_setup_tcp(int conn)
+{
+    int no_delay = 1;
+    int keepalive = 1;
+    int keepalive_idle = SOCK_KEEPALIVE_IDLE_S;
+    int keepalive_interval = SOCK_KEEPALIVE_INTVL_S;
+    int keepalive_cnt = SOCK_KEEPALIVE_CNT;
+    // Unacknowledged data is given up on as fast as an unanswered keepalive.
+    unsigned int user_timeout
+        = (SOCK_KEEPALIVE_IDLE_S + SOCK_KEEPALIVE_INTVL_S * SOCK_KEEPALIVE_CNT) * 1000;
+
+    // Set no delay on client.
+    if (setsockopt(conn, SOL_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay)))
+    {
+        return -1;
+    }
+
+    // Setup keepalive packets for client, so half-open connections are detected.
+    if (setsockopt(conn, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive))
+        || setsockopt(conn, SOL_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle))
+        || setsockopt(
+            conn, SOL_TCP, TCP_KEEPINTVL, &keepalive_interval, sizeof(keepalive_interval))
+        || setsockopt(conn, SOL_TCP, TCP_KEEPCNT, &keepalive_cnt, sizeof(keepalive_cnt))
+        || setsockopt(conn, SOL_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout)))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sock_accept(void* ctx, uint32_t* addr)
+{
+    sock_transport_t* sock = ctx;
+
+    if (sock->listen_sock == NO_SOCK)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+
+    int conn = accept4(
+        sock->listen_sock, (struct sockaddr*)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (conn == -1)
+    {
+        // Acceptor socket failed in some way, stop this socket.
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED
+            && errno != EMFILE && errno != ENFILE && errno != ENOBUFS && errno != ENOMEM)
+        {
+            int error = errno;
+            sock_transport_stop(sock);
+            errno = error;
+        }
+
+        return -1;
+    }
+
+    if (sock->tcp && sock_setup_tcp(conn))
+    {
+        // Reported like a connection that was reset before it was accepted.
+        sock_stop(conn);
+        errno = ECONNABORTED;
+        return -1;
+    }
+
+    *addr = (peer.sin_family == AF_INET) ? peer.sin_addr.s_addr : 0;
+
+    return conn;
+}
+
+static ssize_t sock_recv(void* ctx, int conn, void* buf, size_t len, int flags)
+{
+    return recv(conn, buf, len, MSG_DONTWAIT | ((flags & TRANSPORT_PEEK) ? MSG_PEEK : 0));
+}
+
+static ssize_t sock_writev(void* ctx, int conn, const struct iovec* iov, int iovcnt, int flags)
+{
+    struct msghdr msg = { .msg_iov = (struct iovec*)iov, .msg_iovlen = iovcnt };
+
+    ssize_t bytes = sendmsg(conn, &msg,
+        MSG_DONTWAIT | MSG_NOSIGNAL | ((flags & TRANSPORT_MORE) ? MSG_MORE : 0)
+            | ((flags & TRANSPORT_ZEROCOPY) ? MSG_ZEROCOPY : 0));
+
+    // Out of memory for pinned pages, retried once earlier sends are reaped.
+    if (bytes < 0 && errno == ENOBUFS && (flags & TRANSPORT_ZEROCOPY))
+    {
+        errno = EAGAIN;
+    }
+
+    return bytes;
+}
+
+static ssize_t sock_sendfile(void* ctx, int conn, int fd, off_t* offset, size_t len)
+{
+    return sendfile(conn, fd, offset, len);
+}
+
+static int sock_poll(void* ctx, int conn, int events)
+{
+    struct pollfd pfd = { .fd = conn, .events = events };
+
+    if (poll(&pfd, 1, 0) < 0)
+    {
+        return 0;
+    }
+
+    return pfd.revents;
+}
+
+static int sock_zerocopy(void* ctx, int conn)
+{
+    int enable = 1;
+
+    return setsockopt(conn, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable));
+}
+
+static int sock_reap_zerocopy(void* ctx, int conn, uint32_t* last, bool* copied)
+{
+    while (1)
+    {
+        // The error is followed by the address of the offender, unused for zero copy.
+        uint8_t control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+
+        if (recvmsg(conn, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+        {
+            return -1;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            struct sock_extended_err err;
+
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            // Notifications cover the sends from ee_info up to ee_data, in order for a stream.
+            *last = err.ee_data;
+            *copied = (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+
+            return 0;
+        }
+    }
+}
+
+static void sock_close(void* ctx, int conn) { sock_stop(conn); }
+
+void sock_transport_init(transport_t* transport, sock_transport_t* sock)
+{
+    sock->listen_sock = NO_SOCK;
+    sock->tcp = false;
+
+    transport->accept = sock_accept;
+    transport->recv = sock_recv;
+    transport->writev = sock_writev;
+    transport->sendfile = sock_sendfile;
+    transport->poll = sock_poll;
+    transport->zerocopy = sock_zerocopy;
+    transport->reap_zerocopy = sock_reap_zerocopy;
+    transport->close = sock_close;
+    transport->ctx = sock;
+}
+
+/**
+ * @brief Bind a new non blocking listen socket and listen on it.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+static int sock_listen(sock_transport_t* sock, int domain, const struct sockaddr* addr,
+    socklen_t addr_len, int backlog)
+{
+    sock_transport_stop(sock);
+
+    int listen_sock = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (listen_sock == -1)
+    {
+        return -1;
+    }
+
+    int reuse = 1;
+
+    // Connections of a previous run in TIME_WAIT do not block a restart.
+    if ((domain == AF_INET
+            && setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)))
+        || bind(listen_sock, addr, addr_len) || listen(listen_sock, backlog))
+    {
+        int error = errno;
+        close(listen_sock);
+        errno = error;
+        return -1;
+    }
+
+    sock->listen_sock = listen_sock;
+    sock->tcp = domain == AF_INET;
+
+    return 0;
+}
+
+int sock_transport_listen_tcp(sock_transport_t* sock, uint16_t port, int backlog)
+{
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+
+    addr.sin_port = TO_NETWORK_ENDIAN_U16(port);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = 0;
+
+    return sock_listen(sock, AF_INET, (struct sockaddr*)&addr, sizeof(addr), backlog);
+}
+
+int sock_transport_listen_unix(sock_transport_t* sock, const char* path, int backlog)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (path == NULL || strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    // A socket file left behind by an earlier run.
+    unlink(path);
+
+    return sock_listen(sock, AF_UNIX, (struct sockaddr*)&addr, sizeof(addr), backlog);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "transport.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// TCP keepalive of accepted connections, a peer that does not answer for
+// SOCK_KEEPALIVE_IDLE_S + SOCK_KEEPALIVE_INTVL_S * SOCK_KEEPALIVE_CNT seconds is disconnected.
+#ifndef SOCK_KEEPALIVE_IDLE_S
+#define SOCK_KEEPALIVE_IDLE_S 10
+#endif
+
+#ifndef SOCK_KEEPALIVE_INTVL_S
+#define SOCK_KEEPALIVE_INTVL_S 10
+#endif
+
+#ifndef SOCK_KEEPALIVE_CNT
+#define SOCK_KEEPALIVE_CNT 10
+#endif
+
+/**
+ * Transport over BSD sockets, connections are the sockets themselves. Sockets of any kind can be
+ * used as connection, connections are accepted from a TCP or Unix domain listen socket.
+ */
+typedef struct sock_transport
+{
+    int listen_sock;
+    // The listen socket is TCP, accepted connections get TCP_NODELAY and keepalive.
+    bool tcp;
+} sock_transport_t;
+
+/**
+ * @brief Initialize a socket transport without a listen socket.
+ * @param transport, The transport to initialize.
+ * @param sock, The context of the transport, must outlive it.
+ */
+void sock_transport_init(transport_t* transport, sock_transport_t* sock);
+
+/**
+ * @brief Accept TCP connections on a port of every IPv4 address.
+ * @param sock, The socket transport, an earlier listen socket is closed.
+ * @param port, The port to listen on, 0 for any free port.
+ * @param backlog, Number of connections the kernel queues until they are accepted.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int sock_transport_listen_tcp(sock_transport_t* sock, uint16_t port, int backlog);
+
+/**
+ * @brief Accept connections on a Unix domain socket, an existing file at path is replaced.
+ * @param sock, The socket transport, an earlier listen socket is closed.
+ * @param path, Path of the socket.
+ * @param backlog, Number of connections the kernel queues until they are accepted.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int sock_transport_listen_unix(sock_transport_t* sock, const char* path, int backlog);
+
+/**
+ * @brief Close the listen socket, connections that were accepted stay open.
+ * @param sock, The socket transport.
+ */
+void sock_transport_stop(sock_transport_t* sock);
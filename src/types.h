@@ -1,6 +0,0 @@
-#pragma once
-
-#include <stddef.h>
-
-typedef void* (*alloc_fn)(size_t size);
-typedef void (*free_fn)(void* obj);
\ No newline at end of file
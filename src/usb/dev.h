@@ -126,6 +126,7 @@ typedef struct usb_string_desc
 
 typedef void (*usb_ep_to_device)(void*, size_t);
 typedef ssize_t (*usb_ep_to_host)(void*, size_t);
+typedef ssize_t (*usb_ep_to_host_file)(urb_file_region_t*, size_t);
 
 typedef struct usb_ep
 {
@@ -133,6 +134,9 @@ typedef struct usb_ep
     struct usb_ep* next;
     usb_ep_to_device to_device;
     usb_ep_to_host to_host;
+    // Optional, points at up to len bytes of IN data in a file instead of copying them, the file
+    // has to stay open until the data is sent.
+    usb_ep_to_host_file to_host_file;
 } usb_ep_t;
 
 typedef struct usb_if
@@ -1,5 +1,12 @@
 #pragma once
+#include "timer_wheel.h"
 #include <stdint.h>
+#include <sys/types.h>
+
+// Transfer buffers up to this size are embedded in the URB instead of taken from the size classes.
+#ifndef URB_INLINE_BUF_SIZE
+#define URB_INLINE_BUF_SIZE 64
+#endif
 
 #pragma pack(push, 1)
 typedef struct urb_setup
@@ -56,6 +63,23 @@ typedef struct usb_iso_packet_descriptor
     int status;
 } usb_iso_packet_descriptor_t;
 
+// Lifecycle of a pooled URB, every URB moves through these states in order.
+typedef enum urb_state
+{
+    URB_STATE_FREE = 0, // In the pool of the Host controller.
+    URB_STATE_ALLOCATED, // Taken from the pool, owned by the submitter.
+    URB_STATE_SUBMITTED, // Owned by the Host controller until it completes or is unlinked.
+    URB_STATE_COMPLETED, // Handed to the completion routine, which owns it.
+    URB_STATE_SENT, // Result queued to the submitter, only freeing remains.
+} urb_state_t;
+
+// Part of a file holding the IN data of a URB, sent without passing through a transfer buffer.
+typedef struct urb_file_region
+{
+    int fd;
+    off_t offset;
+} urb_file_region_t;
+
 typedef struct urb
 {
     unsigned int pipe; // endpoint information
@@ -70,8 +94,8 @@ typedef struct urb
 #define PIPE_TYPE_INTR 0x2
 #define PIPE_TYPE_ISO  0x3
 
-#define PIPE_TYPE_GET(pipe) ((pipe >> PIPE_TYPE_OFF) & PIPE_TYPE_MASK);
-#define PIPE_TYPE_SET(pipe) ((pipe & PIPE_TYPE_MASK) << PIPE_TYPE_OFF);
+#define PIPE_TYPE_GET(pipe) (((pipe) >> PIPE_TYPE_OFF) & PIPE_TYPE_MASK)
+#define PIPE_TYPE_SET(pipe) (((pipe)&PIPE_TYPE_MASK) << PIPE_TYPE_OFF)
 #define PIPE_DIR(pipe)      ((pipe)&PIPE_DIR_MASK)
 #define PIPE_EP_GET(pipe)   (pipe >> PIPE_EP_OFF)
 #define PIPE_EP_SET(pipe)   (pipe << PIPE_EP_OFF)
@@ -85,6 +109,7 @@ typedef struct urb
 #define URB_FREE_BUFFER         0x0100 // Free transfer buffer with the URB
 // Interal flags
 #define URB_INTERNAL_PARTIAL_URB 0x0200 // This is a partial URB not fully received yet.
+#define URB_FILE_REGION          0x0400 // IN data is in file_region, there is no transfer buffer.
 
     // (IN) all urbs need completion routines
     void* context; // context for completion routine
@@ -96,6 +121,7 @@ typedef struct urb
     // (IN) buffer used for data transfers
     void* transfer_buffer; // associated data buffer
     uint32_t transfer_buffer_length; // data buffer length
+    urb_file_region_t file_region; // (OUT) where the data is with URB_FILE_REGION
     int number_of_packets; // size of iso_frame_desc
 
     // (OUT) sometimes only part of CTRL/BULK/INTR transfer_buffer is used
@@ -117,6 +143,21 @@ typedef struct urb
     // Sequence number of this urb request needed for unlink requests.
     uint32_t seq_num;
 
+    // Handle of the device this urb is submitted to.
+    uint32_t dev;
+
+    // Handle of the object that submitted this urb, validated before completion is delivered.
+    uint32_t owner;
+
     // Next urb in sequence (singly linked list)
     struct urb* next;
+
+    // Current lifecycle state, see urb_state_t.
+    urb_state_t state;
+
+    // Timer of the submitter (e.g. a timeout), it is disarmed when the URB is freed.
+    wheel_timer_t timer;
+
+    // Storage for small transfer buffers, transfer_buffer points here when it is used.
+    _Alignas(sizeof(void*)) uint8_t inline_buf[URB_INLINE_BUF_SIZE];
 } urb_t;
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "usbip_types.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,45 +17,7 @@
 
 typedef __ssize_t ssize_t;
 
-#ifdef DEV_POOL_SIZE
-static mem_pool_t dev_mem_pool;
-static mem_pool_t dev_node_mem_pool;
-static vusb_dev_t dev_pool[DEV_POOL_SIZE];
-static node_t dev_node_pool[DEV_POOL_SIZE];
-
-void* _dev_mem_alloc(size_t n) { return mem_pool_alloc(dev_mem_pool); }
-
-void* _dev_mem_free(void* obj) { return mem_pool_free(dev_mem_pool, obj); }
-
-void* _dev_node_mem_alloc(size_t n) { return mem_pool_alloc(dev_node_mem_pool); }
-
-void* _dev_node_mem_free(void* obj) { return mem_pool_free(dev_node_mem_pool, obj); }
-
-alloc_fn dev_alloc = _dev_mem_alloc;
-alloc_fn dev_node_alloc = _dev_node_mem_alloc;
-free_fn dev_free = _dev_mem_free;
-free_fn dev_node_free = _dev_node_mem_free;
-#else
-alloc_fn dev_alloc = malloc;
-alloc_fn dev_node_alloc = malloc;
-free_fn dev_free = free;
-free_fn dev_node_free = free;
-#endif
-
-#ifdef URB_POOL_SIZE
-static mem_pool_t urb_mem_pool;
-static urb_t urb_pool[URB_POOL_SIZE];
-
-void* _urb_mem_alloc(size_t n) { return mem_pool_alloc(urb_mem_pool); }
-
-void* _urb_mem_free(void* obj) { return mem_pool_free(urb_mem_pool, obj); }
-
-alloc_fn urb_alloc = _urb_mem_alloc;
-free_fn urb_free = _urb_mem_free;
-#else
-alloc_fn urb_alloc = malloc;
-free_fn urb_free = free;
-#endif
+static const size_t urb_buf_counts[] = VHCI_URB_BUF_COUNTS;
 
 static void stop_sock(int* sock)
 {
@@ -63,20 +26,30 @@ static void stop_sock(int* sock)
     *sock = NO_SOCK;
 }
 
-int vhci_init(vhci_handle_t* handle)
+int vhci_init(vhci_handle_t* handle, const allocator_t* allocator)
 {
-#ifdef DEV_POOL_SIZE
-    init_obj_mem_pool(sizeof(vusb_dev_t), dev_pool, DEV_POOL_SIZE, dev_mem_pool);
-    init_obj_mem_pool(sizeof(node_t), dev_node_pool, DEV_POOL_SIZE, dev_node_mem_pool);
-#endif
-
-#ifdef URB_POOL_SIZE
-    init_obj_mem_pool(sizeof(urb_t), urb_mem_pool, URB_POOL_SIZE, urb_mem_pool);
-#endif
+    if (handle == NULL || allocator == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
 
     memset(handle, 0, sizeof(vhci_handle_t));
 
-    if (linked_list_init(dev_node_alloc, dev_node_free, &handle->devices))
+    handle->allocator = *allocator;
+
+    if (slot_map_init(&handle->devices, handle->device_slots, VHCI_MAX_DEVICES))
+    {
+        return -1;
+    }
+
+    if (slab_init(&handle->urb_bufs, handle->urb_buf_region, sizeof(handle->urb_buf_region),
+            VHCI_URB_BUF_MIN_SIZE, urb_buf_counts, sizeof(urb_buf_counts) / sizeof(size_t)))
+    {
+        return -1;
+    }
+
+    if (init_mem_pool(sizeof(urb_t), handle->urb_mem, sizeof(handle->urb_mem), &handle->urbs))
     {
         return -1;
     }
@@ -96,16 +69,20 @@ void handle_get_desc(vusb_dev_t* dev, urb_t* urb)
         {
         case USB_DESC_TYPE_DEV:
         {
-            void* dest = urb->transfer_buffer;
+            uint8_t desc[sizeof(usb_desc_hdr_t) + sizeof(usb_dev_desc_t)];
 
-            usb_desc_hdr_t* hdr = dest;
-            hdr->bLength = sizeof(usb_dev_desc_t) + sizeof(usb_desc_hdr_t);
-            hdr->bDescriptorType = USB_DESC_TYPE_CONF;
+            usb_desc_hdr_t* hdr = (usb_desc_hdr_t*)desc;
+            hdr->bLength = sizeof(desc);
+            hdr->bDescriptorType = USB_DESC_TYPE_DEV;
 
-            usb_dev_desc_t* desc = &dev->dev->desc;
+            memcpy(desc + sizeof(usb_desc_hdr_t), &dev->dev->desc, sizeof(usb_dev_desc_t));
 
-            memcpy(dest + sizeof(usb_desc_hdr_t), desc, sizeof(usb_dev_desc_t));
-            urb->actual_length = hdr->bLength;
+            // Hosts first ask for the first 8 bytes only, to learn bMaxPacketSize0.
+            urb->actual_length = urb->transfer_buffer_length < sizeof(desc)
+                ? urb->transfer_buffer_length
+                : sizeof(desc);
+            memcpy(urb->transfer_buffer, desc, urb->actual_length);
+            urb->status = 0;
             break;
         }
         case USB_DESC_TYPE_CONF:
@@ -130,7 +107,7 @@ void handle_get_desc(vusb_dev_t* dev, urb_t* urb)
                 while (cur_if_grp != NULL)
                 {
                     usb_if_t* cur_if = cur_if_grp->interfaces;
-                    while (cur_if_grp != NULL)
+                    while (cur_if != NULL)
                     {
                         hdr = dest;
                         hdr->bDescriptorType = USB_DESC_TYPE_IF;
@@ -173,6 +150,7 @@ void handle_get_desc(vusb_dev_t* dev, urb_t* urb)
                 }
 
                 urb->actual_length = urb->transfer_buffer_length - remaining;
+                urb->status = 0;
             }
 
             break;
@@ -193,9 +171,11 @@ void handle_get_desc(vusb_dev_t* dev, urb_t* urb)
                 hdr->bDescriptorType = USB_DESC_TYPE_STR;
                 hdr->bLength = sizeof(usb_desc_hdr_t) + 2;
 
-                *((uint16_t*)dest + sizeof(usb_desc_hdr_t)) = dev->dev->lang_id;
+                uint16_t lang_id = dev->dev->lang_id;
+                memcpy((uint8_t*)dest + sizeof(usb_desc_hdr_t), &lang_id, sizeof(lang_id));
 
                 urb->actual_length = hdr->bLength;
+                urb->status = 0;
             }
             else
             {
@@ -221,17 +201,95 @@ void handle_get_desc(vusb_dev_t* dev, urb_t* urb)
                 hdr->bLength = sizeof(usb_desc_hdr_t) + byte_len;
                 memcpy(urb->transfer_buffer + sizeof(usb_desc_hdr_t), str, byte_len);
                 urb->actual_length = hdr->bLength;
+                urb->status = 0;
             }
             break;
         }
         default:
-            urb->status = ENOTSUP;
+            urb->status = -ENOTSUP;
             break;
         }
     }
 }
 
-void handle_urb(vusb_dev_t* dev, urb_t* urb)
+usb_ep_t* vhci_find_ep(usb_dev_t* dev, uint8_t ep, uint8_t direction)
+{
+    usb_conf_t* conf = usb_dev_get_config(dev, dev->cur_config);
+    usb_if_group_t* grp = (conf != NULL) ? conf->interfaces : NULL;
+
+    // Only the endpoints of the active alternate setting of every interface can be addressed.
+    for (; grp != NULL; grp = grp->next)
+    {
+        for (usb_if_t* cur_if = grp->interfaces; cur_if != NULL; cur_if = cur_if->next)
+        {
+            if (cur_if->desc.bAlternateSetting == grp->cur_alt_set)
+            {
+                usb_ep_t* found = usb_if_get_ep(cur_if, ep, direction);
+
+                if (found != NULL)
+                {
+                    return found;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int handle_ep_urb(vusb_dev_t* dev, urb_t* urb)
+{
+    uint8_t direction = PIPE_DIR(urb->pipe);
+    usb_ep_t* ep = vhci_find_ep(dev->dev, PIPE_EP_GET(urb->pipe), direction);
+
+    if (direction == PIPE_IN)
+    {
+        bool file = urb->transfer_flags & URB_FILE_REGION;
+
+        if (ep == NULL || (file ? ep->to_host_file == NULL : ep->to_host == NULL))
+        {
+            urb->status = -EPIPE;
+            return 1;
+        }
+
+        ssize_t bytes = file
+            ? ep->to_host_file(&urb->file_region, urb->transfer_buffer_length)
+            : ep->to_host(urb->transfer_buffer, urb->transfer_buffer_length);
+
+        if (bytes < 0)
+        {
+            // Nothing to send yet, like a NAK, the URB stays pending.
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+
+            urb->status = -errno;
+            return 1;
+        }
+
+        urb->actual_length = bytes;
+    }
+    else
+    {
+        if (ep == NULL || ep->to_device == NULL)
+        {
+            urb->status = -EPIPE;
+            return 1;
+        }
+
+        ep->to_device(urb->transfer_buffer, urb->actual_length);
+    }
+
+    urb->status = 0;
+    return 1;
+}
+
+/**
+ * @brief Run a URB against the device.
+ * @return int, 1 when the URB completed, 0 when it has to be retried later.
+ */
+static int handle_urb(vusb_dev_t* dev, urb_t* urb)
 {
     uint8_t direction = PIPE_DIR(urb->pipe);
     uint8_t ep = PIPE_EP_GET(urb->pipe);
@@ -247,6 +305,12 @@ void handle_urb(vusb_dev_t* dev, urb_t* urb)
             uint16_t idx = urb->setup_packet.wIndex;
             uint8_t type = urb->setup_packet.bmRequestType.recipient;
 
+            if (urb->transfer_buffer_length < 2)
+            {
+                urb->status = -EINVAL;
+                break;
+            }
+
             urb->actual_length = 2;
             ((uint16_t*)urb->transfer_buffer)[0] = 0;
             break;
@@ -286,7 +350,7 @@ void handle_urb(vusb_dev_t* dev, urb_t* urb)
             }
             else
             {
-                urb->status = EINVAL;
+                urb->status = -EINVAL;
             }
 
             break;
@@ -302,44 +366,42 @@ void handle_urb(vusb_dev_t* dev, urb_t* urb)
             }
             else
             {
-                urb->status = EINVAL;
+                urb->status = -EINVAL;
             }
             break;
         }
         case DEV_REQ_GET_IF:
         {
-            urb->status = EINVAL;
+            urb->status = -EINVAL;
             uint16_t idx = urb->setup_packet.wIndex;
 
             usb_if_group_t* cur_if = usb_dev_get_if_grp(dev->dev, dev->dev->cur_config, idx);
 
-            if (cur_if != NULL)
+            if (cur_if != NULL && urb->transfer_buffer_length >= 1)
             {
                 ((uint8_t*)urb->transfer_buffer)[0] = cur_if->cur_alt_set;
 
                 urb->actual_length = 1;
+                urb->status = 0;
             }
 
             break;
         }
         default:
-            urb->status = ENOTSUP;
+            urb->status = -ENOTSUP;
             break;
         }
-        urb->complete(urb, urb->context);
-    }
-    else
-    {
-        if (direction == PIPE_IN)
-        {
-            // urb->dev->ep[ep].in(urb->transfer_buffer, urb->transfer_buffer_length);
-        }
-        else
-        {
-            /*urb->actual_length
-                = urb->dev->ep[ep].out(urb->transfer_buffer, urb->transfer_buffer_length);*/
-        }
+
+        return 1;
     }
+
+    return handle_ep_urb(dev, urb);
+}
+
+static void complete_urb(urb_t* urb)
+{
+    urb->state = URB_STATE_COMPLETED;
+    urb->complete(urb, urb->context);
 }
 
 int vhci_register_dev(vhci_handle_t* handle, usb_dev_t* dev)
@@ -360,7 +422,8 @@ int vhci_register_dev(vhci_handle_t* handle, usb_dev_t* dev)
     dev->devnum = handle->last_devnum++;
     dev->busnum = handle->last_busnum;
 
-    vusb_dev_t* vdev = dev_alloc(sizeof(vusb_dev_t));
+    vusb_dev_t* vdev
+        = allocator_alloc(&handle->allocator, sizeof(vusb_dev_t), _Alignof(vusb_dev_t));
 
     if (vdev == NULL)
     {
@@ -369,10 +432,12 @@ int vhci_register_dev(vhci_handle_t* handle, usb_dev_t* dev)
     }
 
     vdev->dev = dev;
+    vdev->urb_list.next = NULL;
+    vdev->handle = slot_map_insert(&handle->devices, vdev);
 
-    if (linked_list_push(&handle->devices, vdev) == -1)
+    if (vdev->handle == SLOT_HANDLE_INVALID)
     {
-        dev_free(vdev);
+        allocator_free(&handle->allocator, vdev, sizeof(vusb_dev_t));
         return -1;
     }
 
@@ -382,120 +447,375 @@ int vhci_register_dev(vhci_handle_t* handle, usb_dev_t* dev)
     return 0;
 }
 
-typedef struct vhci_iter_ctx
+int vhci_remove_device(vhci_handle_t* handle, usb_dev_t* dev)
 {
-    void* user_ctx;
-    vhci_iter_cb user_cb;
-} vhci_iter_ctx_t;
+    if (handle == NULL || dev == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
 
-int vhci_iter_internal(void* data, size_t idx, void* ctx)
-{
-    vhci_iter_ctx_t* iter_ctx = ctx;
+    size_t i;
 
-    iter_ctx->user_cb(data, iter_ctx->user_ctx);
-    return 0;
+    SLOT_MAP_FOREACH(&handle->devices, i)
+    {
+        vusb_dev_t* vdev = slot_map_at(&handle->devices, i);
+
+        if (vdev->dev == dev)
+        {
+            // Outstanding handles to this device become stale.
+            slot_map_remove(&handle->devices, vdev->handle);
+
+            urb_t* urb = vdev->urb_list.next;
+
+            // Pending URBs can no longer complete normally.
+            while (urb != NULL)
+            {
+                urb_t* next = urb->next;
+
+                urb->next = NULL;
+                urb->status = -ESHUTDOWN;
+                complete_urb(urb);
+                urb = next;
+            }
+
+            allocator_free(&handle->allocator, vdev, sizeof(vusb_dev_t));
+            return 0;
+        }
+    }
+
+    errno = ENODEV;
+    return -1;
 }
 
 void vhci_iter_devices(vhci_handle_t* handle, vhci_iter_cb cb, void* ctx)
 {
-    vhci_iter_ctx_t iter_ctx = {
-        .user_ctx = ctx,
-        .user_cb = cb,
-    };
+    size_t i;
 
-    linked_list_iter(&handle->devices, vhci_iter_internal, &iter_ctx);
+    SLOT_MAP_FOREACH(&handle->devices, i)
+    {
+        cb(slot_map_at(&handle->devices, i), ctx);
+    }
 }
 
-typedef struct vhci_find_dev_ctx
+vusb_dev_t* vhci_find_device(vhci_handle_t* handle, const char* busid)
 {
-    const char* busid;
-    vusb_dev_t* dev;
-} vhci_find_dev_ctx_t;
+    size_t i;
 
-int vhci_find_dev_iter(void* data, size_t idx, void* ctx)
+    SLOT_MAP_FOREACH(&handle->devices, i)
+    {
+        vusb_dev_t* dev = slot_map_at(&handle->devices, i);
+
+        if (strncmp(busid, dev->dev->busid, 32) == 0)
+        {
+            return dev;
+        }
+    }
+
+    return NULL;
+}
+
+vusb_dev_t* vhci_get_device(vhci_handle_t* handle, uint32_t busnum, uint32_t devnum)
 {
-    vhci_find_dev_ctx_t* find_ctx = ctx;
-    vusb_dev_t* dev = data;
+    size_t i;
 
-    if (strncmp(find_ctx->busid, dev->dev->busid, 32) == 0)
+    SLOT_MAP_FOREACH(&handle->devices, i)
     {
-        find_ctx->dev = dev;
+        vusb_dev_t* dev = slot_map_at(&handle->devices, i);
+
+        if (dev->dev->busnum == busnum && dev->dev->devnum == devnum)
+        {
+            return dev;
+        }
     }
 
-    return 0;
+    return NULL;
 }
 
-vusb_dev_t* vhci_find_device(vhci_handle_t* handle, const char* busid)
+vusb_dev_t* vhci_get_device_by_handle(vhci_handle_t* handle, slot_handle_t dev_handle)
 {
-    vhci_find_dev_ctx_t ctx = {
-        .busid = busid,
-        .dev = NULL,
-    };
-    linked_list_iter(&handle->devices, vhci_find_dev_iter, &ctx);
+    return slot_map_get(&handle->devices, dev_handle);
+}
 
-    return ctx.dev;
+static void vhci_handle_dev(vhci_handle_t* handle, vusb_dev_t* dev)
+{
+    urb_t* prev = &dev->urb_list;
+
+    // Retry pending URBs in submission order.
+    while (prev->next != NULL)
+    {
+        urb_t* urb = prev->next;
+
+        if (handle_urb(dev, urb))
+        {
+            prev->next = urb->next;
+            urb->next = NULL;
+            complete_urb(urb);
+        }
+        else
+        {
+            prev = urb;
+        }
+    }
 }
 
-typedef struct vhci_get_dev_ctx
+static urb_t* urb_alloc(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length,
+    uint32_t buffer_length)
 {
-    uint32_t busnum;
-    uint32_t devnum;
-    vusb_dev_t* dev;
-} vhci_get_dev_ctx_t;
+    urb_t* urb = mem_pool_alloc(&handle->urbs);
+
+    if (urb == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // The inline buffer is not cleared, like buffers from the size classes.
+    memset(urb, 0, offsetof(urb_t, inline_buf));
+
+    urb->state = URB_STATE_ALLOCATED;
+    urb->dev = dev->handle;
+    urb->transfer_buffer_length = transfer_buffer_length;
 
-int vhci_get_dev_iter(void* data, size_t idx, void* ctx)
+    if (buffer_length > URB_INLINE_BUF_SIZE)
+    {
+        urb->transfer_buffer = slab_alloc(&handle->urb_bufs, buffer_length);
+
+        if (urb->transfer_buffer == NULL)
+        {
+            urb->state = URB_STATE_FREE;
+            mem_pool_free(&handle->urbs, urb);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        urb->transfer_flags |= URB_FREE_BUFFER;
+    }
+    else if (buffer_length > 0)
+    {
+        urb->transfer_buffer = urb->inline_buf;
+    }
+
+    return urb;
+}
+
+urb_t* vhci_urb_alloc(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length)
 {
-    vhci_get_dev_ctx_t* find_ctx = ctx;
-    vusb_dev_t* dev = data;
+    return urb_alloc(handle, dev, transfer_buffer_length, transfer_buffer_length);
+}
 
-    if (dev->dev->busnum == find_ctx->busnum && dev->dev->devnum == find_ctx->devnum)
+urb_t* vhci_urb_alloc_file(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length)
+{
+    urb_t* urb = urb_alloc(handle, dev, transfer_buffer_length, 0);
+
+    if (urb != NULL)
     {
-        find_ctx->dev = dev;
+        urb->transfer_flags |= URB_FILE_REGION;
+        urb->file_region.fd = -1;
     }
 
-    return 0;
+    return urb;
 }
 
-vusb_dev_t* vhci_get_device(vhci_handle_t* handle, uint32_t busnum, uint32_t devnum)
+urb_t* vhci_urb_alloc_stream(
+    vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length)
+{
+    uint32_t stage_length = (transfer_buffer_length < VHCI_URB_STREAM_CHUNK)
+        ? transfer_buffer_length
+        : VHCI_URB_STREAM_CHUNK;
+
+    urb_t* urb = urb_alloc(handle, dev, transfer_buffer_length, stage_length);
+
+    if (urb != NULL)
+    {
+        urb->transfer_flags |= URB_INTERNAL_PARTIAL_URB;
+    }
+
+    return urb;
+}
+
+void vhci_urb_free(vhci_handle_t* handle, urb_t* urb)
 {
-    vhci_get_dev_ctx_t ctx = {
-        .devnum = devnum,
-        .busnum = busnum,
-        .dev = NULL,
-    };
-    linked_list_iter(&handle->devices, vhci_get_dev_iter, &ctx);
-
-    return ctx.dev;
+    if (urb->transfer_flags & URB_FREE_BUFFER)
+    {
+        slab_free(&handle->urb_bufs, urb->transfer_buffer);
+    }
+
+    wheel_timer_cancel(&urb->timer);
+    urb->state = URB_STATE_FREE;
+    mem_pool_free(&handle->urbs, urb);
 }
 
-int vhci_handle_dev(void* data, size_t idx, void* ctx)
+int vhci_submit_urb(vhci_handle_t* handle, urb_t* urb)
 {
-    vhci_handle_t* handle = ctx;
-    vusb_dev_t* dev = data;
+    if (handle == NULL || urb == NULL || urb->state != URB_STATE_ALLOCATED)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    vusb_dev_t* dev = vhci_get_device_by_handle(handle, urb->dev);
+
+    if (dev == NULL)
+    {
+        errno = ENODEV;
+        return -1;
+    }
+
+    // Streamed URBs only check their endpoint, the data is passed on by vhci_urb_stream.
+    if (urb->transfer_flags & URB_INTERNAL_PARTIAL_URB)
+    {
+        usb_ep_t* ep = vhci_find_ep(dev->dev, PIPE_EP_GET(urb->pipe), PIPE_DIR(urb->pipe));
+
+        if (PIPE_DIR(urb->pipe) != PIPE_OUT || ep == NULL || ep->to_device == NULL)
+        {
+            errno = EPIPE;
+            return -1;
+        }
+
+        urb->state = URB_STATE_SUBMITTED;
+        return 0;
+    }
+
+    urb->state = URB_STATE_SUBMITTED;
+
+    if (handle_urb(dev, urb))
+    {
+        complete_urb(urb);
+        return 0;
+    }
+
+    urb_t* tail = &dev->urb_list;
+
+    while (tail->next != NULL)
+    {
+        tail = tail->next;
+    }
+
+    // Retried from vhci_run_once until it completes or is unlinked.
+    urb->next = NULL;
+    tail->next = urb;
 
     return 0;
 }
 
-int vhci_urb_init(vhci_handle_t* handle, vusb_dev_t* dev, urb_t* urb)
+int vhci_urb_stream(vhci_handle_t* handle, urb_t* urb, uint32_t length)
 {
-    urb->status = 0;
+    if (handle == NULL || urb == NULL || urb->state != URB_STATE_SUBMITTED
+        || !(urb->transfer_flags & URB_INTERNAL_PARTIAL_URB)
+        || length > urb->transfer_buffer_length - urb->actual_length)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    vusb_dev_t* dev = vhci_get_device_by_handle(handle, urb->dev);
+    usb_ep_t* ep = (dev != NULL)
+        ? vhci_find_ep(dev->dev, PIPE_EP_GET(urb->pipe), PIPE_DIR(urb->pipe))
+        : NULL;
+
+    // The device was removed or reconfigured while the data was arriving.
+    if (ep == NULL || ep->to_device == NULL)
+    {
+        errno = ENODEV;
+        return -1;
+    }
+
+    ep->to_device(urb->transfer_buffer, length);
+    urb->actual_length += length;
+
+    if (urb->actual_length == urb->transfer_buffer_length)
+    {
+        urb->transfer_flags &= ~URB_INTERNAL_PARTIAL_URB;
+        urb->status = 0;
+        complete_urb(urb);
+    }
 
     return 0;
 }
 
-int vhci_submit_urb(vhci_handle_t* handle, urb_t urb)
+int vhci_unlink_urb(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t seq_num, uint32_t owner)
 {
-    errno = ENOTSUP;
+    if (handle == NULL || dev == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (urb_t* prev = &dev->urb_list; prev->next != NULL; prev = prev->next)
+    {
+        urb_t* urb = prev->next;
+
+        if (urb->seq_num == seq_num && urb->owner == owner)
+        {
+            prev->next = urb->next;
+            vhci_urb_free(handle, urb);
+            return 0;
+        }
+    }
+
+    errno = ENOENT;
     return -1;
 }
 
-int vhci_unlink_urb(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t seq_num)
+size_t vhci_unlink_owner(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t owner)
 {
-    errno = ENOTSUP;
+    size_t count = 0;
+    urb_t* prev = &dev->urb_list;
+
+    while (prev->next != NULL)
+    {
+        urb_t* urb = prev->next;
+
+        if (urb->owner == owner)
+        {
+            prev->next = urb->next;
+            vhci_urb_free(handle, urb);
+            count++;
+        }
+        else
+        {
+            prev = urb;
+        }
+    }
+
+    return count;
+}
+
+int vhci_cancel_urb(vhci_handle_t* handle, urb_t* urb, int status)
+{
+    if (handle == NULL || urb == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    vusb_dev_t* dev = vhci_get_device_by_handle(handle, urb->dev);
+
+    if (dev != NULL && urb->state == URB_STATE_SUBMITTED)
+    {
+        for (urb_t* prev = &dev->urb_list; prev->next != NULL; prev = prev->next)
+        {
+            if (prev->next == urb)
+            {
+                prev->next = urb->next;
+                urb->status = status;
+                complete_urb(urb);
+                return 0;
+            }
+        }
+    }
+
+    errno = ENOENT;
     return -1;
 }
 
 void vhci_run_once(vhci_handle_t* handle)
 {
-    linked_list_iter(&handle->devices, vhci_find_dev_iter, handle);
+    size_t i;
+
+    SLOT_MAP_FOREACH(&handle->devices, i)
+    {
+        vhci_handle_dev(handle, slot_map_at(&handle->devices, i));
+    }
 }
\ No newline at end of file
@@ -1,19 +1,64 @@
 #pragma once
 
+#include "allocator.h"
 #include "dev.h"
-#include "linked_list.h"
+#include "mem_pool.h"
+#include "slab.h"
+#include "slot_map.h"
 #include "urb.h"
 #include <stdint.h>
 
+#ifndef VHCI_MAX_DEVICES
+#define VHCI_MAX_DEVICES 32
+#endif
+
+// Maximum number of URBs allocated at once over all devices.
+#ifndef VHCI_MAX_URBS
+#define VHCI_MAX_URBS 32
+#endif
+
+// Bulk and interrupt OUT transfers larger than this are streamed to the endpoint through a staging
+// buffer of this size instead of being received whole.
+#ifndef VHCI_URB_STREAM_CHUNK
+#define VHCI_URB_STREAM_CHUNK 512
+#endif
+
+// URB transfer buffers are served from power of two size classes starting at this size.
+#ifndef VHCI_URB_BUF_MIN_SIZE
+#define VHCI_URB_BUF_MIN_SIZE 8
+#endif
+
+// Number of transfer buffers per size class, 8 up to 4096 bytes by default.
+#ifndef VHCI_URB_BUF_COUNTS
+#define VHCI_URB_BUF_COUNTS                                                                        \
+    {                                                                                              \
+        32, 32, 32, 32, 16, 16, 16, 8, 4, 4                                                        \
+    }
+#endif
+
+// Size of the region in every handle the transfer buffers are carved from, must fit
+// VHCI_URB_BUF_COUNTS.
+#ifndef VHCI_URB_BUF_REGION_SIZE
+#define VHCI_URB_BUF_REGION_SIZE (64 * 1024)
+#endif
+
 typedef struct vusb_dev
 {
+    slot_handle_t handle;
     usb_dev_t* dev;
+    // Head of the URBs submitted to this device that have not completed yet.
     urb_t urb_list;
 } vusb_dev_t;
 
 typedef struct vhci_handle
 {
-    linked_list_t devices;
+    allocator_t allocator;
+    slot_map_t devices;
+    slot_map_entry_t device_slots[VHCI_MAX_DEVICES];
+    slab_t urb_bufs;
+    mem_pool_t urbs;
+    _Alignas(urb_t) uint8_t urb_mem[MEM_POOL_SIZE(urb_t, VHCI_MAX_URBS)];
+    _Alignas(sizeof(void*)) uint8_t urb_buf_region[VHCI_URB_BUF_REGION_SIZE];
     uint32_t last_busnum;
     uint32_t last_devnum;
 } vhci_handle_t;
@@ -23,9 +68,10 @@ typedef void (*vhci_iter_cb)(vusb_dev_t* dev, void* ctx);
 /**
  * @brief Initialize Virtual Host controller.
  * @param handle, The handle to be initialized.
+ * @param allocator, Allocator for the devices of the Host controller, copied into the handle.
  * @return int, -1 on error and errno set, otherwise 0
  */
-int vhci_init(vhci_handle_t* handle);
+int vhci_init(vhci_handle_t* handle, const allocator_t* allocator);
 
 /**
  * @brief Register a device to the Host controller.
@@ -68,32 +114,114 @@ vusb_dev_t* vhci_find_device(vhci_handle_t* handle, const char* busid);
 vusb_dev_t* vhci_get_device(vhci_handle_t* handle, uint32_t busnum, uint32_t devnum);
 
 /**
- * @brief Handle any neccesary actions for this Host Controller once.
+ * @brief Get a device by its handle.
+ * @param handle, The Host controller to search in.
+ * @param dev_handle, The handle of the device, see vusb_dev_t::handle.
+ * @return vusb_dev_t*, Found device or NULL if the handle is stale.
+ */
+vusb_dev_t* vhci_get_device_by_handle(vhci_handle_t* handle, slot_handle_t dev_handle);
+
+/**
+ * @brief Find an endpoint in the active configuration and alternate settings of a device.
+ * @param dev, The device to search in.
+ * @param ep, The endpoint number.
+ * @param direction, PIPE_IN or PIPE_OUT.
+ * @return usb_ep_t*, Found endpoint or NULL if not found.
+ */
+usb_ep_t* vhci_find_ep(usb_dev_t* dev, uint8_t ep, uint8_t direction);
+
+/**
+ * @brief Handle any neccesary actions for this Host Controller once, pending URBs are retried and
+ * completed when their endpoint is ready.
  * @param handle, The Host controller to handle actions for.
  */
 void vhci_run_once(vhci_handle_t* handle);
 
 /**
- * @brief Submit a URB to the Host controller.
+ * @brief Allocate a URB for a device from the pool of the Host controller.
+ * @param handle, The Host controller to which the usb device is connected.
+ * @param dev, The device the URB will be submitted to.
+ * @param transfer_buffer_length, Size of the transfer buffer, buffers up to URB_INLINE_BUF_SIZE
+ * bytes are embedded in the URB, larger ones are taken from the size classes.
+ * @return urb_t*, The zeroed URB in URB_STATE_ALLOCATED, or NULL with errno set to ENOMEM.
+ */
+urb_t* vhci_urb_alloc(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length);
+
+/**
+ * @brief Allocate an IN URB whose data is left in a file by the to_host_file callback of its
+ * endpoint, no transfer buffer is allocated.
+ * @param handle, The Host controller to which the usb device is connected.
+ * @param dev, The device the URB will be submitted to.
+ * @param transfer_buffer_length, Maximum length of the transfer.
+ * @return urb_t*, The zeroed URB in URB_STATE_ALLOCATED, or NULL with errno set to ENOMEM.
+ */
+urb_t* vhci_urb_alloc_file(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length);
+
+/**
+ * @brief Allocate an OUT URB whose data is streamed to the endpoint as it arrives, the transfer
+ * buffer is a staging buffer of at most VHCI_URB_STREAM_CHUNK bytes.
+ * @param handle, The Host controller to which the usb device is connected.
+ * @param dev, The device the URB will be submitted to.
+ * @param transfer_buffer_length, Total length of the transfer.
+ * @return urb_t*, The zeroed URB in URB_STATE_ALLOCATED, or NULL with errno set to ENOMEM.
+ */
+urb_t* vhci_urb_alloc_stream(
+    vhci_handle_t* handle, vusb_dev_t* dev, uint32_t transfer_buffer_length);
+
+/**
+ * @brief Return a URB and its transfer buffer to the Host controller.
+ * @param handle, The Host controller the URB was allocated from.
+ * @param urb, The URB to free, must not be pending on a device, streamed URBs may be freed before
+ * all their data arrived.
+ */
+void vhci_urb_free(vhci_handle_t* handle, urb_t* urb);
+
+/**
+ * @brief Submit a URB to the Host controller, the Host controller owns it until its completion
+ * routine is called. The completion routine owns the URB and releases it with vhci_urb_free, it may
+ * be called before this function returns.
  * @param handle, The Host controller to submit the URB to.
- * @param urb, The URB to submit.
+ * @param urb, The URB to submit, in URB_STATE_ALLOCATED.
  * @return int, -1 on error and errno set, otherwise 0
  */
-int vhci_submit_urb(vhci_handle_t* handle, urb_t urb);
+int vhci_submit_urb(vhci_handle_t* handle, urb_t* urb);
 
 /**
- * @brief Unlink a URB from the Host controller.
+ * @brief Pass the next part of a submitted streamed URB to its endpoint, the URB completes once
+ * transfer_buffer_length bytes were passed.
+ * @param handle, The Host controller the URB was submitted to.
+ * @param urb, The streamed URB, the data is at the start of its staging buffer.
+ * @param length, Number of bytes in the staging buffer.
+ * @return int, -1 on error and errno set, the URB is not completed and still owned by the caller,
+ * otherwise 0
+ */
+int vhci_urb_stream(vhci_handle_t* handle, urb_t* urb, uint32_t length);
+
+/**
+ * @brief Unlink a pending URB from the Host controller, it is freed without being completed.
  * @param handle, The Host controller to unlink the URB from.
- * @param seq_num, The sequence number of the URB to unlink.
- * @return int, -1 on error and errno set, otherwise 0
+ * @param dev, The device the URB was submitted to.
+ * @param seq_num, The sequence number of the URB to unlink, only unique for one owner.
+ * @param owner, The owner of the URB, see urb_t::owner.
+ * @return int, -1 on error and errno set to ENOENT if no such URB is pending, otherwise 0
  */
-int vhci_unlink_urb(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t seq_num);
+int vhci_unlink_urb(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t seq_num, uint32_t owner);
 
 /**
- * @brief Initialize a URB for a device, allocates memory for the URB if necessary.
- * @param handle, The Host controller to which the usb device is connected.
- * @param dev, The device to initialize the URB for.
- * @param urb, The URB to initialize.
- * @return int, -1 on error and errno set, otherwise 0
+ * @brief Unlink all pending URBs of a submitter from a device, they are freed without being
+ * completed.
+ * @param handle, The Host controller to unlink the URBs from.
+ * @param dev, The device the URBs were submitted to.
+ * @param owner, The owner of the URBs, see urb_t::owner.
+ * @return size_t, Number of unlinked URBs.
+ */
+size_t vhci_unlink_owner(vhci_handle_t* handle, vusb_dev_t* dev, uint32_t owner);
+
+/**
+ * @brief Give up on a pending URB, it is removed from its device and completed with a status.
+ * @param handle, The Host controller the URB was submitted to.
+ * @param urb, The URB to cancel.
+ * @param status, The status to complete the URB with, e.g. -ETIMEDOUT.
+ * @return int, -1 on error and errno set to ENOENT if the URB is not pending, otherwise 0
  */
-int vhci_urb_init(vhci_handle_t* handle, vusb_dev_t* dev, urb_t* urb);
+int vhci_cancel_urb(vhci_handle_t* handle, urb_t* urb, int status);
@@ -1,117 +1,215 @@
 
-#include <arpa/inet.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/socket.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "conv.h"
 #include "queue.h"
+#include "transport.h"
 #include "usb/urb.h"
 #include "usbip.h"
 #include "usbip_types.h"
 
-#if !defined(USBIP_STATIC_CLIENT_POOL_SIZE) || !defined(USBIP_DEVICE_POOL_SIZE)
-#include <memory.h>
-#endif
-
-typedef struct imported_dev
+static uint64_t usbip_now_us(void)
 {
-    uint16_t busnum;
-    uint16_t devnum;
-    struct imported_dev* next;
-} imported_dev_t;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
 
-typedef struct usbip_client
+void client_stop(usbip_server_t* handle, usbip_client_t* client)
 {
-    int sock;
-    uint8_t data_stream[1024];
-    stream_fifo_t out_fifo;
-    imported_dev_t* imported_devs;
-} usbip_client_t;
+    transport_close(&handle->transport, client->conn);
+    wheel_timer_cancel(&client->idle_timer);
 
-#ifdef USBIP_IMPORTED_DEV_POOL_SIZE
-INIT_MEM_POOL(imported_dev_pool, imported_dev_t, USBIP_IMPORTED_DEV_POOL_SIZE);
-static inline void* imported_dev_alloc(size_t size) { return mem_pool_alloc(&imported_dev_pool); }
-static inline void imported_dev_free(void* dev) { mem_pool_free(&imported_dev_pool, dev); }
-#else
-static inline void* imported_dev_alloc(size_t size) { return malloc(size); }
-static inline void imported_dev_free(void* dev) { free(dev); }
-#endif
+    // Pending URB completions hold the client handle, removing it makes them stale.
+    slot_map_remove(&handle->clients, client->handle);
 
-#ifdef USBIP_CLIENT_POOL_SIZE
-INIT_MEM_POOL(client_pool, usbip_client_t, USBIP_CLIENT_POOL_SIZE);
-INIT_MEM_POOL(client_node_pool, node_t, USBIP_CLIENT_POOL_SIZE);
-static inline void* client_alloc() { return mem_pool_alloc(&client_pool); }
-static inline void client_free(void* client) { mem_pool_free(&client_pool, client); }
-static inline void* client_node_alloc(size_t size) { return mem_pool_alloc(&client_node_pool); }
-static inline void client_node_free(void* node) { mem_pool_free(&client_node_pool, node); }
-#else
-static inline void* client_alloc() { return malloc(sizeof(usbip_client_t)); }
-static inline void client_free(void* client) { free(client); }
-static inline void* client_node_alloc(size_t size) { return malloc(size); }
-static inline void client_node_free(void* node) { free(node); }
-#endif
+    // A URB still receiving its payload was never handed over to the Host controller.
+    if (client->rx_urb != NULL)
+    {
+        vhci_urb_free(handle->vhci_handle, client->rx_urb);
+    }
+
+    while (client->producers != NULL)
+    {
+        usbip_producer_t* producer = client->producers;
+        client->producers = producer->next;
+
+        if (producer->release != NULL)
+        {
+            producer->release(producer, handle);
+        }
+    }
+
+    // The socket is closed, the kernel no longer sends from this memory.
+    while (client->zerocopy_pending != NULL)
+    {
+        usbip_producer_t* producer = client->zerocopy_pending;
+        client->zerocopy_pending = producer->next;
+
+        if (producer->release != NULL)
+        {
+            producer->release(producer, handle);
+        }
+    }
+
+    while (client->imported_devs != NULL)
+    {
+        imported_dev_t* imported = client->imported_devs;
+        vusb_dev_t* dev = vhci_get_device_by_handle(handle->vhci_handle, imported->dev);
+
+        // Nobody waits for the URBs still pending on the device, they are freed right away.
+        if (dev != NULL)
+        {
+            vhci_unlink_owner(handle->vhci_handle, dev, client->handle);
+        }
+
+        client->imported_devs = imported->next;
+        allocator_free(&handle->allocator, imported, sizeof(imported_dev_t));
+    }
 
-INIT_LINKED_LIST(client_list, client_node_alloc, client_node_free);
+    allocator_free(&handle->allocator, client, sizeof(usbip_client_t));
+}
 
-void sock_stop(int sock)
+/**
+ * @brief Stop a client that did not send a request for idle_timeout_ms.
+ * @param timer, The idle timer of the client.
+ */
+static void usbip_client_idle(wheel_timer_t* timer)
 {
-    shutdown(sock, O_RDWR);
-    close(sock);
+    usbip_client_t* client = WHEEL_TIMER_ENTRY(timer, usbip_client_t, idle_timer);
+
+    // An imported device may go unused for long, dead peers are found by TCP keepalive instead.
+    if (client->imported_devs == NULL)
+    {
+        client_stop(timer->context, client);
+    }
 }
 
-void client_stop(usbip_server_t* handle, usbip_client_t* client, size_t i)
+/**
+ * @brief Restart the idle timeout of a client after it sent a request.
+ * @param handle, The server of the client.
+ * @param client, The client that sent a request.
+ */
+static void usbip_client_touch(usbip_server_t* handle, usbip_client_t* client)
 {
-    sock_stop(client->sock);
-    linked_list_rem(&client_list, i);
-    client_free(client);
+    if (handle->idle_timeout_ms == 0 || client->imported_devs != NULL)
+    {
+        wheel_timer_cancel(&client->idle_timer);
+        return;
+    }
+
+    timer_wheel_add(
+        &handle->timers, &client->idle_timer, handle->timers.now + handle->idle_timeout_ms);
 }
 
-int add_client(usbip_server_t* handle, int sock)
+/**
+ * @brief Add a connection of the transport as client.
+ * @param handle, The server to add the client to.
+ * @param conn, The connection of the client, owned by the server on success.
+ * @param addr, IPv4 address of the peer in network order, 0 for other peers.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+static int usbip_server_add_conn(usbip_server_t* handle, int conn, uint32_t addr)
 {
-    usbip_client_t* client = client_alloc();
+    usbip_client_t* client
+        = allocator_alloc(&handle->allocator, sizeof(usbip_client_t), _Alignof(usbip_client_t));
 
     if (client == NULL)
     {
+        errno = ENOMEM;
         return -1;
     }
 
-    client->sock = sock;
+    client->conn = conn;
+    client->imported_devs = NULL;
+    client->rx_urb = NULL;
+    client->rx_remaining = 0;
+    client->producers = NULL;
+    client->producers_tail = NULL;
+    client->pending_since = 0;
+    client->requests = 0;
+    client->zerocopy = false;
+    client->zerocopy_sends = 0;
+    client->zerocopy_pending = NULL;
+    client->zerocopy_pending_tail = NULL;
+    client->out_queued = 0;
+    client->urbs = 0;
+    client->throttled = false;
+    client->throttled_since = 0;
+    client->stats.throttle_count = 0;
+    client->stats.throttled_us = 0;
+    client->deficit = 0;
+    memset(&client->rate, 0, sizeof(client->rate));
+    client->addr = addr;
+    client->idle_timer = (wheel_timer_t) { .callback = usbip_client_idle, .context = handle };
+
+    // Zero copy is optional, connections that do not support it (e.g. AF_UNIX) copy as usual.
+    if (handle->zerocopy_min_bytes > 0 && handle->transport.zerocopy != NULL)
+    {
+        client->zerocopy = handle->transport.zerocopy(handle->transport.ctx, conn) == 0;
+    }
 
     if (stream_fifo_init(&client->out_fifo, client->data_stream, 1024) == -1)
     {
-        client_free(client);
+        allocator_free(&handle->allocator, client, sizeof(usbip_client_t));
         return -1;
     }
 
-    if (linked_list_push(&client_list, client) == -1)
+    client->handle = slot_map_insert(&handle->clients, client);
+
+    if (client->handle == SLOT_HANDLE_INVALID)
     {
-        client_free(client);
+        allocator_free(&handle->allocator, client, sizeof(usbip_client_t));
         return -1;
     }
 
+    usbip_client_touch(handle, client);
+
     return 0;
 }
 
-int usb_dev_to_buf(stream_fifo_t* fifo, vusb_dev_t* dev)
+int usbip_server_add_client(usbip_server_t* handle, int sock)
 {
-    if (stream_fifo_push(fifo, dev->dev->path, 256) == 0)
-    {
-        return -1;
-    }
+    return usbip_server_add_conn(handle, sock, 0);
+}
+
+// Largest reply written straight into the send buffer, requests wait until it fits.
+#define USBIP_MAX_DIRECT_REPLY (sizeof(hdr_common_t) + USB_DEV_RECORD_SIZE)
+
+size_t usb_dev_if_count(vusb_dev_t* dev)
+{
+    usb_conf_t* conf = usb_dev_get_config(dev->dev, dev->dev->cur_config);
+    size_t count = 0;
 
-    if (stream_fifo_push(fifo, dev->dev->busid, 32) == 0)
+    if (conf != NULL)
     {
-        return -1;
+        for (usb_if_group_t* cur = conf->interfaces; cur != NULL; cur = cur->next)
+        {
+            for (usb_if_t* cur_if = cur->interfaces; cur_if != NULL; cur_if = cur_if->next)
+            {
+                count++;
+            }
+        }
     }
 
-    uint8_t temp[32] = { 0 };
+    return count;
+}
 
-    uint8_t* buf = temp;
+uint8_t* usb_dev_to_buf(uint8_t* buf, vusb_dev_t* dev)
+{
+    memcpy(buf, dev->dev->path, 256);
+    buf += 256;
+    memcpy(buf, dev->dev->busid, 32);
+    buf += 32;
 
     buf = WRITE_BUF_NETWORK_ENDIAN_U32(buf, dev->dev->busnum) + sizeof(uint32_t);
     buf = WRITE_BUF_NETWORK_ENDIAN_U32(buf, dev->dev->devnum) + sizeof(uint32_t);
@@ -143,89 +241,306 @@ int usb_dev_to_buf(stream_fifo_t* fifo, vusb_dev_t* dev)
 
     buf += 1;
 
-    if (stream_fifo_push(fifo, temp, buf - temp) == 0)
-    {
-        return -1;
-    }
-
-    return 0;
+    return buf;
 }
 
-int usb_dev_if_to_buf(stream_fifo_t* fifo, vusb_dev_t* dev)
+size_t usb_dev_if_to_buf(uint8_t* buf, vusb_dev_t* dev, size_t first, size_t max)
 {
-
     usb_conf_t* conf = usb_dev_get_config(dev->dev, dev->dev->cur_config);
+    size_t index = 0;
+    size_t written = 0;
 
     if (conf != NULL)
     {
-        usb_if_group_t* cur = conf->interfaces;
-
-        while (cur != NULL)
+        for (usb_if_group_t* cur = conf->interfaces; cur != NULL; cur = cur->next)
         {
-            usb_if_t* cur_if = cur->interfaces;
-            while (cur_if != NULL)
+            for (usb_if_t* cur_if = cur->interfaces; cur_if != NULL && written < max;
+                 cur_if = cur_if->next)
             {
-                uint8_t temp[] = { cur_if->desc.bInterfaceClass, cur_if->desc.bInterfaceSubClass,
-                    cur_if->desc.bInterfaceProtocol, 0 };
-
-                if (stream_fifo_push(fifo, temp, sizeof(temp)) == 0)
+                if (index++ < first)
                 {
-                    return -1;
+                    continue;
                 }
 
-                cur_if = cur_if->next;
+                buf[0] = cur_if->desc.bInterfaceClass;
+                buf[1] = cur_if->desc.bInterfaceSubClass;
+                buf[2] = cur_if->desc.bInterfaceProtocol;
+                buf[3] = 0;
+                buf += USB_IF_RECORD_SIZE;
+                written++;
             }
-            cur = cur->next;
         }
     }
 
-    return 0;
+    return written;
 }
 
-void fill_devlist(vusb_dev_t* dev, void* ctx)
+void usbip_client_queue(usbip_client_t* client, usbip_producer_t* producer)
 {
-    stream_fifo_t* fifo = (*(void**)ctx);
-    int err = usb_dev_to_buf(fifo, dev);
+    client->out_queued += producer->length;
 
-    if (err == -1)
+    if (client->producers == NULL)
     {
+        producer->next = NULL;
+        client->producers = producer;
+        client->producers_tail = producer;
         return;
     }
 
-    err = usb_dev_if_to_buf(fifo, dev);
+    // Replies are only split at message boundaries, the first one is finished before any other.
+    usbip_producer_t* prev = client->producers;
 
-    if (err == -1)
+    if (client->producers_tail->out_class > producer->out_class)
     {
-        return;
+        while (prev->next != NULL && prev->next->out_class <= producer->out_class)
+        {
+            prev = prev->next;
+        }
+    }
+    else
+    {
+        prev = client->producers_tail;
+    }
+
+    producer->next = prev->next;
+    prev->next = producer;
+
+    if (producer->next == NULL)
+    {
+        client->producers_tail = producer;
+    }
+}
+
+/**
+ * @brief Get the output class of the reply to a URB from its transfer type.
+ */
+static usbip_out_class_t usbip_urb_out_class(const urb_t* urb)
+{
+    switch (PIPE_TYPE_GET(urb->pipe))
+    {
+    case PIPE_TYPE_CTRL:
+        return USBIP_OUT_CONTROL;
+    case PIPE_TYPE_INTR:
+    case PIPE_TYPE_ISO:
+        return USBIP_OUT_PERIODIC;
+    default:
+        return USBIP_OUT_BULK;
+    }
+}
+
+/**
+ * @brief Account for bytes of a queued reply that were produced or sent directly.
+ * @param client, The client the reply is queued on.
+ * @param producer, The producer of the reply.
+ * @param bytes, Number of bytes, more than are left is clamped.
+ */
+static void usbip_client_account(usbip_client_t* client, usbip_producer_t* producer, size_t bytes)
+{
+    // Producers may end up shorter than announced, e.g. when devices are removed.
+    if (bytes > producer->length)
+    {
+        bytes = producer->length;
+    }
+
+    producer->length -= bytes;
+    client->out_queued -= bytes;
+}
+
+/**
+ * @brief Free a URB allocated for a client, it no longer counts for its owner.
+ * @param handle, The server of the client.
+ * @param urb, The URB to free.
+ */
+static void usbip_urb_free(usbip_server_t* handle, urb_t* urb)
+{
+    usbip_client_t* client = slot_map_get(&handle->clients, urb->owner);
+
+    // Stopped clients no longer count their URBs.
+    if (client != NULL)
+    {
+        client->urbs--;
+    }
+
+    vhci_urb_free(handle->vhci_handle, urb);
+}
+
+/**
+ * @brief Let the queued replies of a client fill its send buffer.
+ * @param handle, The server of the client.
+ * @param client, The client whose replies are produced.
+ */
+static void usbip_client_produce(usbip_server_t* handle, usbip_client_t* client)
+{
+    while (client->producers != NULL)
+    {
+        size_t space;
+        uint8_t* buf = stream_fifo_reserve(&client->out_fifo, &space);
+
+        if (space == 0)
+        {
+            return;
+        }
+
+        usbip_producer_t* producer = client->producers;
+        size_t bytes = producer->produce(producer, buf, space);
+
+        stream_fifo_commit(&client->out_fifo, bytes);
+        usbip_client_account(client, producer, bytes);
+
+        if (bytes == 0)
+        {
+            // The rest is sent from the memory of the producer once the FIFO is empty.
+            if (producer->direct_len > 0)
+            {
+                return;
+            }
+
+            client->producers = producer->next;
+            usbip_client_account(client, producer, producer->length);
+
+            if (producer->release != NULL)
+            {
+                producer->release(producer, handle);
+            }
+        }
+    }
+}
+
+// Stage the next part of the devlist reply, returns 0 once all devices are written.
+static int devlist_stage_next(usbip_devlist_producer_t* devlist)
+{
+    slot_map_t* devices = &devlist->vhci_handle->devices;
+
+    if (devlist->if_next < devlist->if_count)
+    {
+        vusb_dev_t* dev = vhci_get_device_by_handle(devlist->vhci_handle, devlist->dev);
+        size_t count = devlist->if_count - devlist->if_next;
+        size_t written = 0;
+
+        if (count > sizeof(devlist->stage) / USB_IF_RECORD_SIZE)
+        {
+            count = sizeof(devlist->stage) / USB_IF_RECORD_SIZE;
+        }
+
+        if (dev != NULL)
+        {
+            written = usb_dev_if_to_buf(devlist->stage, dev, devlist->if_next, count);
+        }
+
+        // The device changed since its record was written, keep the announced size.
+        memset(devlist->stage + written * USB_IF_RECORD_SIZE, 0,
+            (count - written) * USB_IF_RECORD_SIZE);
+
+        devlist->if_next += count;
+        devlist->stage_len = count * USB_IF_RECORD_SIZE;
+    }
+    else if (devlist->devs_left > 0)
+    {
+        devlist->devs_left--;
+
+        // Same order as SLOT_MAP_FOREACH, a device removed since the header was written leaves an
+        // empty record.
+        vusb_dev_t* dev = (devlist->devs_left < devices->size)
+            ? slot_map_at(devices, devlist->devs_left)
+            : NULL;
+
+        if (dev != NULL)
+        {
+            usb_dev_to_buf(devlist->stage, dev);
+            devlist->dev = dev->handle;
+            devlist->if_count = usb_dev_if_count(dev);
+        }
+        else
+        {
+            memset(devlist->stage, 0, USB_DEV_RECORD_SIZE);
+            devlist->if_count = 0;
+        }
+
+        devlist->if_next = 0;
+        devlist->stage_len = USB_DEV_RECORD_SIZE;
+    }
+    else
+    {
+        return 0;
+    }
+
+    devlist->stage_off = 0;
+
+    return 1;
+}
+
+static size_t produce_devlist(usbip_producer_t* producer, uint8_t* buf, size_t len)
+{
+    usbip_devlist_producer_t* devlist = (usbip_devlist_producer_t*)producer;
+    size_t written = 0;
+
+    while (written < len)
+    {
+        if (devlist->stage_off == devlist->stage_len && !devlist_stage_next(devlist))
+        {
+            break;
+        }
+
+        size_t count = devlist->stage_len - devlist->stage_off;
+
+        if (count > len - written)
+        {
+            count = len - written;
+        }
+
+        memcpy(buf + written, devlist->stage + devlist->stage_off, count);
+        devlist->stage_off += count;
+        written += count;
     }
+
+    return written;
 }
 
-int usbip_resp_devlist(usbip_server_t* handle, usbip_client_t* client, size_t i)
+int usbip_resp_devlist(usbip_server_t* handle, usbip_client_t* client)
 {
+    usbip_devlist_producer_t* devlist = &client->devlist;
+
     hdr_rep_devlist_t reply = { .hdr = { .op_code = TO_NETWORK_ENDIAN_U16(REP_DEVLIST),
                                     .version = TO_NETWORK_ENDIAN_U16(USBIP_VERSION),
                                     .status = TO_NETWORK_ENDIAN_U32(USBIP_STATUS_OK) },
         .dev_count = TO_NETWORK_ENDIAN_U32(handle->vhci_handle->devices.size) };
 
-    if (stream_fifo_push(&client->out_fifo, &reply, sizeof(hdr_rep_devlist_t)) == 0)
+    // Only the header is staged, the devices follow as the reply is sent.
+    devlist->producer.produce = produce_devlist;
+    devlist->producer.release = NULL;
+    devlist->producer.direct = NULL;
+    devlist->producer.direct_fd = -1;
+    devlist->producer.length = sizeof(hdr_rep_devlist_t);
+    devlist->producer.out_class = USBIP_OUT_BULK;
+    devlist->producer.direct_len = 0;
+    devlist->vhci_handle = handle->vhci_handle;
+    devlist->devs_left = handle->vhci_handle->devices.size;
+    devlist->if_next = 0;
+    devlist->if_count = 0;
+    devlist->stage_off = 0;
+    devlist->stage_len = sizeof(hdr_rep_devlist_t);
+    memcpy(devlist->stage, &reply, sizeof(hdr_rep_devlist_t));
+
+    size_t i;
+
+    SLOT_MAP_FOREACH(&handle->vhci_handle->devices, i)
     {
-        client_stop(handle, client, i);
-        return -1;
-    }
+        vusb_dev_t* dev = slot_map_at(&handle->vhci_handle->devices, i);
 
-    if (handle->vhci_handle->devices.size > 0)
-    {
-        vhci_iter_devices(handle->vhci_handle, fill_devlist, &client->out_fifo);
+        devlist->producer.length
+            += USB_DEV_RECORD_SIZE + usb_dev_if_count(dev) * USB_IF_RECORD_SIZE;
     }
 
+    usbip_client_queue(client, &devlist->producer);
+
     return 0;
 }
 
-int usbip_handle_import(usbip_server_t* handle, usbip_client_t* client, size_t i)
+int usbip_handle_import(usbip_server_t* handle, usbip_client_t* client)
 {
     char busid[32] = { 0 };
 
-    int bytes = recv(client->sock, busid, 32, 0);
+    int bytes = transport_recv(&handle->transport, client->conn, busid, 32, 0);
 
     hdr_common_t hdr = { 0 };
 
@@ -233,8 +548,6 @@ int usbip_handle_import(usbip_server_t* handle, usbip_client_t* client, size_t i
     hdr.op_code = TO_NETWORK_ENDIAN_U16(REP_IMPORT);
     hdr.status = TO_NETWORK_ENDIAN_U32(USBIP_STATUS_ERROR);
 
-    int length = 8;
-
     if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
     {
         // No data yet
@@ -242,158 +555,292 @@ int usbip_handle_import(usbip_server_t* handle, usbip_client_t* client, size_t i
     }
     else if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
     {
-        client_stop(handle, client, i);
+        client_stop(handle, client);
         return -1;
     }
     else if (bytes > 0)
     {
         vusb_dev_t* dev = vhci_find_device(handle->vhci_handle, busid);
+        imported_dev_t* imported = NULL;
 
         if (dev != NULL)
         {
+            imported = allocator_alloc(
+                &handle->allocator, sizeof(imported_dev_t), _Alignof(imported_dev_t));
+        }
+
+        if (imported != NULL)
+        {
+            imported->busnum = dev->dev->busnum;
+            imported->devnum = dev->dev->devnum;
+            imported->dev = dev->handle;
+            imported->next = client->imported_devs;
+            client->imported_devs = imported;
+
             hdr.status = TO_NETWORK_ENDIAN_U32(USBIP_STATUS_OK);
 
-            if (stream_fifo_push(&client->out_fifo, &hdr, sizeof(hdr)) == 0)
+            uint8_t* buf
+                = arena_alloc(&handle->scratch, sizeof(hdr) + USB_DEV_RECORD_SIZE, sizeof(uint32_t));
+
+            if (buf == NULL)
             {
-                client_stop(handle, client, i);
+                client_stop(handle, client);
                 return -1;
             }
 
-            int err = usb_dev_to_buf(&client->out_fifo, dev);
+            memcpy(buf, &hdr, sizeof(hdr));
+            usb_dev_to_buf(buf + sizeof(hdr), dev);
 
-            if (err == -1)
+            if (stream_fifo_push(&client->out_fifo, buf, sizeof(hdr) + USB_DEV_RECORD_SIZE) < 0)
             {
-                client_stop(handle, client, i);
+                client_stop(handle, client);
                 return -1;
             }
         }
+        // Unknown device or the import could not be recorded, reject it.
+        else if (stream_fifo_push(&client->out_fifo, &hdr, sizeof(hdr)) < 0)
+        {
+            client_stop(handle, client);
+            return -1;
+        }
     }
 
     return 0;
 }
 
-int usbip_accept_new_client(usbip_server_t* handle)
+/**
+ * @brief Keep a connection that could not be accepted as client, so its request is answered with
+ * USBIP_STATUS_ERROR instead of a reset. The connection is closed if too many are waiting.
+ * @param handle, The server that accepted the connection.
+ * @param conn, The connection.
+ */
+static void usbip_reject_client(usbip_server_t* handle, int conn)
 {
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(struct sockaddr_in);
+    if (handle->reject_count == USBIP_MAX_REJECTS)
+    {
+        transport_close(&handle->transport, conn);
+        return;
+    }
 
-    // Check for a new connection
-    int client_sock = accept(handle->listen_sock, (struct sockaddr*)&client_addr, &client_len);
+    usbip_reject_t* reject = &handle->rejects[handle->reject_count++];
+
+    reject->conn = conn;
+    reject->deadline_us = usbip_now_us() + USBIP_REJECT_TIMEOUT_US;
+}
+
+/**
+ * @brief Answer the requests of rejected connections and close them.
+ * @param handle, The server of the rejected connections.
+ */
+static void usbip_handle_rejects(usbip_server_t* handle)
+{
+    uint64_t now = usbip_now_us();
+    size_t i = handle->reject_count;
 
-    // Handle a new connection
-    if (client_sock != -1)
+    while (i-- > 0)
     {
-        // Get flags for new client.
-        int flags = fcntl(client_sock, F_GETFL);
+        usbip_reject_t* reject = &handle->rejects[i];
+        hdr_common_t hdr;
 
-        // Unable to get flags
-        if (flags < 0)
+        // Wait for the request until the deadline.
+        if (!(transport_poll(&handle->transport, reject->conn, POLLIN) & POLLIN)
+            && now < reject->deadline_us)
         {
-            sock_stop(client_sock);
-            return -1;
+            continue;
         }
 
-        // Set non blocking on new client.
-        if (fcntl(client_sock, F_SETFL, flags | O_NONBLOCK | O_CLOEXEC) < 0)
+        ssize_t bytes = transport_recv(&handle->transport, reject->conn, &hdr, sizeof(hdr), 0);
+
+        // The reply has the op code of the request, so the client reports an error for it.
+        if (bytes == sizeof(hdr))
         {
-            sock_stop(client_sock);
-            return -1;
+            hdr.op_code
+                = TO_NETWORK_ENDIAN_U16(FROM_NETWORK_ENDIAN_U16(hdr.op_code) & ~OP_REQUEST);
+            hdr.status = TO_NETWORK_ENDIAN_U32(USBIP_STATUS_ERROR);
+            struct iovec iov = { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+            transport_writev(&handle->transport, reject->conn, &iov, 1, 0);
         }
 
-        int no_delay = 1;
-        int keepalive_interval = 10;
-        int keepalive_cnt = 10;
+        transport_close(&handle->transport, reject->conn);
+        *reject = handle->rejects[--handle->reject_count];
+    }
+}
 
-        // Set no delay on client.
-        if (setsockopt(client_sock, SOL_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay)))
-        {
-            sock_stop(client_sock);
-            return -1;
-        }
+/**
+ * @brief Count the clients connected from an address.
+ */
+static size_t usbip_clients_from(usbip_server_t* handle, uint32_t addr)
+{
+    size_t count = 0;
+    size_t i;
+
+    SLOT_MAP_FOREACH(&handle->clients, i)
+    {
+        count += ((usbip_client_t*)slot_map_at(&handle->clients, i))->addr == addr;
+    }
+
+    return count;
+}
+
+int usbip_accept_new_client(usbip_server_t* handle)
+{
+    // Reconnecting hosts are taken from the backlog together, up to a limit per iteration.
+    for (size_t n = 0; n < handle->accepts_per_iteration; ++n)
+    {
+        uint32_t addr = 0;
+        int conn = transport_accept(&handle->transport, &addr);
 
-        // Setup keepalive packets for client.
-        if (setsockopt(client_sock, SOL_SOCKET, TCP_KEEPINTVL, &keepalive_interval,
-                sizeof(keepalive_interval)))
+        if (conn == -1)
         {
-            sock_stop(client_sock);
+            // The connection was reset while waiting, try the next one.
+            if (errno == ECONNABORTED || errno == EINTR)
+            {
+                continue;
+            }
+
+            // Backlog drained, or out of descriptors or memory for now.
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE || errno == ENFILE
+                || errno == ENOBUFS || errno == ENOMEM)
+            {
+                return 0;
+            }
+
+            // The transport stopped accepting.
             return -1;
         }
 
-        // Set keepalive count
-        if (setsockopt(client_sock, SOL_SOCKET, TCP_KEEPCNT, &keepalive_cnt, sizeof(keepalive_cnt)))
+        if (addr != 0 && usbip_clients_from(handle, addr) >= handle->max_clients_per_addr)
         {
-            sock_stop(client_sock);
-            return -1;
+            usbip_reject_client(handle, conn);
+            continue;
         }
 
         // Add client to list of current clients (may fail if no more clients can be accepted).
-        if (add_client(handle, client_sock))
+        if (usbip_server_add_conn(handle, conn, addr))
         {
-            sock_stop(client_sock);
-            return -1;
+            usbip_reject_client(handle, conn);
         }
     }
-    // Acceptor socket failed in some way, stop this socket.
-    else if (client_sock == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
-    {
-        sock_stop(handle->listen_sock);
-        return -1;
-    }
 
     return 0;
 }
 
-int usbip_server_setup(usbip_server_t* handle, vhci_handle_t* usb_handle)
+int usbip_server_init(
+    usbip_server_t* handle, vhci_handle_t* usb_handle, const allocator_t* allocator)
 {
+    if (handle == NULL || usb_handle == NULL || allocator == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
     memset(handle, 0, sizeof(usbip_server_t));
 
     handle->vhci_handle = usb_handle;
+    handle->allocator = *allocator;
+    sock_transport_init(&handle->transport, &handle->sock_transport);
+    handle->listen_backlog = USBIP_LISTEN_BACKLOG;
+    handle->accepts_per_iteration = USBIP_ACCEPTS_PER_ITERATION;
+    handle->max_clients_per_addr = USBIP_MAX_CLIENTS_PER_ADDR;
+    handle->flush_min_bytes = USBIP_FLUSH_MIN_BYTES;
+    handle->flush_max_delay_us = USBIP_FLUSH_MAX_DELAY_US;
+    handle->zerocopy_min_bytes = USBIP_ZEROCOPY_MIN_BYTES;
+    handle->out_high_watermark = USBIP_OUT_HIGH_WATERMARK;
+    handle->out_low_watermark = USBIP_OUT_LOW_WATERMARK;
+    handle->urb_high_watermark = USBIP_URB_HIGH_WATERMARK;
+    handle->urb_low_watermark = USBIP_URB_LOW_WATERMARK;
+    handle->drr_quantum = USBIP_DRR_QUANTUM;
+    handle->idle_timeout_ms = USBIP_IDLE_TIMEOUT_MS;
+    handle->urb_timeout_ms = USBIP_URB_TIMEOUT_MS;
+
+    if (timer_wheel_init(&handle->timers, usbip_now_us() / 1000))
+    {
+        return -1;
+    }
 
-    handle->listen_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
-
-    if (handle->listen_sock == -1)
+    if (init_mem_pool(sizeof(usbip_urb_reply_t), handle->urb_reply_mem,
+            sizeof(handle->urb_reply_mem), &handle->urb_replies))
     {
         return -1;
     }
 
-    struct sockaddr_in addr;
+    if (init_arena(&handle->scratch, handle->scratch_mem, USBIP_SCRATCH_SIZE))
+    {
+        return -1;
+    }
 
-    memset(&addr, 0, sizeof(struct sockaddr_in));
+    if (slot_map_init(&handle->clients, handle->client_slots, USBIP_MAX_CLIENTS))
+    {
+        return -1;
+    }
 
-    addr.sin_port = TO_NETWORK_ENDIAN_U16(3240);
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = 0;
+    return 0;
+}
 
-    if (bind(handle->listen_sock, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) == -1)
+int usbip_server_listen(usbip_server_t* handle, uint16_t port)
+{
+    // Clients already served by sockets keep their connections.
+    if (handle->transport.ctx != &handle->sock_transport
+        && usbip_server_set_transport(handle, NULL))
     {
-        printf("bind failed %s", strerror(errno));
-        sock_stop(handle->listen_sock);
         return -1;
     }
 
-    int flags = fcntl(handle->listen_sock, F_GETFL);
+    return sock_transport_listen_tcp(&handle->sock_transport, port, handle->listen_backlog);
+}
 
-    if (flags < 0)
+int usbip_server_listen_unix(usbip_server_t* handle, const char* path)
+{
+    // Clients already served by sockets keep their connections.
+    if (handle->transport.ctx != &handle->sock_transport
+        && usbip_server_set_transport(handle, NULL))
     {
-        sock_stop(handle->listen_sock);
         return -1;
     }
 
-    if (fcntl(handle->listen_sock, F_SETFL, flags | O_NONBLOCK))
+    return sock_transport_listen_unix(&handle->sock_transport, path, handle->listen_backlog);
+}
+
+int usbip_server_set_transport(usbip_server_t* handle, const transport_t* transport)
+{
+    // Connections of clients and rejects belong to the current transport.
+    if (handle->clients.size > 0 || handle->reject_count > 0)
     {
-        sock_stop(handle->listen_sock);
+        errno = EBUSY;
         return -1;
     }
 
-    if (listen(handle->listen_sock, 1))
+    if (transport == NULL && handle->transport.ctx == &handle->sock_transport)
     {
-        sock_stop(handle->listen_sock);
-        return -1;
+        return 0;
+    }
+
+    // The listening socket is only used by the socket transport that is replaced.
+    sock_transport_stop(&handle->sock_transport);
+
+    if (transport != NULL)
+    {
+        handle->transport = *transport;
+    }
+    else
+    {
+        sock_transport_init(&handle->transport, &handle->sock_transport);
     }
 
     return 0;
 }
 
+int usbip_server_setup(
+    usbip_server_t* handle, vhci_handle_t* usb_handle, const allocator_t* allocator)
+{
+    if (usbip_server_init(handle, usb_handle, allocator))
+    {
+        return -1;
+    }
+
+    return usbip_server_listen(handle, USBIP_PORT);
+}
+
 void write_cmd_response_header(usbip_client_t* client, hdr_cmd_t cmd)
 {
     uint8_t buf[sizeof(hdr_cmd_t)] = { 0 };
@@ -404,34 +851,129 @@ void write_cmd_response_header(usbip_client_t* client, hdr_cmd_t cmd)
     stream_fifo_push(&client->out_fifo, buf, sizeof(hdr_cmd_t));
 }
 
-void urb_complete_cb(struct urb* urb, void* context)
+static size_t produce_urb_reply(usbip_producer_t* producer, uint8_t* buf, size_t len)
 {
-    uint8_t buf[48] = { 0 };
-    uint8_t* buf_ptr = buf;
-    usbip_client_t* client = context;
+    usbip_urb_reply_t* reply = (usbip_urb_reply_t*)producer;
+    urb_t* urb = reply->urb;
+    size_t length = sizeof(hdr_cmd_t);
+    size_t written = 0;
 
-    hdr_cmd_t hdr = {
-        .command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT),
-        .seq_num = TO_NETWORK_ENDIAN_U32(urb->seq_num),
-        .busnum = 0,
-        .devnum = 0,
-        .direction = 0,
-        .endpoint = 0,
-    };
+    // Data sent with MSG_ZEROCOPY or from a file is not part of what is produced.
+    if (PIPE_DIR(urb->pipe) == PIPE_IN && producer->direct == NULL && producer->direct_fd == -1)
+    {
+        length += urb->actual_length;
+    }
 
-    cmd_t* cmd = (cmd_t*)(&hdr.padding);
-    cmd->status = TO_NETWORK_ENDIAN_U32(urb->status);
-    cmd->start_frame = TO_NETWORK_ENDIAN_U32(urb->start_frame);
-    cmd->number_of_packets = TO_NETWORK_ENDIAN_U32(urb->number_of_packets);
-    cmd->error_count = TO_NETWORK_ENDIAN_U32(urb->error_count);
-    cmd->length = TO_NETWORK_ENDIAN_U32(urb->actual_length);
+    if (len > length - reply->offset)
+    {
+        len = length - reply->offset;
+    }
 
-    write_cmd_response_header(client, hdr);
+    if (reply->offset < sizeof(hdr_cmd_t) && len > 0)
+    {
+        hdr_cmd_t hdr = { 0 };
+
+        hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT);
+        hdr.seq_num = TO_NETWORK_ENDIAN_U32(urb->seq_num);
+
+        cmd_t* cmd = (cmd_t*)(&hdr.padding);
+        cmd->status = TO_NETWORK_ENDIAN_U32(urb->status);
+        cmd->start_frame = TO_NETWORK_ENDIAN_U32(urb->start_frame);
+        cmd->number_of_packets = TO_NETWORK_ENDIAN_U32(urb->number_of_packets);
+        cmd->error_count = TO_NETWORK_ENDIAN_U32(urb->error_count);
+        cmd->length = TO_NETWORK_ENDIAN_U32(urb->actual_length);
+
+        written = sizeof(hdr_cmd_t) - reply->offset;
+
+        if (written > len)
+        {
+            written = len;
+        }
+
+        memcpy(buf, (uint8_t*)&hdr + reply->offset, written);
+    }
+
+    // IN data is sent from the transfer buffer of the URB, without an intermediate copy.
+    if (written < len)
+    {
+        memcpy(buf + written,
+            (uint8_t*)urb->transfer_buffer + reply->offset + written - sizeof(hdr_cmd_t),
+            len - written);
+    }
+
+    reply->offset += len;
+
+    if (len == 0)
+    {
+        urb->state = URB_STATE_SENT;
+    }
+
+    return len;
+}
+
+static void release_urb_reply(usbip_producer_t* producer, usbip_server_t* handle)
+{
+    usbip_urb_reply_t* reply = (usbip_urb_reply_t*)producer;
+
+    usbip_urb_free(handle, reply->urb);
+    mem_pool_free(&handle->urb_replies, reply);
+}
+
+void urb_complete_cb(struct urb* urb, void* context)
+{
+    usbip_server_t* handle = context;
+    usbip_client_t* client = slot_map_get(&handle->clients, urb->owner);
+
+    wheel_timer_cancel(&urb->timer);
+
+    // The client was stopped while this URB was in flight, drop the completion.
+    if (client == NULL)
+    {
+        vhci_urb_free(handle->vhci_handle, urb);
+        return;
+    }
+
+    // Sized for every URB, only fails if the configuration is inconsistent.
+    usbip_urb_reply_t* reply = mem_pool_alloc(&handle->urb_replies);
+
+    if (reply == NULL)
+    {
+        usbip_urb_free(handle, urb);
+        return;
+    }
+
+    // The URB stays alive until its reply is sent.
+    reply->producer.produce = produce_urb_reply;
+    reply->producer.release = release_urb_reply;
+    reply->producer.direct = NULL;
+    reply->producer.direct_fd = -1;
+    reply->producer.direct_len = 0;
+    reply->producer.length = sizeof(hdr_cmd_t);
+    reply->producer.out_class = usbip_urb_out_class(urb);
+    reply->urb = urb;
+    reply->offset = 0;
+
+    // IN data left in a file by the endpoint is sent from there, large IN data in the URB is
+    // left there for the kernel to send from.
+    if ((urb->transfer_flags & URB_FILE_REGION) && urb->actual_length > 0)
+    {
+        reply->producer.direct_fd = urb->file_region.fd;
+        reply->producer.direct_offset = urb->file_region.offset;
+        reply->producer.direct_len = urb->actual_length;
+    }
+    else if (client->zerocopy && PIPE_DIR(urb->pipe) == PIPE_IN
+        && urb->actual_length >= handle->zerocopy_min_bytes)
+    {
+        reply->producer.direct = urb->transfer_buffer;
+        reply->producer.direct_len = urb->actual_length;
+    }
 
     if (PIPE_DIR(urb->pipe) == PIPE_IN)
     {
-        stream_fifo_push(&client->out_fifo, urb->transfer_buffer, urb->actual_length);
+        reply->producer.length += urb->actual_length;
     }
+
+    usbip_client_queue(client, &reply->producer);
 }
 
 vusb_dev_t* get_client_dev(usbip_server_t* handle, usbip_client_t* client, hdr_cmd_t hdr)
@@ -448,38 +990,139 @@ vusb_dev_t* get_client_dev(usbip_server_t* handle, usbip_client_t* client, hdr_c
         imported = (imported != NULL) ? imported->next : NULL;
     } while (imported != NULL);
 
-    cmd_t* cmd = (cmd_t*)(&hdr.padding);
-
-    // Device not imported
+    // Device not imported, the caller replies.
     if (imported == NULL)
     {
-        hdr.command = TO_NETWORK_ENDIAN_U32(
-            (hdr.command == USBIP_CMD_SUBMIT) ? USBIP_RET_SUBMIT : USBIP_RET_UNLINK);
-        hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
-        cmd->status = TO_NETWORK_ENDIAN_U32(-EINVAL);
-        write_cmd_response_header(client, hdr);
         return NULL;
     }
 
-    return vhci_get_device(handle->vhci_handle, hdr.busnum, hdr.devnum);
+    return vhci_get_device_by_handle(handle->vhci_handle, imported->dev);
 }
 
-int handle_urb_submit(usbip_server_t* handle, usbip_client_t* client, size_t i, hdr_cmd_t hdr)
+static void write_submit_error(usbip_client_t* client, uint32_t seq_num, int status)
 {
-    vusb_dev_t* dev = get_client_dev(handle, client, hdr);
-
+    hdr_cmd_t hdr = { 0 };
     cmd_t* cmd = (cmd_t*)(&hdr.padding);
 
-    // Device not found
-    if (dev == NULL)
+    hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT);
+    hdr.seq_num = TO_NETWORK_ENDIAN_U32(seq_num);
+    cmd->status = TO_NETWORK_ENDIAN_U32(status);
+    write_cmd_response_header(client, hdr);
+}
+
+/**
+ * @brief Complete a URB that stayed pending for urb_timeout_ms with -ETIMEDOUT.
+ * @param timer, The timer of the URB.
+ */
+static void usbip_urb_timeout(wheel_timer_t* timer)
+{
+    usbip_server_t* handle = timer->context;
+
+    vhci_cancel_urb(handle->vhci_handle, WHEEL_TIMER_ENTRY(timer, urb_t, timer), -ETIMEDOUT);
+}
+
+static int submit_urb(usbip_server_t* handle, usbip_client_t* client, urb_t* urb)
+{
+    uint32_t seq_num = urb->seq_num;
+
+    // Streamed URBs are pending on the client until their payload arrived.
+    if (handle->urb_timeout_ms > 0 && !(urb->transfer_flags & URB_INTERNAL_PARTIAL_URB))
     {
-        hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT);
-        hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
-        cmd->status = TO_NETWORK_ENDIAN_U32(-ENODEV);
-        write_cmd_response_header(client, hdr);
-        return 0;
+        urb->timer = (wheel_timer_t) { .callback = usbip_urb_timeout, .context = handle };
+        timer_wheel_add(&handle->timers, &urb->timer, handle->timers.now + handle->urb_timeout_ms);
     }
 
+    // The URB belongs to the Host controller now, it may already be completed and freed.
+    if (vhci_submit_urb(handle->vhci_handle, urb) == -1)
+    {
+        write_submit_error(client, seq_num, -errno);
+        usbip_urb_free(handle, urb);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Receive the OUT payload of the current CMD_SUBMIT, as far as it is available. Streamed
+ * URBs pass every part on to the device as it arrives, other URBs are submitted once complete.
+ * @return int, -1 if the client was stopped, otherwise 0
+ */
+static int usbip_client_recv_payload(usbip_server_t* handle, usbip_client_t* client)
+{
+    uint8_t discard[256];
+
+    while (client->rx_remaining > 0)
+    {
+        urb_t* urb = client->rx_urb;
+        uint8_t* dest = discard;
+        size_t length = (client->rx_remaining < sizeof(discard)) ? client->rx_remaining
+                                                                 : sizeof(discard);
+
+        if (urb != NULL && (urb->transfer_flags & URB_INTERNAL_PARTIAL_URB))
+        {
+            dest = urb->transfer_buffer;
+            length = (client->rx_remaining < VHCI_URB_STREAM_CHUNK) ? client->rx_remaining
+                                                                    : VHCI_URB_STREAM_CHUNK;
+        }
+        else if (urb != NULL)
+        {
+            dest = (uint8_t*)urb->transfer_buffer + urb->actual_length;
+            length = client->rx_remaining;
+        }
+
+        ssize_t bytes = transport_recv(&handle->transport, client->conn, dest, length, 0);
+
+        if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            client_stop(handle, client);
+            return -1;
+        }
+        else if (bytes <= 0)
+        {
+            return 0;
+        }
+
+        client->rx_remaining -= bytes;
+
+        if (urb == NULL)
+        {
+            continue;
+        }
+
+        if (!(urb->transfer_flags & URB_INTERNAL_PARTIAL_URB))
+        {
+            urb->actual_length += bytes;
+        }
+        else if (vhci_urb_stream(handle->vhci_handle, urb, bytes) == -1)
+        {
+            // The rest of the payload is dropped.
+            write_submit_error(client, urb->seq_num, -errno);
+            usbip_urb_free(handle, urb);
+            client->rx_urb = NULL;
+        }
+        else if (client->rx_remaining == 0)
+        {
+            // The last part completed the URB.
+            client->rx_urb = NULL;
+        }
+    }
+
+    if (client->rx_urb != NULL)
+    {
+        urb_t* urb = client->rx_urb;
+
+        client->rx_urb = NULL;
+        submit_urb(handle, client, urb);
+    }
+
+    return 0;
+}
+
+int handle_urb_submit(usbip_server_t* handle, usbip_client_t* client, hdr_cmd_t hdr)
+{
+    cmd_t* cmd = (cmd_t*)(&hdr.padding);
+
     // Parse the intial URB submit header
     cmd->txfer_flags = FROM_NETWORK_ENDIAN_U32(cmd->txfer_flags);
     cmd->length = FROM_NETWORK_ENDIAN_U32(cmd->length);
@@ -487,69 +1130,106 @@ int handle_urb_submit(usbip_server_t* handle, usbip_client_t* client, size_t i,
     cmd->number_of_packets = FROM_NETWORK_ENDIAN_U32(cmd->number_of_packets);
     cmd->interval = FROM_NETWORK_ENDIAN_U32(cmd->interval);
 
+    // The header was charged when it was read, the transfer is charged here.
+    client->deficit -= cmd->length;
+
+    uint8_t direction = PIPE_DIR(hdr.direction);
+
+    // An OUT payload follows the header, it is consumed even if the URB fails.
+    if (direction == PIPE_OUT)
+    {
+        client->rx_remaining = cmd->length;
+    }
+
+    vusb_dev_t* dev = get_client_dev(handle, client, hdr);
+
+    // Device not found
+    if (dev == NULL)
+    {
+        write_submit_error(client, hdr.seq_num, -ENODEV);
+        return usbip_client_recv_payload(handle, client);
+    }
+
     urb_setup_t* setup = (urb_setup_t*)(cmd->setup);
 
-    setup->wValue = FROM_NETWORK_ENDIAN_U16(setup->wValue);
-
-    urb_t urb = {
-        .transfer_flags = cmd->txfer_flags,
-        .transfer_buffer_length = cmd->length,
-        .start_frame = cmd->start_frame,
-        .number_of_packets = cmd->number_of_packets,
-        .interval = cmd->interval,
-        .setup_packet = *setup,
-        .seq_num = hdr.seq_num,
-        .transfer_buffer = NULL,
-        .pipe = PIPE_DIR(hdr.direction) | PIPE_EP_SET(hdr.endpoint),
-        .complete = urb_complete_cb,
-        .context = client,
-    };
-
-    int err = vhci_urb_init(handle->vhci_handle, dev, &urb);
-
-    // URB init failed
-    if (err == -1)
+#ifndef ENDIAN_CONV
+    // The setup packet is copied from the USB wire format, which is little endian.
+    setup->wValue = i_bswap16(setup->wValue);
+    setup->wIndex = i_bswap16(setup->wIndex);
+    setup->wLength = i_bswap16(setup->wLength);
+#endif
+
+    // Large OUT transfers to data endpoints are passed through as they arrive.
+    bool stream
+        = direction == PIPE_OUT && hdr.endpoint != 0 && cmd->length > VHCI_URB_STREAM_CHUNK;
+
+    usb_ep_t* ep = (hdr.endpoint != 0) ? vhci_find_ep(dev->dev, hdr.endpoint, direction) : NULL;
+
+    // IN endpoints backed by a file need no transfer buffer, the data is sent from the file.
+    bool file = direction == PIPE_IN && ep != NULL && ep->to_host_file != NULL;
+
+    urb_t* urb;
+
+    if (stream)
     {
-        hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT);
-        hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
-        cmd->status = TO_NETWORK_ENDIAN_U32(-errno);
-        write_cmd_response_header(client, hdr);
-        return 0;
+        urb = vhci_urb_alloc_stream(handle->vhci_handle, dev, cmd->length);
+    }
+    else if (file)
+    {
+        urb = vhci_urb_alloc_file(handle->vhci_handle, dev, cmd->length);
+    }
+    else
+    {
+        urb = vhci_urb_alloc(handle->vhci_handle, dev, cmd->length);
     }
 
-    if (PIPE_DIR(urb.pipe) == PIPE_OUT)
+    // URB allocation failed
+    if (urb == NULL)
     {
-        ssize_t bytes = recv(client->sock, urb.transfer_buffer, urb.transfer_buffer_length, 0);
+        write_submit_error(client, hdr.seq_num, -errno);
+        return usbip_client_recv_payload(handle, client);
+    }
 
-        if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    client->urbs++;
+
+    // Buffer ownership stays with the Host controller.
+    urb->transfer_flags
+        |= cmd->txfer_flags & ~(URB_FREE_BUFFER | URB_INTERNAL_PARTIAL_URB | URB_FILE_REGION);
+    urb->start_frame = cmd->start_frame;
+    urb->number_of_packets = cmd->number_of_packets;
+    urb->interval = cmd->interval;
+    urb->setup_packet = *setup;
+    urb->seq_num = hdr.seq_num;
+    // The transfer type of the endpoint decides the output class of the reply.
+    urb->pipe = direction | PIPE_EP_SET(hdr.endpoint)
+        | PIPE_TYPE_SET((ep != NULL) ? ep->desc.txfer_type : PIPE_TYPE_CTRL);
+    urb->complete = urb_complete_cb;
+    urb->context = handle;
+    urb->owner = client->handle;
+
+    if (stream)
+    {
+        // Streamed URBs are submitted first so every part can go straight to the endpoint.
+        if (submit_urb(handle, client, urb) == 0)
         {
-            return -1;
+            client->rx_urb = urb;
         }
-        else if (bytes == urb.transfer_buffer_length)
-        {
-            urb.actual_length = bytes;
-            err = vhci_submit_urb(handle->vhci_handle, urb);
 
-            // URB submit failed
-            if (err == -1)
-            {
-                hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_SUBMIT);
-                hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
-                cmd->status = TO_NETWORK_ENDIAN_U32(-errno);
-                write_cmd_response_header(client, hdr);
-                return 0;
-            }
-        }
-        else
-        {
-            // Not all data received
-        }
+        return usbip_client_recv_payload(handle, client);
+    }
+
+    if (client->rx_remaining > 0)
+    {
+        client->rx_urb = urb;
+        return usbip_client_recv_payload(handle, client);
     }
 
+    submit_urb(handle, client, urb);
+
     return 0;
 }
 
-int handle_urb_unlink(usbip_server_t* handle, usbip_client_t* client, size_t i, hdr_cmd_t hdr)
+int handle_urb_unlink(usbip_server_t* handle, usbip_client_t* client, hdr_cmd_t hdr)
 {
     vusb_dev_t* dev = get_client_dev(handle, client, hdr);
 
@@ -565,18 +1245,23 @@ int handle_urb_unlink(usbip_server_t* handle, usbip_client_t* client, size_t i,
         return 0;
     }
 
-    int err = vhci_unlink_urb(handle->vhci_handle, dev, hdr.seq_num);
+    // The sequence number of the URB to unlink follows the header, it is only unique for a client.
+    int err = vhci_unlink_urb(
+        handle->vhci_handle, dev, FROM_NETWORK_ENDIAN_U32(cmd->seq_num), client->handle);
 
-    // URB unlink failed
+    // URB unlink failed, a URB that already completed had its RET_SUBMIT sent.
     if (err == -1)
     {
         hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_UNLINK);
         hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
-        cmd->status = TO_NETWORK_ENDIAN_U32(-errno);
+        cmd->status = TO_NETWORK_ENDIAN_U32((errno == ENOENT) ? 0 : -errno);
         write_cmd_response_header(client, hdr);
         return 0;
     }
 
+    // The Host controller freed the URB, only URBs of this client are unlinked.
+    client->urbs--;
+
     hdr.command = TO_NETWORK_ENDIAN_U32(USBIP_RET_UNLINK);
     hdr.seq_num = TO_NETWORK_ENDIAN_U32(hdr.seq_num);
     cmd->status = TO_NETWORK_ENDIAN_U32(-ECONNRESET);
@@ -585,35 +1270,411 @@ int handle_urb_unlink(usbip_server_t* handle, usbip_client_t* client, size_t i,
     return 0;
 }
 
-int usbip_client_handle(void* data, size_t i, void* ctx)
+/**
+ * @brief Release the replies the transport reports it no longer reads for TRANSPORT_ZEROCOPY.
+ * @param handle, The server of the client.
+ * @param client, The client whose notifications are read.
+ */
+static void usbip_client_reap_zerocopy(usbip_server_t* handle, usbip_client_t* client)
 {
-    usbip_server_t* handle = ctx;
-    usbip_client_t* client = data;
+    while (client->zerocopy_pending != NULL)
+    {
+        uint32_t last;
+        bool copied;
+
+        if (handle->transport.reap_zerocopy(handle->transport.ctx, client->conn, &last, &copied))
+        {
+            return;
+        }
+
+        // Copying after all costs more than copying up front, e.g. on loopback.
+        if (copied)
+        {
+            client->zerocopy = false;
+        }
+
+        while (client->zerocopy_pending != NULL
+            && (int32_t)(last - client->zerocopy_pending->zerocopy_id) >= 0)
+        {
+            usbip_producer_t* producer = client->zerocopy_pending;
+            client->zerocopy_pending = producer->next;
+
+            if (producer->release != NULL)
+            {
+                producer->release(producer, handle);
+            }
+        }
+    }
+}
 
-    if (stream_fifo_length(&client->out_fifo) > 0)
+/**
+ * @brief Send the data of the first producer with TRANSPORT_ZEROCOPY, the producer waits for the
+ * notification of the transport once all of it is sent.
+ * @param handle, The server of the client.
+ * @param client, The client to send to.
+ * @return int, -1 on error and errno set, otherwise the number of bytes sent
+ */
+static int usbip_client_send_zerocopy(usbip_server_t* handle, usbip_client_t* client)
+{
+    usbip_producer_t* producer = client->producers;
+    int flags = TRANSPORT_ZEROCOPY | ((producer->next != NULL) ? TRANSPORT_MORE : 0);
+
+    struct iovec iov = { .iov_base = (void*)producer->direct, .iov_len = producer->direct_len };
+
+    int bytes = transport_writev(&handle->transport, client->conn, &iov, 1, flags);
+
+    if (bytes <= 0)
+    {
+        return bytes;
+    }
+
+    producer->zerocopy_id = client->zerocopy_sends++;
+    producer->direct += bytes;
+    producer->direct_len -= bytes;
+    usbip_client_account(client, producer, bytes);
+
+    if (producer->direct_len == 0)
+    {
+        client->producers = producer->next;
+        producer->next = NULL;
+        usbip_client_account(client, producer, producer->length);
+
+        if (client->zerocopy_pending == NULL)
+        {
+            client->zerocopy_pending = producer;
+        }
+        else
+        {
+            client->zerocopy_pending_tail->next = producer;
+        }
+
+        client->zerocopy_pending_tail = producer;
+    }
+
+    return bytes;
+}
+
+/**
+ * @brief Send the file region of the first producer with sendfile, the producer is released once
+ * all of it is sent.
+ * @param handle, The server of the client.
+ * @param client, The client to send to.
+ * @return int, -1 on error and errno set, otherwise the number of bytes sent
+ */
+static int usbip_client_sendfile(usbip_server_t* handle, usbip_client_t* client)
+{
+    usbip_producer_t* producer = client->producers;
+
+    ssize_t bytes = transport_sendfile(&handle->transport, client->conn, producer->direct_fd,
+        &producer->direct_offset, producer->direct_len);
+
+    // The file ended before the length reported in the header, the stream is out of sync.
+    if (bytes == 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+    else if (bytes < 0)
+    {
+        return -1;
+    }
+
+    producer->direct_len -= bytes;
+    usbip_client_account(client, producer, bytes);
+
+    if (producer->direct_len == 0)
+    {
+        client->producers = producer->next;
+        usbip_client_account(client, producer, producer->length);
+
+        if (producer->release != NULL)
+        {
+            producer->release(producer, handle);
+        }
+    }
+
+    return bytes;
+}
+
+/**
+ * @brief Send the replies queued during this iteration, held back while fewer than
+ * flush_min_bytes are queued for less than flush_max_delay_us.
+ * @return int, -1 if the client was stopped, otherwise 0
+ */
+static int usbip_client_flush(usbip_server_t* handle, usbip_client_t* client)
+{
+    usbip_client_reap_zerocopy(handle, client);
+    usbip_client_produce(handle, client);
+
+    if (stream_fifo_length(&client->out_fifo) == 0 && client->producers == NULL)
     {
-        int bytes = stream_fifo_send_sock(&client->out_fifo, client->sock);
+        client->pending_since = 0;
+        return 0;
+    }
+
+    if (handle->flush_min_bytes > 0)
+    {
+        uint64_t now = usbip_now_us();
+
+        if (client->pending_since == 0)
+        {
+            client->pending_since = now;
+        }
+
+        // Producers left means the FIFO is full, it is sent regardless.
+        if (client->producers == NULL
+            && stream_fifo_length(&client->out_fifo) < handle->flush_min_bytes
+            && now - client->pending_since < handle->flush_max_delay_us)
+        {
+            return 0;
+        }
+    }
+
+    while (stream_fifo_length(&client->out_fifo) > 0 || client->producers != NULL)
+    {
+        int bytes;
+
+        if (stream_fifo_length(&client->out_fifo) > 0)
+        {
+            struct iovec iov[2];
+            int iovcnt = stream_fifo_iov(&client->out_fifo, iov);
+            // Tell the stack more follows, so the parts of large replies share segments.
+            int flags = (client->producers != NULL) ? TRANSPORT_MORE : 0;
+
+            bytes = transport_writev(&handle->transport, client->conn, iov, iovcnt, flags);
+
+            if (bytes > 0)
+            {
+                stream_fifo_drop(&client->out_fifo, bytes);
+            }
+        }
+        // Only a producer with data to send directly leaves the FIFO empty.
+        else if (client->producers->direct_fd != -1)
+        {
+            bytes = usbip_client_sendfile(handle, client);
+        }
+        else
+        {
+            bytes = usbip_client_send_zerocopy(handle, client);
+        }
 
         // Send failed
         if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
         {
-            client_stop(handle, client, i);
+            client_stop(handle, client);
             return -1;
         }
+        else if (bytes <= 0)
+        {
+            return 0;
+        }
+
+        usbip_client_produce(handle, client);
+    }
+
+    client->pending_since = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Update the flow control state of a client from its pending output and URBs in flight.
+ * @param handle, The server of the client.
+ * @param client, The client to update.
+ * @return bool, true while no requests are read from the client.
+ */
+static bool usbip_client_throttle(usbip_server_t* handle, usbip_client_t* client)
+{
+    size_t out = stream_fifo_length(&client->out_fifo) + client->out_queued;
+
+    if (!client->throttled
+        && (out >= handle->out_high_watermark || client->urbs >= handle->urb_high_watermark))
+    {
+        client->throttled = true;
+        client->throttled_since = usbip_now_us();
+        client->stats.throttle_count++;
+    }
+    else if (client->throttled && out <= handle->out_low_watermark
+        && client->urbs <= handle->urb_low_watermark)
+    {
+        client->throttled = false;
+        client->stats.throttled_us += usbip_now_us() - client->throttled_since;
+    }
+
+    return client->throttled;
+}
+
+/**
+ * @brief Refill a token bucket.
+ * @param bucket, The bucket to refill.
+ * @param rate, Tokens added per second, 0 is unlimited.
+ * @param burst, Most tokens the bucket holds, 0 is one second worth.
+ * @param now, Monotonic time in microseconds.
+ * @return bool, true if the bucket holds at least a whole token.
+ */
+static bool usbip_bucket_ready(
+    usbip_token_bucket_t* bucket, uint32_t rate, uint32_t burst, uint64_t now)
+{
+    if (rate == 0)
+    {
+        return true;
+    }
+
+    int64_t max = (int64_t)((burst != 0) ? burst : rate) * 1000000;
+
+    // A bucket starts out full.
+    if (bucket->last_us == 0 || (now - bucket->last_us) >= (uint64_t)(max - bucket->credit) / rate)
+    {
+        bucket->credit = max;
+    }
+    else
+    {
+        bucket->credit += (int64_t)((now - bucket->last_us) * rate);
+    }
+
+    bucket->last_us = now;
+
+    return bucket->credit >= 1000000;
+}
+
+/**
+ * @brief Take tokens from a bucket, the credit may become negative and is paid back first.
+ * @param bucket, The bucket to take from.
+ * @param rate, Tokens added per second, 0 is unlimited.
+ * @param tokens, Number of tokens to take.
+ */
+static void usbip_bucket_take(usbip_token_bucket_t* bucket, uint32_t rate, uint64_t tokens)
+{
+    if (rate != 0)
+    {
+        bucket->credit -= (int64_t)tokens * 1000000;
+    }
+}
+
+/**
+ * @brief Check a rate and its limit.
+ * @return bool, true if both a URB and a byte can be taken.
+ */
+static bool usbip_rate_ready(usbip_rate_t* rate, const usbip_rate_limit_t* limit, uint64_t now)
+{
+    bool urbs = usbip_bucket_ready(&rate->urbs, limit->urbs_per_sec, limit->urb_burst, now);
+    bool bytes = usbip_bucket_ready(&rate->bytes, limit->bytes_per_sec, limit->byte_burst, now);
+
+    return urbs && bytes;
+}
+
+/**
+ * @brief Take a URB of length bytes from a rate.
+ */
+static void usbip_rate_take(usbip_rate_t* rate, const usbip_rate_limit_t* limit, uint32_t length)
+{
+    usbip_bucket_take(&rate->urbs, limit->urbs_per_sec, 1);
+    usbip_bucket_take(&rate->bytes, limit->bytes_per_sec, length);
+}
+
+/**
+ * @brief Check the rate limits of the client and the device for the next request, which is
+ * peeked so a request over its limits stays in the socket.
+ * @param handle, The server of the client.
+ * @param client, The client to check.
+ * @return bool, true if the request can be read.
+ */
+static bool usbip_client_admit(usbip_server_t* handle, usbip_client_t* client)
+{
+    if (handle->client_limit.urbs_per_sec == 0 && handle->client_limit.bytes_per_sec == 0
+        && handle->dev_limit.urbs_per_sec == 0 && handle->dev_limit.bytes_per_sec == 0)
+    {
+        return true;
+    }
+
+    hdr_cmd_t hdr;
+    ssize_t bytes
+        = transport_recv(&handle->transport, client->conn, &hdr, sizeof(hdr), TRANSPORT_PEEK);
+
+    // Only URB submissions are limited, anything else is read as usual.
+    if (bytes < (ssize_t)sizeof(uint32_t)
+        || FROM_NETWORK_ENDIAN_U32(hdr.command) != USBIP_CMD_SUBMIT)
+    {
+        return true;
+    }
+
+    // The rest of the header is still on its way.
+    if (bytes < (ssize_t)sizeof(hdr))
+    {
+        return false;
+    }
+
+    uint32_t length = FROM_NETWORK_ENDIAN_U32(((cmd_t*)hdr.padding)->length);
+    uint64_t now = usbip_now_us();
+
+    hdr.busnum = FROM_NETWORK_ENDIAN_U16(hdr.busnum);
+    hdr.devnum = FROM_NETWORK_ENDIAN_U16(hdr.devnum);
+
+    vusb_dev_t* dev = get_client_dev(handle, client, hdr);
+    usbip_rate_t* dev_rate
+        = (dev != NULL) ? &handle->dev_rates[SLOT_HANDLE_INDEX(dev->handle)] : NULL;
+
+    if (!usbip_rate_ready(&client->rate, &handle->client_limit, now)
+        || (dev_rate != NULL && !usbip_rate_ready(dev_rate, &handle->dev_limit, now)))
+    {
+        return false;
+    }
+
+    usbip_rate_take(&client->rate, &handle->client_limit, length);
+
+    if (dev_rate != NULL)
+    {
+        usbip_rate_take(dev_rate, &handle->dev_limit, length);
+    }
+
+    return true;
+}
+
+int usbip_client_handle(usbip_server_t* handle, usbip_client_t* client)
+{
+    // Earlier replies are moved into the send buffer, they are sent at the end of the iteration.
+    usbip_client_produce(handle, client);
+
+    // Unread requests leave the socket buffer full, so TCP pushes back on the remote host.
+    if (usbip_client_throttle(handle, client))
+    {
+        return 0;
+    }
+
+    // Requests wait until earlier replies are produced and any direct reply fits.
+    if (client->producers != NULL
+        || stream_fifo_space(&client->out_fifo) < USBIP_MAX_DIRECT_REPLY)
+    {
+        return 0;
+    }
+
+    // The payload of the previous command has to be consumed before the next header.
+    if (client->rx_remaining > 0)
+    {
+        return usbip_client_recv_payload(handle, client);
+    }
+
+    if (!usbip_client_admit(handle, client))
+    {
+        return 0;
     }
 
     uint32_t hdr[2] = { 0 };
     const uint32_t intial_hdr_size = 8;
 
-    ssize_t bytes = recv(client->sock, &hdr, intial_hdr_size, 0);
+    ssize_t bytes = transport_recv(&handle->transport, client->conn, &hdr, intial_hdr_size, 0);
 
-    if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    // A closed connection no longer counts against the admission limits.
+    if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
     {
-        client_stop(handle, client, i);
+        client_stop(handle, client);
         return -1;
     }
     else if (bytes == sizeof(hdr))
     {
+        usbip_client_touch(handle, client);
+        client->requests++;
+        client->deficit -= sizeof(hdr_cmd_t);
         hdr[0] = FROM_NETWORK_ENDIAN_U32(hdr[0]);
 
         if (hdr[0] > USBIP_CMD_UNLINK)
@@ -627,9 +1688,9 @@ int usbip_client_handle(void* data, size_t i, void* ctx)
                 switch (op_code)
                 {
                 case REQ_DEVLIST:
-                    return usbip_resp_devlist(handle, client, i);
+                    return usbip_resp_devlist(handle, client);
                 case REQ_IMPORT:
-                    return usbip_handle_import(handle, client, i);
+                    return usbip_handle_import(handle, client);
                 default:
                     break;
                 }
@@ -639,15 +1700,16 @@ int usbip_client_handle(void* data, size_t i, void* ctx)
         {
             hdr_cmd_t cmd;
 
-            cmd.command = FROM_NETWORK_ENDIAN_U32(hdr[0]);
+            // The command was already converted to host order above.
+            cmd.command = hdr[0];
             cmd.seq_num = FROM_NETWORK_ENDIAN_U32(hdr[1]);
 
-            ssize_t bytes = recv(client->sock, ((uint8_t*)(&cmd)) + intial_hdr_size,
-                sizeof(hdr_cmd_t) - intial_hdr_size, 0);
+            ssize_t bytes = transport_recv(&handle->transport, client->conn,
+                ((uint8_t*)(&cmd)) + intial_hdr_size, sizeof(hdr_cmd_t) - intial_hdr_size, 0);
 
             if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
             {
-                client_stop(handle, client, i);
+                client_stop(handle, client);
                 return -1;
             }
             else if (bytes == sizeof(hdr_cmd_t) - intial_hdr_size)
@@ -655,16 +1717,16 @@ int usbip_client_handle(void* data, size_t i, void* ctx)
 
                 cmd.busnum = FROM_NETWORK_ENDIAN_U16(cmd.busnum);
                 cmd.devnum = FROM_NETWORK_ENDIAN_U16(cmd.devnum);
-                cmd.direction = FROM_NETWORK_ENDIAN_U16(cmd.direction);
-                cmd.endpoint = FROM_NETWORK_ENDIAN_U16(cmd.endpoint);
+                cmd.direction = FROM_NETWORK_ENDIAN_U32(cmd.direction);
+                cmd.endpoint = FROM_NETWORK_ENDIAN_U32(cmd.endpoint);
 
                 switch (cmd.command)
                 {
                 case USBIP_CMD_SUBMIT:
-                    return handle_urb_submit(handle, client, i, cmd);
+                    return handle_urb_submit(handle, client, cmd);
                     break;
                 case USBIP_CMD_UNLINK:
-                    return handle_urb_unlink(handle, client, i, cmd);
+                    return handle_urb_unlink(handle, client, cmd);
                     break;
                 default:
                     break;
@@ -679,8 +1741,60 @@ int usbip_client_handle(void* data, size_t i, void* ctx)
 int usbip_server_handle_once(usbip_server_t* handle)
 {
     usbip_accept_new_client(handle);
+    usbip_handle_rejects(handle);
+
+    // Idle clients are stopped and URBs that take too long are completed.
+    timer_wheel_advance(&handle->timers, usbip_now_us() / 1000);
+
+    size_t i;
+
+    bool active = true;
+
+    // Deficit round robin, every round each client can read drr_quantum bytes worth of requests,
+    // so clients with large transfers do not delay the small requests of others.
+    for (size_t round = 0; active && round < USBIP_REQUESTS_PER_ITERATION; ++round)
+    {
+        active = false;
+
+        // Clients may be stopped (and removed) while they are being handled.
+        SLOT_MAP_FOREACH(&handle->clients, i)
+        {
+            usbip_client_t* client = slot_map_at(&handle->clients, i);
+
+            client->deficit += handle->drr_quantum;
+            active |= client->deficit <= 0;
+
+            while (client->deficit > 0)
+            {
+                size_t requests = client->requests;
+
+                if (usbip_client_handle(handle, client) == -1)
+                {
+                    break;
+                }
+                else if (client->requests == requests)
+                {
+                    // Idle clients do not save up credit, only debt is carried over.
+                    client->deficit = 0;
+                    break;
+                }
+
+                active = true;
+            }
+        }
+    }
+
+    // Pending URBs that complete now are queued on their clients.
+    vhci_run_once(handle->vhci_handle);
+
+    // Everything completed during this iteration goes out together.
+    SLOT_MAP_FOREACH(&handle->clients, i)
+    {
+        usbip_client_flush(handle, slot_map_at(&handle->clients, i));
+    }
 
-    linked_list_iter(&client_list, usbip_client_handle, handle);
+    // Scratch memory only lives for a single iteration.
+    arena_reset(&handle->scratch);
 
     return 0;
 }
\ No newline at end of file
@@ -4,17 +4,367 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include "linked_list.h"
+#include "allocator.h"
+#include "arena.h"
+#include "mem_pool.h"
+#include "queue.h"
+#include "slot_map.h"
+#include "timer_wheel.h"
+#include "transport.h"
+#include "transport_sock.h"
 #include "usb/vhci.h"
 
+#ifndef USBIP_MAX_CLIENTS
+#define USBIP_MAX_CLIENTS 32
+#endif
+
+#ifndef USBIP_PORT
+#define USBIP_PORT 3240
+#endif
+
+// Connections the kernel queues before usbip_server_handle_once accepts them.
+#ifndef USBIP_LISTEN_BACKLOG
+#define USBIP_LISTEN_BACKLOG 64
+#endif
+
+// Connections accepted per usbip_server_handle_once.
+#ifndef USBIP_ACCEPTS_PER_ITERATION
+#define USBIP_ACCEPTS_PER_ITERATION 16
+#endif
+
+// Clients from the same IPv4 address, further connections are rejected.
+#ifndef USBIP_MAX_CLIENTS_PER_ADDR
+#define USBIP_MAX_CLIENTS_PER_ADDR 8
+#endif
+
+// Rejected connections waiting for their request, to answer it with USBIP_STATUS_ERROR.
+#ifndef USBIP_MAX_REJECTS
+#define USBIP_MAX_REJECTS 8
+#endif
+
+// Time in microseconds a rejected connection may take to send its request.
+#ifndef USBIP_REJECT_TIMEOUT_US
+#define USBIP_REJECT_TIMEOUT_US 100000
+#endif
+
+// Milliseconds a client without imported devices may go without sending a request before it is
+// stopped, 0 disables the timeout.
+#ifndef USBIP_IDLE_TIMEOUT_MS
+#define USBIP_IDLE_TIMEOUT_MS 30000
+#endif
+
+// Milliseconds a submitted URB may stay pending before it is completed with -ETIMEDOUT, 0 disables
+// the timeout. Hosts unlink URBs they no longer wait for, so it is disabled by default.
+#ifndef USBIP_URB_TIMEOUT_MS
+#define USBIP_URB_TIMEOUT_MS 0
+#endif
+
+// Number of devices that can be imported at once over all clients.
+#ifndef USBIP_MAX_IMPORTS
+#define USBIP_MAX_IMPORTS USBIP_MAX_CLIENTS
+#endif
+
+// Scratch memory for building replies, released at the end of every usbip_server_handle_once.
+#ifndef USBIP_SCRATCH_SIZE
+#define USBIP_SCRATCH_SIZE 4096
+#endif
+
+// Size of a device record in the devlist and import replies, without its interfaces.
+#define USB_DEV_RECORD_SIZE (256 + 32 + 3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 6)
+// Size of a single interface record in the devlist reply.
+#define USB_IF_RECORD_SIZE 4
+
+struct usbip_server;
+
+// Output classes of replies, a reply is sent ahead of queued replies of a later class.
+typedef enum usbip_out_class
+{
+    USBIP_OUT_CONTROL = 0, // Control transfers, e.g. ep0 status and descriptors.
+    USBIP_OUT_PERIODIC, // Interrupt and isochronous transfers, e.g. HID reports.
+    USBIP_OUT_BULK, // Bulk transfers and other large replies.
+} usbip_out_class_t;
+
+// A reply that is produced in parts, whenever there is room in the send buffer of the client.
+typedef struct usbip_producer
+{
+    // Writes the next part of the reply, at most len bytes, returns 0 once the reply is complete.
+    size_t (*produce)(struct usbip_producer* producer, uint8_t* buf, size_t len);
+    // Called when the reply is complete or the client is stopped, may be NULL.
+    void (*release)(struct usbip_producer* producer, struct usbip_server* handle);
+    // Rest of the reply, sent once produce returned 0 straight from memory with MSG_ZEROCOPY or,
+    // if direct_fd is not -1, from the file at direct_offset with sendfile.
+    const uint8_t* direct;
+    int direct_fd;
+    off_t direct_offset;
+    size_t direct_len;
+    // Last zero copy send of the reply, it is released once the kernel reports it done.
+    uint32_t zerocopy_id;
+    // Bytes of the reply not yet produced or sent directly, counted as pending output.
+    size_t length;
+    usbip_out_class_t out_class;
+    struct usbip_producer* next;
+} usbip_producer_t;
+
+// Reply to REQ_DEVLIST, the devices are written one record at a time as the reply is sent.
+typedef struct usbip_devlist_producer
+{
+    usbip_producer_t producer;
+    vhci_handle_t* vhci_handle;
+    size_t devs_left;
+    slot_handle_t dev;
+    size_t if_next;
+    size_t if_count;
+    size_t stage_len;
+    size_t stage_off;
+    uint8_t stage[USB_DEV_RECORD_SIZE];
+} usbip_devlist_producer_t;
+
+// Reply to CMD_SUBMIT, sent straight from the completed URB.
+typedef struct usbip_urb_reply
+{
+    usbip_producer_t producer;
+    urb_t* urb;
+    size_t offset;
+} usbip_urb_reply_t;
+
+// Replies are held back until this many bytes are queued for a client, 0 sends every iteration.
+#ifndef USBIP_FLUSH_MIN_BYTES
+#define USBIP_FLUSH_MIN_BYTES 0
+#endif
+
+// Longest time in microseconds USBIP_FLUSH_MIN_BYTES may hold back a reply.
+#ifndef USBIP_FLUSH_MAX_DELAY_US
+#define USBIP_FLUSH_MAX_DELAY_US 1000
+#endif
+
+// IN data of at least this many bytes is sent with MSG_ZEROCOPY, 0 disables zero copy sends.
+#ifndef USBIP_ZEROCOPY_MIN_BYTES
+#define USBIP_ZEROCOPY_MIN_BYTES 0
+#endif
+
+// Requests read from a client per iteration, their replies are sent together.
+#ifndef USBIP_REQUESTS_PER_ITERATION
+#define USBIP_REQUESTS_PER_ITERATION 16
+#endif
+
+// No more requests are read from a client once this many reply bytes are waiting to be sent...
+#ifndef USBIP_OUT_HIGH_WATERMARK
+#define USBIP_OUT_HIGH_WATERMARK (64 * 1024)
+#endif
+
+// ...until no more than this many are left.
+#ifndef USBIP_OUT_LOW_WATERMARK
+#define USBIP_OUT_LOW_WATERMARK (16 * 1024)
+#endif
+
+// No more requests are read from a client once it has this many URBs in flight...
+#ifndef USBIP_URB_HIGH_WATERMARK
+#define USBIP_URB_HIGH_WATERMARK (VHCI_MAX_URBS / 2)
+#endif
+
+// ...until no more than this many are left.
+#ifndef USBIP_URB_LOW_WATERMARK
+#define USBIP_URB_LOW_WATERMARK (VHCI_MAX_URBS / 4)
+#endif
+
+// Bytes worth of requests read from every client per round, see usbip_server_handle_once.
+#ifndef USBIP_DRR_QUANTUM
+#define USBIP_DRR_QUANTUM 4096
+#endif
+
+// Token bucket, the credit is kept in millionths of a token so it can be refilled every microsecond.
+typedef struct usbip_token_bucket
+{
+    int64_t credit;
+    // Monotonic time in microseconds of the last refill, 0 before the first one.
+    uint64_t last_us;
+} usbip_token_bucket_t;
+
+// Rate limits of a client or device, a rate of 0 is unlimited and a burst of 0 is a second worth.
+typedef struct usbip_rate_limit
+{
+    uint32_t urbs_per_sec;
+    uint32_t urb_burst;
+    uint32_t bytes_per_sec;
+    uint32_t byte_burst;
+} usbip_rate_limit_t;
+
+// Buckets a CMD_SUBMIT takes a URB and its transfer length from.
+typedef struct usbip_rate
+{
+    usbip_token_bucket_t urbs;
+    usbip_token_bucket_t bytes;
+} usbip_rate_t;
+
+// Flow control counters of a client.
+typedef struct usbip_client_stats
+{
+    // Number of times reading requests was stopped by a high watermark.
+    size_t throttle_count;
+    // Time in microseconds requests were not read, without a throttle that is still ongoing.
+    uint64_t throttled_us;
+} usbip_client_stats_t;
+
+// A device imported by a client.
+typedef struct imported_dev
+{
+    uint16_t busnum;
+    uint16_t devnum;
+    slot_handle_t dev;
+    struct imported_dev* next;
+} imported_dev_t;
+
+// A connected client, allocated through the allocator of the server.
+typedef struct usbip_client
+{
+    slot_handle_t handle;
+    // Connection of the client on the transport of the server.
+    int conn;
+    uint8_t data_stream[1024];
+    stream_fifo_t out_fifo;
+    imported_dev_t* imported_devs;
+    // OUT payload of a CMD_SUBMIT that is still arriving, it is discarded if rx_urb is NULL.
+    urb_t* rx_urb;
+    uint32_t rx_remaining;
+    // Replies waiting for room in out_fifo, new requests are read once they are all produced.
+    // Ordered by output class, the first one may already be produced in part.
+    usbip_producer_t* producers;
+    usbip_producer_t* producers_tail;
+    usbip_devlist_producer_t devlist;
+    // Monotonic time in microseconds the oldest unsent reply was queued, 0 if nothing is queued.
+    uint64_t pending_since;
+    // Number of request headers read.
+    size_t requests;
+    // SO_ZEROCOPY is enabled, cleared once the kernel reports it had to copy anyway.
+    bool zerocopy;
+    // MSG_ZEROCOPY sends done, the kernel numbers its notifications the same way.
+    uint32_t zerocopy_sends;
+    // Replies sent with MSG_ZEROCOPY whose memory the kernel may still read.
+    usbip_producer_t* zerocopy_pending;
+    usbip_producer_t* zerocopy_pending_tail;
+    // Sum of the length of the queued producers.
+    size_t out_queued;
+    // URBs allocated for this client and not yet freed.
+    size_t urbs;
+    // Requests are not read, a high watermark was reached and the low watermarks are not yet.
+    bool throttled;
+    uint64_t throttled_since;
+    usbip_client_stats_t stats;
+    // Bytes worth of requests that can still be read this round, negative after a large request.
+    int64_t deficit;
+    usbip_rate_t rate;
+    // IPv4 address of the peer in network order, 0 for other sockets.
+    uint32_t addr;
+    // Expires idle_timeout_ms after the last request, see USBIP_IDLE_TIMEOUT_MS.
+    wheel_timer_t idle_timer;
+} usbip_client_t;
+
+// A connection that was not accepted as client, its request is answered with an error.
+typedef struct usbip_reject
+{
+    int conn;
+    uint64_t deadline_us;
+} usbip_reject_t;
+
 typedef struct usbip_server
 {
     vhci_handle_t* vhci_handle;
-    int listen_sock;
-    linked_list_t dev_list;
+    allocator_t allocator;
+    // Clients are accepted from and talked to through the transport, sockets by default.
+    transport_t transport;
+    sock_transport_t sock_transport;
+    // Admission control, initialized from USBIP_LISTEN_BACKLOG, USBIP_ACCEPTS_PER_ITERATION and
+    // USBIP_MAX_CLIENTS_PER_ADDR.
+    int listen_backlog;
+    size_t accepts_per_iteration;
+    size_t max_clients_per_addr;
+    usbip_reject_t rejects[USBIP_MAX_REJECTS];
+    size_t reject_count;
+    // Timeouts in milliseconds, ticks of timers are milliseconds of the monotonic clock.
+    uint32_t idle_timeout_ms;
+    uint32_t urb_timeout_ms;
+    timer_wheel_t timers;
+    slot_map_t clients;
+    slot_map_entry_t client_slots[USBIP_MAX_CLIENTS];
+    // Flush policy, initialized from USBIP_FLUSH_MIN_BYTES and USBIP_FLUSH_MAX_DELAY_US.
+    size_t flush_min_bytes;
+    uint32_t flush_max_delay_us;
+    // Initialized from USBIP_ZEROCOPY_MIN_BYTES, applies to clients added afterwards.
+    size_t zerocopy_min_bytes;
+    // Flow control, initialized from the USBIP_*_WATERMARK defines.
+    size_t out_high_watermark;
+    size_t out_low_watermark;
+    size_t urb_high_watermark;
+    size_t urb_low_watermark;
+    // Fair share between clients, initialized from USBIP_DRR_QUANTUM.
+    size_t drr_quantum;
+    // Rate limits of every client and every device, unlimited by default.
+    usbip_rate_limit_t client_limit;
+    usbip_rate_limit_t dev_limit;
+    // Indexed by the slot of the device handle.
+    usbip_rate_t dev_rates[VHCI_MAX_DEVICES];
+    arena_t scratch;
+    _Alignas(sizeof(void*)) uint8_t scratch_mem[USBIP_SCRATCH_SIZE];
+    // Every URB can be waiting to be sent at once.
+    mem_pool_t urb_replies;
+    _Alignas(usbip_urb_reply_t) uint8_t
+        urb_reply_mem[MEM_POOL_SIZE(usbip_urb_reply_t, VHCI_MAX_URBS)];
 } usbip_server_t;
 
-int usbip_server_setup(usbip_server_t* handle, vhci_handle_t* usb_handle);
+/**
+ * @brief Initialize a server without a listening socket, clients are added with
+ * usbip_server_add_client or after calling usbip_server_listen or usbip_server_set_transport.
+ * @param handle, The server to initialize.
+ * @param usb_handle, The Host controller whose devices are exported.
+ * @param allocator, Allocator for clients and imported devices, copied into the server.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_init(
+    usbip_server_t* handle, vhci_handle_t* usb_handle, const allocator_t* allocator);
+
+/**
+ * @brief Start accepting clients on a TCP port.
+ * @param handle, The server to listen with.
+ * @param port, The TCP port to listen on.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_listen(usbip_server_t* handle, uint16_t port);
+
+/**
+ * @brief Start accepting clients on a Unix domain socket.
+ * @param handle, The server to listen with.
+ * @param path, Path of the socket, an existing file is replaced.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_listen_unix(usbip_server_t* handle, const char* path);
+
+/**
+ * @brief Accept and serve clients through another transport, e.g. a loopback transport. Must be
+ * called before clients are added, the current transport is left untouched on error.
+ * @param handle, The server to set the transport of.
+ * @param transport, The transport, copied into the server.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_set_transport(usbip_server_t* handle, const transport_t* transport);
+
+/**
+ * @brief Initialize a server listening on USBIP_PORT.
+ * @param handle, The server to initialize.
+ * @param usb_handle, The Host controller whose devices are exported.
+ * @param allocator, Allocator for clients and imported devices, copied into the server.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_setup(
+    usbip_server_t* handle, vhci_handle_t* usb_handle, const allocator_t* allocator);
+
+/**
+ * @brief Add an already connected socket as a client of the server.
+ * @param handle, The server to add the client to.
+ * @param sock, The socket (the connection on a transport set with usbip_server_set_transport) of
+ * the client, owned by the server on success.
+ * @return int, -1 on error and errno set, otherwise 0
+ */
+int usbip_server_add_client(usbip_server_t* handle, int sock);
 
 int usbip_add_dev(usbip_server_t* handle, usb_dev_t* dev);
 
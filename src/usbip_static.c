@@ -0,0 +1,37 @@
+#include "usbip_static.h"
+
+INIT_MEM_POOL(client_pool, usbip_client_t, USBIP_MAX_CLIENTS);
+INIT_MEM_POOL(imported_dev_pool, imported_dev_t, USBIP_MAX_IMPORTS);
+INIT_MEM_POOL(device_pool, vusb_dev_t, VHCI_MAX_DEVICES);
+
+static mem_pool_t* static_pools[] = { &client_pool, &imported_dev_pool, &device_pool };
+
+static pool_set_t static_pool_set = {
+    .pools = static_pools,
+    .count = sizeof(static_pools) / sizeof(mem_pool_t*),
+};
+
+static allocator_t static_allocator;
+
+const allocator_t* usbip_static_allocator(void)
+{
+    if (static_allocator.alloc == NULL)
+    {
+        init_pool_set_allocator(&static_allocator, &static_pool_set);
+    }
+
+    return &static_allocator;
+}
+
+void usbip_static_footprint(usbip_static_footprint_t* footprint)
+{
+    footprint->clients = client_pool.pool_size;
+    footprint->imported_devs = imported_dev_pool.pool_size;
+    footprint->devices = device_pool.pool_size;
+    // The transfer buffers are part of every Host controller handle.
+    footprint->urb_bufs = sizeof(((vhci_handle_t*)NULL)->urb_buf_region);
+    footprint->server = sizeof(usbip_server_t);
+    footprint->vhci = sizeof(vhci_handle_t) - footprint->urb_bufs;
+    footprint->total = footprint->clients + footprint->imported_devs + footprint->devices
+        + footprint->urb_bufs + footprint->server + footprint->vhci;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "allocator.h"
+#include "usbip.h"
+#include <stddef.h>
+
+/**
+ * Fully static profile, every object of the server and the Host controller is taken from pools that
+ * are sized at compile time by USBIP_MAX_CLIENTS, USBIP_MAX_IMPORTS and VHCI_MAX_DEVICES. An
+ * exhausted pool fails the request instead of falling back to the C library heap.
+ */
+
+typedef struct usbip_static_footprint
+{
+    size_t clients;
+    size_t imported_devs;
+    size_t devices;
+    // URB transfer buffers of one Host controller handle.
+    size_t urb_bufs;
+    size_t server;
+    // One Host controller handle without its URB transfer buffers.
+    size_t vhci;
+    size_t total;
+} usbip_static_footprint_t;
+
+/**
+ * @brief Get the allocator serving the static pools, pass it to vhci_init and usbip_server_setup.
+ * @return const allocator_t*, The allocator of the static pools.
+ */
+const allocator_t* usbip_static_allocator(void);
+
+/**
+ * @brief Get the statically allocated memory of the profile in bytes.
+ * @param footprint, Filled with the size of every pool, the server and Host controller handles,
+ * the total is for one server and one Host controller.
+ */
+void usbip_static_footprint(usbip_static_footprint_t* footprint);
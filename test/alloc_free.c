@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include "usbip.h"
+#include "usbip_types.h"
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Links with malloc, calloc, realloc, posix_memalign and free wrapped so every allocation made by
+ * the server after the warm-up phase is recorded together with its call site.
+ */
+
+#define MAX_SITES          64
+#define WARMUP_ITERATIONS  64
+#define STEADY_ITERATIONS  4096
+#define OUT_PAYLOAD_LENGTH 64
+
+typedef struct alloc_site
+{
+    void* caller;
+    const char* fn;
+    size_t count;
+} alloc_site_t;
+
+static int tracking = 0;
+static size_t site_count = 0;
+static size_t alloc_count = 0;
+static alloc_site_t sites[MAX_SITES];
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+int __real_posix_memalign(void** ptr, size_t align, size_t size);
+void __real_free(void* ptr);
+
+static void record(const char* fn, void* caller)
+{
+    if (!tracking)
+    {
+        return;
+    }
+
+    alloc_count++;
+
+    for (size_t i = 0; i < site_count; ++i)
+    {
+        if (sites[i].caller == caller && sites[i].fn == fn)
+        {
+            sites[i].count++;
+            return;
+        }
+    }
+
+    if (site_count < MAX_SITES)
+    {
+        sites[site_count++] = (alloc_site_t) { .caller = caller, .fn = fn, .count = 1 };
+    }
+}
+
+void* __wrap_malloc(size_t size)
+{
+    record("malloc", __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    record("calloc", __builtin_return_address(0));
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    record("realloc", __builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void** ptr, size_t align, size_t size)
+{
+    record("posix_memalign", __builtin_return_address(0));
+    return __real_posix_memalign(ptr, align, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr != NULL)
+    {
+        record("free", __builtin_return_address(0));
+    }
+
+    __real_free(ptr);
+}
+
+static void report_sites(void)
+{
+    for (size_t i = 0; i < site_count; ++i)
+    {
+        Dl_info info;
+
+        if (dladdr(sites[i].caller, &info) && info.dli_sname != NULL)
+        {
+            printf("\t\t%s from %s+0x%zx: %zu calls\n", sites[i].fn, info.dli_sname,
+                (size_t)((uint8_t*)sites[i].caller - (uint8_t*)info.dli_saddr), sites[i].count);
+        }
+        else
+        {
+            printf("\t\t%s from %p: %zu calls\n", sites[i].fn, sites[i].caller, sites[i].count);
+        }
+    }
+}
+
+static usbip_server_t server;
+static vhci_handle_t vhci;
+static usb_dev_t dev;
+static usb_conf_t conf;
+static usb_if_group_t if_grp;
+static usb_if_t data_if;
+
+static void setup_device(void)
+{
+    usb_dev_desc_t desc = {
+        .bcdDevice = 0x0200,
+        .bcdUSB = 0x0200,
+        .bDeviceClass = 0xFF,
+        .bMaxPacketSize0 = 64,
+    };
+
+    dev = usb_dev_create(&desc, LANG_ID_ENGLISH_US);
+    conf.desc.bConfigurationValue = 0;
+    conf.desc.one = 1;
+    data_if.desc.bInterfaceClass = 0xFF;
+
+    usb_dev_add_config(&dev, &conf);
+    usb_if_grp_add(&if_grp, &data_if);
+    usb_dev_add_if_grp(&dev, 0, &if_grp);
+    dev.cur_config = 0;
+}
+
+static size_t drain(int sock)
+{
+    uint8_t buf[4096];
+    size_t total = 0;
+    ssize_t bytes;
+
+    while ((bytes = recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+    {
+        total += bytes;
+    }
+
+    return total;
+}
+
+static void send_submit(int sock, uint32_t seq_num, uint32_t direction)
+{
+    uint8_t buf[sizeof(hdr_cmd_t) + OUT_PAYLOAD_LENGTH] = { 0 };
+    uint32_t* words = (uint32_t*)buf;
+    size_t length = sizeof(hdr_cmd_t);
+
+    words[0] = htonl(USBIP_CMD_SUBMIT);
+    words[1] = htonl(seq_num);
+    words[2] = 0;
+    words[3] = htonl(direction);
+    words[4] = 0;
+    words[6] = htonl(direction == USBIP_DIR_IN ? 18 : OUT_PAYLOAD_LENGTH);
+
+    if (direction == USBIP_DIR_IN)
+    {
+        // GET_DESCRIPTOR(DEVICE)
+        uint8_t setup[8] = { 0x80, 6, 0x00, 0x01, 0, 0, 18, 0 };
+        memcpy(buf + 40, setup, sizeof(setup));
+    }
+    else
+    {
+        length += OUT_PAYLOAD_LENGTH;
+    }
+
+    send(sock, buf, length, 0);
+}
+
+static size_t run_workload(int sock, size_t iterations, uint32_t* seq_num)
+{
+    size_t replied = 0;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        send_submit(sock, (*seq_num)++, (i & 1) ? USBIP_DIR_IN : USBIP_DIR_OUT);
+        usbip_server_handle_once(&server);
+        usbip_server_handle_once(&server);
+        replied += drain(sock);
+    }
+
+    return replied;
+}
+
+test(test_steady_state_no_alloc)
+{
+    int socks[2];
+    uint32_t seq_num = 1;
+
+    setup_device();
+
+    assert_int_eq(vhci_init(&vhci, &std_allocator), 0);
+    assert_int_eq(vhci_register_dev(&vhci, &dev), 0);
+    assert_int_eq(usbip_server_init(&server, &vhci, &std_allocator), 0);
+    assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, socks), 0);
+    assert_int_eq(fcntl(socks[0], F_SETFL, fcntl(socks[0], F_GETFL) | O_NONBLOCK), 0);
+    assert_int_eq(usbip_server_add_client(&server, socks[0]), 0);
+
+    // Warm up, connecting and importing may allocate.
+    uint8_t import[8 + 32] = { 0 };
+    uint16_t* import_hdr = (uint16_t*)import;
+
+    import_hdr[0] = htons(USBIP_VERSION);
+    import_hdr[1] = htons(REQ_IMPORT);
+    strcpy((char*)import + 8, dev.busid);
+
+    send(socks[1], import, sizeof(import), 0);
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+    drain(socks[1]);
+
+    run_workload(socks[1], WARMUP_ITERATIONS, &seq_num);
+
+    tracking = 1;
+    size_t replied = run_workload(socks[1], STEADY_ITERATIONS, &seq_num);
+    tracking = 0;
+
+    printf("\t\t%d URBs after warm-up, %zu allocator calls\n", STEADY_ITERATIONS, alloc_count);
+
+    if (alloc_count != 0)
+    {
+        report_sites();
+    }
+
+    assert_int_eq(alloc_count, 0);
+    // Every OUT is answered with a bare header, every IN with the 18 byte device descriptor.
+    assert_int_eq(replied, STEADY_ITERATIONS / 2 * (2 * sizeof(hdr_cmd_t) + 18));
+    assert_int_eq(server.clients.size, 1);
+
+    close(socks[1]);
+
+    return 1;
+}
+
+test(test_harness_reports_alloc)
+{
+    alloc_count = 0;
+    site_count = 0;
+
+    tracking = 1;
+    void* ptr = allocator_alloc(&std_allocator, 16, 8);
+    allocator_free(&std_allocator, ptr, 16);
+    tracking = 0;
+
+    assert_int_eq(alloc_count, 2);
+    assert_int_eq(site_count, 2);
+
+    report_sites();
+
+    alloc_count = 0;
+    site_count = 0;
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_harness_reports_alloc);
+    run_test(test_steady_state_no_alloc);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+#include "allocator.h"
+#include "arena.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+test(test_arena_create_no_mem)
+{
+    arena_t arena;
+    uint64_t mem[4];
+
+    assert_int_eq(init_arena(NULL, mem, sizeof(mem)), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_arena(&arena, NULL, sizeof(mem)), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_arena(&arena, mem, 0), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_arena_alloc_align)
+{
+    arena_t arena;
+    uint64_t data[8];
+    uint8_t* mem = (uint8_t*)data;
+
+    assert_int_eq(init_arena(&arena, mem, sizeof(data)), 0);
+
+    uint8_t* one = arena_alloc(&arena, 3, 1);
+    uint8_t* two = arena_alloc(&arena, 8, 8);
+    uint8_t* three = arena_alloc(&arena, 1, 1);
+
+    assert_ptr_eq(one, mem);
+    assert_ptr_eq(two, mem + 8);
+    assert_ptr_eq(three, mem + 16);
+    assert_int_eq(arena.used, 17);
+
+    // Not enough room left once the padding is taken into account.
+    assert_ptr_eq(arena_alloc(&arena, 46, 4), NULL);
+    assert_int_eq(arena.failures, 1);
+    assert_ptr_eq(arena_alloc(&arena, 46, 1), mem + 17);
+    assert_ptr_eq(arena_alloc(&arena, 1, 1), mem + 63);
+    assert_ptr_eq(arena_alloc(&arena, 1, 1), NULL);
+
+    return 1;
+}
+
+test(test_arena_reset)
+{
+    arena_t arena;
+    uint64_t data[4];
+    uint8_t* mem = (uint8_t*)data;
+
+    assert_int_eq(init_arena(&arena, mem, sizeof(data)), 0);
+
+    assert_ptr_eq(arena_alloc(&arena, 24, 1), mem);
+    assert_ptr_eq(arena_alloc(&arena, 16, 1), NULL);
+
+    arena_reset(&arena);
+
+    assert_int_eq(arena.used, 0);
+    assert_int_eq(arena.peak, 24);
+    assert_ptr_eq(arena_alloc(&arena, 16, 1), mem);
+
+    return 1;
+}
+
+test(test_arena_allocator)
+{
+    arena_t arena;
+    allocator_t allocator;
+    uint64_t data[4];
+    uint8_t* mem = (uint8_t*)data;
+
+    assert_int_eq(init_arena(&arena, mem, sizeof(data)), 0);
+    assert_int_eq(init_arena_allocator(&allocator, &arena), 0);
+
+    void* one = allocator_alloc(&allocator, 8, 8);
+
+    assert_ptr_eq(one, mem);
+
+    // Free does not release memory, only a reset does.
+    allocator_free(&allocator, one, 8);
+    assert_ptr_eq(allocator_alloc(&allocator, 8, 8), mem + 8);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_arena_create_no_mem);
+    run_test(test_arena_alloc_align);
+    run_test(test_arena_reset);
+    run_test(test_arena_allocator);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include "chunk_pool.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define OBJ_SIZE   64
+
+test(test_chunk_pool_create_bad_chunk_size)
+{
+    chunk_pool_t pool;
+
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, CHUNK_SIZE, 0, 0, NULL), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, CHUNK_SIZE + 4096, 0, 0, &pool), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, 64, 0, 0, &pool), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_chunk_pool(CHUNK_SIZE, CHUNK_SIZE, 0, 0, &pool), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_chunk_pool_grow)
+{
+    chunk_pool_t pool;
+
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, CHUNK_SIZE, 0, 0, &pool), 0);
+    assert_int_eq(pool.chunks.size, 0);
+
+    void* first = chunk_pool_alloc(&pool);
+    assert_int_eq(first != NULL, 1);
+    assert_int_eq(pool.chunks.size, 1);
+
+    chunk_t* chunk = ILIST_ENTRY(pool.chunks.first, chunk_t, link);
+    size_t capacity = chunk->capacity;
+
+    assert_int_eq((uintptr_t)chunk % CHUNK_SIZE, 0);
+
+    void** objs = malloc(sizeof(void*) * capacity * 3);
+
+    objs[0] = first;
+
+    for (size_t i = 1; i < capacity * 3; ++i)
+    {
+        objs[i] = chunk_pool_alloc(&pool);
+        assert_int_eq(objs[i] != NULL, 1);
+        ((uint8_t*)objs[i])[OBJ_SIZE - 1] = 0xAA;
+    }
+
+    assert_int_eq(pool.chunks.size, 3);
+    assert_int_eq(pool.peak_chunks, 3);
+    assert_int_eq(pool.in_use, capacity * 3);
+    assert_int_eq(pool.high_watermark, capacity * 3);
+
+    // Free the middle chunk and half of the last one.
+    for (size_t i = capacity; i < capacity * 2 + capacity / 2; ++i)
+    {
+        chunk_pool_free(&pool, objs[i]);
+    }
+
+    assert_int_eq(pool.in_use, capacity * 2 - capacity / 2);
+    assert_int_eq(pool.high_watermark, capacity * 3);
+
+    // Freed objects are reused before a new chunk is mapped.
+    for (size_t i = capacity; i < capacity * 2 + capacity / 2; ++i)
+    {
+        objs[i] = chunk_pool_alloc(&pool);
+        assert_int_eq(objs[i] != NULL, 1);
+    }
+
+    assert_int_eq(pool.chunks.size, 3);
+
+    chunk_pool_destroy(&pool);
+    free(objs);
+
+    assert_int_eq(pool.chunks.size, 0);
+
+    return 1;
+}
+
+test(test_chunk_pool_trim)
+{
+    chunk_pool_t pool;
+
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, CHUNK_SIZE, 0, 0, &pool), 0);
+
+    void* first = chunk_pool_alloc(&pool);
+    chunk_t* chunk = ILIST_ENTRY(pool.chunks.first, chunk_t, link);
+    size_t capacity = chunk->capacity;
+    void** objs = malloc(sizeof(void*) * capacity * 3);
+
+    objs[0] = first;
+
+    for (size_t i = 1; i < capacity * 3; ++i)
+    {
+        objs[i] = chunk_pool_alloc(&pool);
+    }
+
+    for (size_t i = 0; i < capacity * 2; ++i)
+    {
+        chunk_pool_free(&pool, objs[i]);
+    }
+
+    // Two chunks are empty, keep one of them mapped.
+    assert_int_eq(chunk_pool_trim(&pool, 1), 1);
+    assert_int_eq(pool.chunks.size, 2);
+    assert_int_eq(chunk_pool_trim(&pool, 1), 0);
+    assert_int_eq(chunk_pool_trim(&pool, 0), 1);
+    assert_int_eq(pool.chunks.size, 1);
+    assert_int_eq(pool.peak_chunks, 3);
+
+    // The remaining chunk is still usable after the current chunk was trimmed.
+    chunk_pool_free(&pool, objs[capacity * 2]);
+    assert_ptr_eq(chunk_pool_alloc(&pool), objs[capacity * 2]);
+
+    chunk_pool_destroy(&pool);
+    free(objs);
+
+    return 1;
+}
+
+test(test_chunk_pool_max_chunks)
+{
+    chunk_pool_t pool;
+
+    assert_int_eq(init_chunk_pool(CHUNK_SIZE / 2, CHUNK_SIZE, 2, 0, &pool), 0);
+
+    // Only one object fits a chunk next to the chunk header.
+    void* one = chunk_pool_alloc(&pool);
+    void* two = chunk_pool_alloc(&pool);
+
+    assert_int_eq(one != NULL && two != NULL, 1);
+    assert_ptr_eq(chunk_pool_alloc(&pool), NULL);
+
+    chunk_pool_free(&pool, one);
+    assert_ptr_eq(chunk_pool_alloc(&pool), one);
+
+    chunk_pool_destroy(&pool);
+
+    return 1;
+}
+
+test(test_chunk_pool_huge_pages)
+{
+    chunk_pool_t pool;
+
+    // Falls back to normal pages when no huge pages are reserved.
+    assert_int_eq(init_chunk_pool(OBJ_SIZE, CHUNK_POOL_HUGE_PAGE_SIZE, 0,
+                      CHUNK_POOL_HUGETLB | CHUNK_POOL_THP, &pool),
+        0);
+
+    uint8_t* obj = chunk_pool_alloc(&pool);
+
+    assert_int_eq(obj != NULL, 1);
+    assert_int_eq((uintptr_t)pool.chunks.first % CHUNK_POOL_HUGE_PAGE_SIZE, 0);
+
+    obj[OBJ_SIZE - 1] = 0xAA;
+    chunk_pool_free(&pool, obj);
+    chunk_pool_destroy(&pool);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_chunk_pool_create_bad_chunk_size);
+    run_test(test_chunk_pool_grow);
+    run_test(test_chunk_pool_trim);
+    run_test(test_chunk_pool_max_chunks);
+    run_test(test_chunk_pool_huge_pages);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int main(void)
+{
+    printf("Chunk pool is only available on Linux\n");
+
+    return EXIT_SUCCESS;
+}
+
+#endif
@@ -3,6 +3,9 @@
 #include <errno.h>
 #include <stdint.h>
 
+// Smallest payload of a block, a free block holds the free list links in its payload.
+#define MIN_BLOCK (sizeof(heap_free_node_t) - sizeof(heap_node_t))
+
 test(test_heap_create_no_pool_obj)
 {
     uint64_t some;
@@ -55,7 +58,7 @@ test(test_heap_alloc_simple)
     void* two = heap_alloc(&pool, 4);
 
     assert_ptr_eq(one, (uint8_t*)mem + sizeof(heap_node_t));
-    assert_ptr_eq(two, (uint8_t*)mem + 4 + sizeof(heap_node_t) * 2);
+    assert_ptr_eq(two, (uint8_t*)mem + MIN_BLOCK + sizeof(heap_node_t) * 2);
 }
 
 test(test_heap_alloc_free_realloc)
@@ -74,14 +77,14 @@ test(test_heap_alloc_free_realloc)
     void* three = heap_alloc(&pool, 4);
 
     assert_ptr_eq(one, (uint8_t*)mem + sizeof(heap_node_t));
-    assert_ptr_eq(two, (uint8_t*)mem + 4 + sizeof(heap_node_t) * 2);
-    assert_ptr_eq(three, (uint8_t*)mem + 8 + sizeof(heap_node_t) * 3);
+    assert_ptr_eq(two, (uint8_t*)mem + MIN_BLOCK + sizeof(heap_node_t) * 2);
+    assert_ptr_eq(three, (uint8_t*)mem + MIN_BLOCK * 2 + sizeof(heap_node_t) * 3);
 
     heap_free(&pool, two);
 
     void* four = heap_alloc(&pool, 4);
 
-    assert_ptr_eq(four, (uint8_t*)mem + 4 + sizeof(heap_node_t) * 2);
+    assert_ptr_eq(four, (uint8_t*)mem + MIN_BLOCK + sizeof(heap_node_t) * 2);
 }
 
 test(test_heap_free_combine_free_blocks)
@@ -100,8 +103,8 @@ test(test_heap_free_combine_free_blocks)
     void* three = heap_alloc(&pool, 4);
 
     assert_ptr_eq(one, (uint8_t*)mem + sizeof(heap_node_t));
-    assert_ptr_eq(two, (uint8_t*)mem + 4 + sizeof(heap_node_t) * 2);
-    assert_ptr_eq(three, (uint8_t*)mem + 8 + sizeof(heap_node_t) * 3);
+    assert_ptr_eq(two, (uint8_t*)mem + MIN_BLOCK + sizeof(heap_node_t) * 2);
+    assert_ptr_eq(three, (uint8_t*)mem + MIN_BLOCK * 2 + sizeof(heap_node_t) * 3);
 
     heap_free(&pool, two);
     heap_free(&pool, one);
@@ -127,8 +130,8 @@ test(test_heap_free_memory_fragmentation)
     void* three = heap_alloc(&pool, 4);
 
     assert_ptr_eq(one, (uint8_t*)mem + sizeof(heap_node_t));
-    assert_ptr_eq(two, (uint8_t*)mem + 4 + sizeof(heap_node_t) * 2);
-    assert_ptr_eq(three, (uint8_t*)mem + 8 + sizeof(heap_node_t) * 3);
+    assert_ptr_eq(two, (uint8_t*)mem + MIN_BLOCK + sizeof(heap_node_t) * 2);
+    assert_ptr_eq(three, (uint8_t*)mem + MIN_BLOCK * 2 + sizeof(heap_node_t) * 3);
 
     heap_free(&pool, one);
     heap_free(&pool, two);
@@ -138,6 +141,194 @@ test(test_heap_free_memory_fragmentation)
     assert_ptr_eq(four, (uint8_t*)mem + sizeof(heap_node_t));
 }
 
+test(test_heap_alloc_aligned_blocks)
+{
+    heap_t pool;
+    _Alignas(64) uint8_t mem[1024];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(mem), 64), 0);
+
+    void* one = heap_alloc(&pool, 1);
+    void* two = heap_alloc(&pool, 100);
+    void* three = heap_alloc(&pool, 3);
+
+    assert_int_eq(((uintptr_t)one) % 64, 0);
+    assert_int_eq(((uintptr_t)two) % 64, 0);
+    assert_int_eq(((uintptr_t)three) % 64, 0);
+
+    heap_free(&pool, two);
+
+    two = heap_alloc(&pool, 64);
+
+    assert_int_eq(((uintptr_t)two) % 64, 0);
+
+    return 1;
+}
+
+test(test_heap_alloc_exhausted)
+{
+    heap_t pool;
+    uint64_t mem[64];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(uint64_t) * 64, 8), 0);
+
+    assert_ptr_eq(heap_alloc(&pool, sizeof(mem)), NULL);
+    assert_int_eq(errno, ENOMEM);
+
+    void* all = heap_alloc(&pool, sizeof(mem) - sizeof(heap_node_t) * 2);
+
+    assert_ptr_eq(all, (uint8_t*)mem + sizeof(heap_node_t));
+    assert_ptr_eq(heap_alloc(&pool, 1), NULL);
+
+    heap_free(&pool, all);
+
+    assert_ptr_eq(heap_alloc(&pool, 1), all);
+
+    return 1;
+}
+
+test(test_heap_free_merge_both_sides)
+{
+    heap_t pool;
+    uint64_t mem[64];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(uint64_t) * 64, 8), 0);
+
+    void* one = heap_alloc(&pool, 8);
+    void* two = heap_alloc(&pool, 8);
+    void* three = heap_alloc(&pool, 8);
+    void* four = heap_alloc(&pool, 8);
+
+    heap_free(&pool, one);
+    heap_free(&pool, three);
+    // Freeing the middle block merges it with the free blocks before and after it.
+    heap_free(&pool, two);
+
+    void* merged = heap_alloc(&pool, MIN_BLOCK * 3 + sizeof(heap_node_t) * 2);
+
+    assert_ptr_eq(merged, one);
+    assert_ptr_eq(heap_alloc(&pool, 8), (uint8_t*)four + MIN_BLOCK + sizeof(heap_node_t));
+
+    return 1;
+}
+
+test(test_heap_realloc_grow_in_place)
+{
+    heap_t pool;
+    uint64_t mem[64];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(uint64_t) * 64, 8), 0);
+
+    uint8_t* one = heap_alloc(&pool, 16);
+
+    for (int i = 0; i < 16; ++i)
+    {
+        one[i] = i;
+    }
+
+    // The block after one is free so the allocation grows without moving.
+    uint8_t* grown = heap_realloc(&pool, one, 128);
+
+    assert_ptr_eq(grown, one);
+
+    void* two = heap_alloc(&pool, 16);
+
+    assert_ptr_eq(two, one + 128 + sizeof(heap_node_t));
+
+    // Two blocks the growth, the allocation has to move and keep its contents.
+    uint8_t* moved = heap_realloc(&pool, grown, 192);
+
+    assert_int_eq(moved != grown, 1);
+
+    for (int i = 0; i < 16; ++i)
+    {
+        assert_int_eq(moved[i], i);
+    }
+
+    return 1;
+}
+
+test(test_heap_realloc_shrink)
+{
+    heap_t pool;
+    uint64_t mem[64];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(uint64_t) * 64, 8), 0);
+
+    void* one = heap_alloc(&pool, 256);
+
+    assert_ptr_eq(heap_realloc(&pool, one, 32), one);
+
+    // The released tail is merged with the free remainder of the pool.
+    void* two = heap_alloc(&pool, 128);
+
+    assert_ptr_eq(two, (uint8_t*)one + 32 + sizeof(heap_node_t));
+
+    return 1;
+}
+
+test(test_heap_aligned_alloc)
+{
+    heap_t pool;
+    uint64_t mem[256];
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(mem), 8), 0);
+
+    void* one = heap_alloc(&pool, 8);
+    void* two = heap_aligned_alloc(&pool, 100, 256);
+    void* three = heap_aligned_alloc(&pool, 8, 64);
+
+    assert_int_eq(two != NULL, 1);
+    assert_int_eq(((uintptr_t)two) % 256, 0);
+    assert_int_eq(((uintptr_t)three) % 64, 0);
+
+    heap_free(&pool, two);
+    heap_free(&pool, three);
+    heap_free(&pool, one);
+
+    heap_stats_t stats;
+
+    // All leading gaps were merged back into a single free block.
+    assert_int_eq(heap_get_stats(&pool, &stats), 0);
+    assert_int_eq(stats.used, 0);
+    assert_int_eq(stats.free_blocks, 1);
+
+    return 1;
+}
+
+test(test_heap_stats)
+{
+    heap_t pool;
+    uint64_t mem[64];
+    heap_stats_t stats;
+
+    assert_int_eq(init_heap(&pool, mem, sizeof(uint64_t) * 64, 8), 0);
+    assert_int_eq(heap_get_stats(&pool, &stats), 0);
+    assert_int_eq(stats.used, 0);
+    assert_int_eq(stats.free_blocks, 1);
+    assert_int_eq(stats.largest_free, stats.free);
+    assert_int_eq(stats.fragmentation == 0.0f, 1);
+
+    void* one = heap_alloc(&pool, 32);
+    void* two = heap_alloc(&pool, 32);
+    void* three = heap_alloc(&pool, 32);
+
+    heap_free(&pool, two);
+
+    assert_int_eq(heap_get_stats(&pool, &stats), 0);
+    assert_int_eq(stats.used, 64);
+    assert_int_eq(stats.peak, 96);
+    assert_int_eq(stats.free_blocks, 2);
+    assert_int_eq(stats.free, sizeof(mem) - sizeof(heap_node_t) * 5 - 64);
+    assert_int_eq(stats.largest_free, stats.free - 32);
+    assert_int_eq(stats.fragmentation > 0.0f, 1);
+
+    assert_int_eq(heap_get_stats(&pool, NULL), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
 int main(void)
 {
     run_test(test_heap_create_no_pool_obj);
@@ -148,6 +339,13 @@ int main(void)
     run_test(test_heap_alloc_free_realloc);
     run_test(test_heap_free_combine_free_blocks);
     run_test(test_heap_free_memory_fragmentation);
+    run_test(test_heap_alloc_aligned_blocks);
+    run_test(test_heap_alloc_exhausted);
+    run_test(test_heap_free_merge_both_sides);
+    run_test(test_heap_realloc_grow_in_place);
+    run_test(test_heap_realloc_shrink);
+    run_test(test_heap_aligned_alloc);
+    run_test(test_heap_stats);
 
     printf("Tests finished\n");
 
@@ -0,0 +1,243 @@
+#include "heap.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Fragmentation benchmark comparing the TLSF heap with the previous first-fit heap. Both run the
+ * same random workload of URB sized buffers, allocation time, failed allocations and the largest
+ * block that can still be allocated afterwards are reported.
+ */
+
+#define POOL_SIZE  (64 * 1024)
+#define LIVE_SLOTS 96
+#define OPS        200000
+
+// Previous first-fit implementation, kept here as the reference for the benchmark.
+typedef struct ff_heap
+{
+    size_t alignment;
+    void* blocks;
+} ff_heap_t;
+
+typedef struct ff_node
+{
+    size_t size;
+    struct ff_node* next;
+} ff_node_t;
+
+static inline int ff_is_allocated(void* ptr) { return ((uintptr_t)ptr) & 0x1; }
+
+static inline void* ff_set_allocated(void* ptr) { return (void*)(((uintptr_t)ptr) | 0x1); }
+
+static inline void* ff_clear_allocated(void* ptr) { return (void*)(((uintptr_t)ptr) & ~0x1); }
+
+static void ff_init(ff_heap_t* heap, void* pool, size_t pool_size, size_t alignment)
+{
+    heap->alignment = alignment;
+    heap->blocks = pool;
+
+    ff_node_t* block = pool;
+    block->size = pool_size - sizeof(ff_node_t);
+    block->next = NULL;
+}
+
+static void* ff_alloc(ff_heap_t* heap, size_t size)
+{
+    size_t aligned_size = ((size & (heap->alignment - 1)) == 0)
+        ? size
+        : size + (heap->alignment - (size % heap->alignment));
+
+    ff_node_t* cur = heap->blocks;
+
+    while (cur != NULL)
+    {
+        while (!ff_is_allocated(cur->next) && cur->next != NULL
+            && !ff_is_allocated(cur->next->next))
+        {
+            cur->size += cur->next->size + sizeof(ff_node_t);
+            cur->next = cur->next->next;
+        }
+
+        if (cur->size >= aligned_size && !ff_is_allocated(cur->next))
+        {
+            if (cur->size - aligned_size > sizeof(ff_node_t))
+            {
+                ff_node_t* new_block
+                    = (ff_node_t*)((uintptr_t)cur + aligned_size + sizeof(ff_node_t));
+                new_block->size = cur->size - aligned_size - sizeof(ff_node_t);
+                new_block->next = cur->next;
+
+                cur->size = aligned_size;
+                cur->next = new_block;
+            }
+
+            cur->next = ff_set_allocated(cur->next);
+
+            return (void*)((uintptr_t)cur + sizeof(ff_node_t));
+        }
+
+        cur = ff_clear_allocated(cur->next);
+    }
+
+    return NULL;
+}
+
+static void ff_free(ff_heap_t* heap, void* obj)
+{
+    ff_node_t* cur = (ff_node_t*)((uint8_t*)obj - sizeof(ff_node_t));
+    cur->next = ff_clear_allocated(cur->next);
+
+    if (cur->next != NULL && !ff_is_allocated(cur->next->next))
+    {
+        cur->size += cur->next->size + sizeof(ff_node_t);
+        cur->next = cur->next->next;
+    }
+}
+
+typedef void* (*bench_alloc_fn)(void* heap, size_t size);
+typedef void (*bench_free_fn)(void* heap, void* obj);
+
+static void* tlsf_bench_alloc(void* heap, size_t size) { return heap_alloc(heap, size); }
+static void tlsf_bench_free(void* heap, void* obj) { heap_free(heap, obj); }
+static void* ff_bench_alloc(void* heap, size_t size) { return ff_alloc(heap, size); }
+static void ff_bench_free(void* heap, void* obj) { ff_free(heap, obj); }
+
+typedef struct bench_result
+{
+    double ns_per_op;
+    size_t failures;
+    size_t largest;
+} bench_result_t;
+
+static uint32_t bench_rand(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Setup replies, descriptors, interrupt reports and bulk payloads.
+static size_t bench_size(uint32_t* state)
+{
+    static const size_t sizes[] = { 8, 18, 64, 64, 256, 512, 1024, 2048, 4096 };
+    uint32_t r = bench_rand(state);
+    return sizes[r % (sizeof(sizes) / sizeof(sizes[0]))] - (r >> 8) % 8;
+}
+
+// Largest single allocation that still succeeds, found by bisection.
+static size_t bench_largest(void* heap, bench_alloc_fn alloc_fn, bench_free_fn free_fn)
+{
+    size_t low = 0;
+    size_t high = POOL_SIZE;
+
+    while (low + 1 < high)
+    {
+        size_t mid = (low + high) / 2;
+        void* obj = alloc_fn(heap, mid);
+
+        if (obj != NULL)
+        {
+            free_fn(heap, obj);
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static bench_result_t bench_run(void* heap, bench_alloc_fn alloc_fn, bench_free_fn free_fn)
+{
+    void* live[LIVE_SLOTS] = { 0 };
+    size_t live_size[LIVE_SLOTS] = { 0 };
+    uint32_t state = 0x12345678;
+    bench_result_t result = { 0 };
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < OPS; ++i)
+    {
+        uint32_t slot = bench_rand(&state) % LIVE_SLOTS;
+
+        if (live[slot] != NULL)
+        {
+            // Check that no other allocation overwrote this one.
+            assert_int_eq(((uint8_t*)live[slot])[live_size[slot] - 1], (uint8_t)slot);
+            free_fn(heap, live[slot]);
+            live[slot] = NULL;
+        }
+        else
+        {
+            size_t size = bench_size(&state);
+            live[slot] = alloc_fn(heap, size);
+
+            if (live[slot] == NULL)
+            {
+                result.failures++;
+            }
+            else
+            {
+                live_size[slot] = size;
+                memset(live[slot], (uint8_t)slot, size);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result.ns_per_op
+        = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (double)OPS;
+    result.largest = bench_largest(heap, alloc_fn, free_fn);
+
+    for (size_t i = 0; i < LIVE_SLOTS; ++i)
+    {
+        if (live[i] != NULL)
+        {
+            free_fn(heap, live[i]);
+        }
+    }
+
+    return result;
+}
+
+test(test_heap_bench_fragmentation)
+{
+    static uint64_t tlsf_mem[POOL_SIZE / sizeof(uint64_t)];
+    static uint64_t ff_mem[POOL_SIZE / sizeof(uint64_t)];
+    heap_t tlsf;
+    ff_heap_t ff;
+
+    assert_int_eq(init_heap(&tlsf, tlsf_mem, POOL_SIZE, 8), 0);
+    ff_init(&ff, ff_mem, POOL_SIZE, 8);
+
+    bench_result_t tlsf_res = bench_run(&tlsf, tlsf_bench_alloc, tlsf_bench_free);
+    bench_result_t ff_res = bench_run(&ff, ff_bench_alloc, ff_bench_free);
+
+    printf("\t\t%-10s %10s %10s %14s\n", "heap", "ns/op", "failures", "largest free");
+    printf("\t\t%-10s %10.1f %10zu %14zu\n", "tlsf", tlsf_res.ns_per_op, tlsf_res.failures,
+        tlsf_res.largest);
+    printf("\t\t%-10s %10.1f %10zu %14zu\n", "first-fit", ff_res.ns_per_op, ff_res.failures,
+        ff_res.largest);
+
+    // With everything freed the TLSF heap must have merged back into a single block.
+    assert_int_eq(heap_alloc(&tlsf, POOL_SIZE - 2 * sizeof(heap_node_t)) != NULL, 1);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_heap_bench_fragmentation);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
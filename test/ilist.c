@@ -0,0 +1,119 @@
+#include "ilist.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct item
+{
+    int value;
+    ilist_node_t node;
+} item_t;
+
+test(test_ilist_create_no_list)
+{
+    assert_int_eq(ilist_init(NULL), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_ilist_push_rem)
+{
+    ilist_t list;
+    item_t a = { .value = 0 };
+    item_t b = { .value = 1 };
+    item_t c = { .value = 2 };
+
+    assert_int_eq(ilist_init(&list), 0);
+
+    ilist_push(&list, &a.node);
+    ilist_push(&list, &b.node);
+    ilist_push(&list, &c.node);
+
+    assert_int_eq(list.size, 3);
+    assert_ptr_eq(list.first, &a.node);
+    assert_ptr_eq(list.last, &c.node);
+    assert_ptr_eq(ILIST_ENTRY(list.first->next, item_t, node), &b);
+
+    ilist_rem(&list, &b.node);
+
+    assert_int_eq(list.size, 2);
+    assert_ptr_eq(list.first->next, &c.node);
+    assert_ptr_eq(list.last->prev, &a.node);
+
+    ilist_rem(&list, &c.node);
+
+    assert_ptr_eq(list.last, &a.node);
+    assert_ptr_eq(a.node.next, NULL);
+
+    ilist_rem(&list, &a.node);
+
+    assert_int_eq(list.size, 0);
+    assert_ptr_eq(list.first, NULL);
+    assert_ptr_eq(list.last, NULL);
+
+    return 1;
+}
+
+test(test_ilist_push_front_pop)
+{
+    ilist_t list;
+    item_t a = { .value = 0 };
+    item_t b = { .value = 1 };
+
+    assert_int_eq(ilist_init(&list), 0);
+
+    ilist_push(&list, &a.node);
+    ilist_push_front(&list, &b.node);
+
+    assert_ptr_eq(ilist_pop_front(&list), &b.node);
+    assert_ptr_eq(ilist_pop_front(&list), &a.node);
+    assert_ptr_eq(ilist_pop_front(&list), NULL);
+
+    return 1;
+}
+
+test(test_ilist_foreach_safe_remove)
+{
+    ilist_t list;
+    item_t items[4];
+
+    assert_int_eq(ilist_init(&list), 0);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        items[i].value = i;
+        ilist_push(&list, &items[i].node);
+    }
+
+    ilist_node_t* cur;
+    ilist_node_t* next;
+    int seen = 0;
+
+    // Remove every item while iterating, every item must still be visited once.
+    ILIST_FOREACH_SAFE(&list, cur, next)
+    {
+        item_t* item = ILIST_ENTRY(cur, item_t, node);
+        assert_int_eq(item->value, seen++);
+        ilist_rem(&list, cur);
+    }
+
+    assert_int_eq(seen, 4);
+    assert_int_eq(list.size, 0);
+    assert_ptr_eq(list.first, NULL);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_ilist_create_no_list);
+    run_test(test_ilist_push_rem);
+    run_test(test_ilist_push_front_pop);
+    run_test(test_ilist_foreach_safe_remove);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -9,7 +9,9 @@ test(test_linked_list_create_no_alloc)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(NULL, free, &list), -1);
+    allocator_t allocator = { .alloc = NULL, .free = std_allocator_free, .ctx = NULL };
+
+    assert_int_eq(linked_list_init(&allocator, &list), -1);
     assert_int_eq(errno, EINVAL);
 }
 
@@ -17,7 +19,9 @@ test(test_linked_list_create_no_free)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(malloc, NULL, &list), -1);
+    allocator_t allocator = { .alloc = std_allocator_alloc, .free = NULL, .ctx = NULL };
+
+    assert_int_eq(linked_list_init(&allocator, &list), -1);
     assert_int_eq(errno, EINVAL);
 }
 
@@ -25,7 +29,7 @@ test(test_linked_list_create_no_fn)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(NULL, NULL, &list), -1);
+    assert_int_eq(linked_list_init(NULL, &list), -1);
     assert_int_eq(errno, EINVAL);
 }
 
@@ -33,7 +37,7 @@ test(test_linked_list_create_no_list)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(malloc, free, NULL), -1);
+    assert_int_eq(linked_list_init(&std_allocator, NULL), -1);
     assert_int_eq(errno, EINVAL);
 }
 
@@ -41,7 +45,7 @@ test(test_linked_list_create_multiple)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(malloc, free, &list), 0);
+    assert_int_eq(linked_list_init(&std_allocator, &list), 0);
 
     int a = 0;
     int b = 1;
@@ -95,7 +99,7 @@ test(test_linked_list_iterate)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(malloc, free, &list), 0);
+    assert_int_eq(linked_list_init(&std_allocator, &list), 0);
 
     int a = 0;
     int b = 1;
@@ -140,7 +144,7 @@ test(test_linked_list_iterate_invalidate)
 {
     linked_list_t list;
 
-    assert_int_eq(linked_list_init(malloc, free, &list), 0);
+    assert_int_eq(linked_list_init(&std_allocator, &list), 0);
 
     int a = 0;
     int b = 1;
@@ -156,6 +160,36 @@ test(test_linked_list_iterate_invalidate)
     assert_ptr_eq(linked_list_rem(&list, 0), &c);
 }
 
+test(test_linked_list_pool_allocator)
+{
+    linked_list_t list;
+    mem_pool_t pool;
+    allocator_t allocator;
+    node_t nodes[2];
+
+    assert_int_eq(init_mem_pool(sizeof(node_t), nodes, sizeof(nodes), &pool), 0);
+    assert_int_eq(init_pool_allocator(&allocator, &pool), 0);
+    assert_int_eq(linked_list_init(&allocator, &list), 0);
+
+    int a = 0;
+    int b = 1;
+    int c = 2;
+
+    // Nodes are taken from the pool, a third node does not fit.
+    assert_int_eq(linked_list_push(&list, &a), 0);
+    assert_int_eq(linked_list_push(&list, &b), 0);
+    assert_int_eq(linked_list_push(&list, &c), -1);
+    assert_int_eq(errno, ENOMEM);
+
+    assert_ptr_eq(ILIST_ENTRY(list.nodes.first, node_t, link), &nodes[0]);
+
+    assert_ptr_eq(linked_list_rem(&list, 0), &a);
+    assert_int_eq(linked_list_push(&list, &c), 0);
+    assert_ptr_eq(linked_list_get(&list, 1), &c);
+
+    return 1;
+}
+
 int main(void)
 {
     run_test(test_linked_list_create_no_alloc);
@@ -165,6 +199,7 @@ int main(void)
     run_test(test_linked_list_create_multiple);
     run_test(test_linked_list_iterate);
     run_test(test_linked_list_iterate_invalidate);
+    run_test(test_linked_list_pool_allocator);
 
     printf("Tests finished\n");
 
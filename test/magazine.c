@@ -0,0 +1,291 @@
+#include "magazine.h"
+#include "test.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_THREADS    8
+#define BENCH_ITERATIONS 200000
+#define BENCH_BATCH      8
+#define BENCH_OBJECTS    (BENCH_THREADS * BENCH_BATCH * 4)
+#define OBJ_SIZE         32
+
+typedef struct bench_ctx
+{
+    mag_depot_t* depot;
+    mem_pool_mt_t* pool;
+    uintptr_t id;
+    size_t failures;
+    size_t corrupt;
+} bench_ctx_t;
+
+static uint8_t bench_mem[BENCH_OBJECTS * OBJ_SIZE];
+static magazine_t bench_mags[BENCH_THREADS * 2 + BENCH_OBJECTS / MAGAZINE_SIZE];
+
+test(test_mag_cache_no_magazines)
+{
+    mem_pool_mt_t pool;
+    mag_depot_t depot;
+    mag_cache_t cache;
+    magazine_t mags[3];
+    uint8_t mem[OBJ_SIZE * 4];
+
+    assert_int_eq(init_mag_depot(&depot, NULL, mags, 3), -1);
+    assert_int_eq(errno, EINVAL);
+
+    assert_int_eq(init_mem_pool_mt(OBJ_SIZE, mem, sizeof(mem), &pool), 0);
+    assert_int_eq(init_mag_depot(&depot, &pool, mags, 3), 0);
+    assert_int_eq(init_mag_cache(&cache, &depot), 0);
+
+    // A single magazine left is not enough for a second cache and must stay in the depot.
+    mag_cache_t other;
+    assert_int_eq(init_mag_cache(&other, &depot), -1);
+    assert_int_eq(errno, ENOMEM);
+    assert_ptr_eq(depot.empty, &mags[0]);
+
+    return 1;
+}
+
+test(test_mag_cache_alloc_free)
+{
+    mem_pool_mt_t pool;
+    mag_depot_t depot;
+    mag_cache_t cache;
+    magazine_t mags[3];
+    uint8_t mem[OBJ_SIZE * MAGAZINE_SIZE * 3];
+    void* objs[MAGAZINE_SIZE * 3];
+
+    assert_int_eq(init_mem_pool_mt(OBJ_SIZE, mem, sizeof(mem), &pool), 0);
+    assert_int_eq(init_mag_depot(&depot, &pool, mags, 3), 0);
+    assert_int_eq(init_mag_cache(&cache, &depot), 0);
+
+    for (size_t i = 0; i < MAGAZINE_SIZE * 3; ++i)
+    {
+        objs[i] = mag_cache_alloc(&cache);
+        assert_ptr_eq(objs[i], mem + OBJ_SIZE * i);
+    }
+
+    assert_ptr_eq(mag_cache_alloc(&cache), NULL);
+
+    // Two magazines fill up in the cache, the third is exchanged with the depot.
+    for (size_t i = 0; i < MAGAZINE_SIZE * 3; ++i)
+    {
+        mag_cache_free(&cache, objs[i]);
+    }
+
+    assert_ptr_eq(depot.empty, NULL);
+    assert_int_eq(depot.full != NULL, 1);
+    assert_int_eq(cache.loaded->rounds, MAGAZINE_SIZE);
+    assert_int_eq(cache.previous->rounds, MAGAZINE_SIZE);
+
+    // Nothing went back to the pool, objects are served from the cache last in first out.
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+    assert_ptr_eq(mag_cache_alloc(&cache), objs[MAGAZINE_SIZE * 3 - 1]);
+    mag_cache_free(&cache, objs[MAGAZINE_SIZE * 3 - 1]);
+
+    mag_cache_release(&cache);
+
+    assert_ptr_eq(cache.loaded, NULL);
+
+    for (size_t i = 0; i < MAGAZINE_SIZE * 2; ++i)
+    {
+        assert_int_eq(mem_pool_mt_alloc(&pool) != NULL, 1);
+    }
+
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+
+    return 1;
+}
+
+test(test_mag_cache_full_exchange)
+{
+    mem_pool_mt_t pool;
+    mag_depot_t depot;
+    mag_cache_t producer, consumer;
+    magazine_t mags[5];
+    uint8_t mem[OBJ_SIZE * MAGAZINE_SIZE * 3];
+    void* objs[MAGAZINE_SIZE * 3];
+
+    assert_int_eq(init_mem_pool_mt(OBJ_SIZE, mem, sizeof(mem), &pool), 0);
+    assert_int_eq(init_mag_depot(&depot, &pool, mags, 5), 0);
+    assert_int_eq(init_mag_cache(&producer, &depot), 0);
+    assert_int_eq(init_mag_cache(&consumer, &depot), 0);
+
+    for (size_t i = 0; i < MAGAZINE_SIZE * 3; ++i)
+    {
+        objs[i] = mag_cache_alloc(&producer);
+    }
+
+    for (size_t i = 0; i < MAGAZINE_SIZE * 3; ++i)
+    {
+        mag_cache_free(&producer, objs[i]);
+    }
+
+    // The pool is empty, the consumer takes the full magazine handed to the depot by the producer.
+    assert_ptr_eq(mag_cache_alloc(&consumer), objs[MAGAZINE_SIZE - 1]);
+    assert_ptr_eq(depot.full, NULL);
+
+    return 1;
+}
+
+static void* cache_worker(void* arg)
+{
+    bench_ctx_t* ctx = arg;
+    mag_cache_t cache;
+    uintptr_t* objs[BENCH_BATCH];
+
+    if (init_mag_cache(&cache, ctx->depot) != 0)
+    {
+        ctx->failures++;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        size_t count = 0;
+
+        for (; count < BENCH_BATCH; ++count)
+        {
+            objs[count] = mag_cache_alloc(&cache);
+
+            if (objs[count] == NULL)
+            {
+                ctx->failures++;
+                break;
+            }
+
+            objs[count][0] = ctx->id;
+        }
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            if (objs[j][0] != ctx->id)
+            {
+                ctx->corrupt++;
+            }
+
+            mag_cache_free(&cache, objs[j]);
+        }
+    }
+
+    mag_cache_release(&cache);
+
+    return NULL;
+}
+
+static void* pool_worker(void* arg)
+{
+    bench_ctx_t* ctx = arg;
+    void* objs[BENCH_BATCH];
+
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        size_t count = 0;
+
+        for (; count < BENCH_BATCH; ++count)
+        {
+            objs[count] = mem_pool_mt_alloc(ctx->pool);
+
+            if (objs[count] == NULL)
+            {
+                ctx->failures++;
+                break;
+            }
+        }
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            mem_pool_mt_free(ctx->pool, objs[j]);
+        }
+    }
+
+    return NULL;
+}
+
+static double run_threads(void* (*worker)(void*), bench_ctx_t* ctxs, size_t thread_count)
+{
+    pthread_t threads[BENCH_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        pthread_create(&threads[i], NULL, worker, &ctxs[i]);
+    }
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+test(test_mag_cache_bench)
+{
+    bench_ctx_t ctxs[BENCH_THREADS];
+    mem_pool_mt_t pool;
+    mag_depot_t depot;
+
+    for (size_t threads = 1; threads <= BENCH_THREADS; threads *= 2)
+    {
+        size_t failures = 0;
+        size_t corrupt = 0;
+
+        assert_int_eq(init_mem_pool_mt(OBJ_SIZE, bench_mem, sizeof(bench_mem), &pool), 0);
+        assert_int_eq(
+            init_mag_depot(&depot, &pool, bench_mags, sizeof(bench_mags) / sizeof(magazine_t)),
+            0);
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            ctxs[i] = (bench_ctx_t) { .depot = &depot, .pool = &pool, .id = i + 1 };
+        }
+
+        double cached = run_threads(cache_worker, ctxs, threads);
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            failures += ctxs[i].failures;
+            corrupt += ctxs[i].corrupt;
+        }
+
+        assert_int_eq(failures, 0);
+        assert_int_eq(corrupt, 0);
+
+        // Releasing every cache returns every object to the pool.
+        for (size_t i = 0; i < BENCH_OBJECTS; ++i)
+        {
+            assert_int_eq(mem_pool_mt_alloc(&pool) != NULL, 1);
+        }
+
+        assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+
+        assert_int_eq(init_mem_pool_mt(OBJ_SIZE, bench_mem, sizeof(bench_mem), &pool), 0);
+
+        double shared = run_threads(pool_worker, ctxs, threads);
+        double ops = threads * BENCH_ITERATIONS * (double)BENCH_BATCH * 2;
+
+        printf("\t\t%zu threads: magazine %.1f Mops/s, shared pool %.1f Mops/s\n", threads,
+            ops / cached / 1e6, ops / shared / 1e6);
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_mag_cache_no_magazines);
+    run_test(test_mag_cache_alloc_free);
+    run_test(test_mag_cache_full_exchange);
+    run_test(test_mag_cache_bench);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
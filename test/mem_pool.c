@@ -132,6 +132,98 @@ test(test_mem_alloc_oob)
     assert_ptr_eq(five, NULL);
 }
 
+test(test_mem_alloc_n_carve)
+{
+    mem_pool_t pool;
+    uint64_t data[4];
+    void* objs[4];
+
+    void* mem = data;
+
+    assert_int_eq(init_mem_pool(sizeof(void*), mem, 32, &pool), 0);
+
+    assert_int_eq(mem_pool_alloc_n(&pool, objs, 3), 3);
+    assert_ptr_eq(objs[0], mem);
+    assert_ptr_eq(objs[1], mem + sizeof(void*));
+    assert_ptr_eq(objs[2], mem + sizeof(void*) * 2);
+
+    // Only one object is left in the pool.
+    assert_int_eq(mem_pool_alloc_n(&pool, objs, 4), 1);
+    assert_ptr_eq(objs[0], mem + sizeof(void*) * 3);
+    assert_int_eq(mem_pool_alloc_n(&pool, objs, 4), 0);
+    assert_ptr_eq(mem_pool_alloc(&pool), NULL);
+
+    return 1;
+}
+
+test(test_mem_alloc_n_free_n)
+{
+    mem_pool_t pool;
+    uint64_t data[4];
+    void* objs[4];
+    void* out[4];
+
+    void* mem = data;
+
+    assert_int_eq(init_mem_pool(sizeof(void*), mem, 32, &pool), 0);
+
+    assert_int_eq(mem_pool_alloc_n(&pool, objs, 2), 2);
+
+    void* two = objs[1];
+
+    mem_pool_free_n(&pool, objs, 1);
+
+    // Freed blocks are taken first, the rest is carved from the untouched tail.
+    assert_int_eq(mem_pool_alloc_n(&pool, out, 3), 3);
+    assert_ptr_eq(out[0], mem);
+    assert_ptr_eq(out[1], mem + sizeof(void*) * 2);
+    assert_ptr_eq(out[2], mem + sizeof(void*) * 3);
+
+    objs[0] = out[2];
+    objs[1] = two;
+    objs[2] = out[0];
+    objs[3] = out[1];
+
+    mem_pool_free_n(&pool, objs, 4);
+    mem_pool_free_n(&pool, objs, 0);
+
+    assert_ptr_eq(mem_pool_alloc(&pool), out[2]);
+    assert_int_eq(mem_pool_alloc_n(&pool, out, 4), 3);
+    assert_ptr_eq(out[0], two);
+    assert_ptr_eq(out[1], mem);
+    assert_ptr_eq(out[2], mem + sizeof(void*) * 2);
+    assert_ptr_eq(mem_pool_alloc(&pool), NULL);
+
+    return 1;
+}
+
+typedef struct static_obj
+{
+    uint8_t data[3];
+} static_obj_t;
+
+INIT_MEM_POOL(static_pool, static_obj_t, 3);
+
+test(test_mem_pool_static)
+{
+    assert_int_eq(static_pool.obj_size, sizeof(void*));
+    assert_int_eq(static_pool.pool_size, sizeof(void*) * 3);
+
+    uint8_t* one = mem_pool_alloc(&static_pool);
+    uint8_t* two = mem_pool_alloc(&static_pool);
+    uint8_t* three = mem_pool_alloc(&static_pool);
+
+    assert_ptr_eq(one, static_pool.pool_start);
+    assert_ptr_eq(two, one + sizeof(void*));
+    assert_ptr_eq(three, one + sizeof(void*) * 2);
+    assert_ptr_eq(mem_pool_alloc(&static_pool), NULL);
+
+    mem_pool_free(&static_pool, two);
+    assert_ptr_eq(mem_pool_alloc(&static_pool), two);
+
+    return 1;
+}
+
 int main(void)
 {
     run_test(test_mem_pool_create_no_pool_obj);
@@ -142,6 +234,9 @@ int main(void)
     run_test(test_mem_alloc_free);
     run_test(test_mem_alloc_free_unordered);
     run_test(test_mem_alloc_oob);
+    run_test(test_mem_alloc_n_carve);
+    run_test(test_mem_alloc_n_free_n);
+    run_test(test_mem_pool_static);
 
     printf("Tests finished\n");
 
@@ -0,0 +1,276 @@
+#include "mem_pool.h"
+#include "mem_pool_mt.h"
+#include "test.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STRESS_THREADS    8
+#define STRESS_ITERATIONS 100000
+#define STRESS_BATCH      8
+#define STRESS_OBJECTS    (STRESS_THREADS * STRESS_BATCH / 2)
+#define OBJ_SIZE          32
+
+typedef struct stress_ctx
+{
+    mem_pool_mt_t* pool;
+    pthread_mutex_t* lock;
+    mem_pool_t* locked_pool;
+    uintptr_t id;
+    size_t iterations;
+    size_t failures;
+    size_t corrupt;
+} stress_ctx_t;
+
+static uint8_t stress_mem[STRESS_OBJECTS * OBJ_SIZE];
+
+test(test_mem_pool_mt_create_no_pool)
+{
+    mem_pool_mt_t pool;
+    uint64_t mem[2];
+
+    assert_int_eq(init_mem_pool_mt(sizeof(void*), NULL, sizeof(mem), &pool), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_mem_pool_mt(sizeof(void*), mem, sizeof(mem), NULL), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(init_mem_pool_mt(sizeof(void*), mem, sizeof(void*) / 2, &pool), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_mem_pool_mt_alloc_free)
+{
+    mem_pool_mt_t pool;
+    uint8_t mem[sizeof(void*) * 4];
+
+    assert_int_eq(init_mem_pool_mt(sizeof(void*) / 2, mem, sizeof(mem) + 1, &pool), 0);
+    assert_int_eq(pool.obj_size, sizeof(void*));
+    assert_int_eq(pool.pool_size, sizeof(mem));
+
+    void* one = mem_pool_mt_alloc(&pool);
+    void* two = mem_pool_mt_alloc(&pool);
+    void* three = mem_pool_mt_alloc(&pool);
+    void* four = mem_pool_mt_alloc(&pool);
+
+    assert_ptr_eq(one, mem);
+    assert_ptr_eq(two, mem + sizeof(void*));
+    assert_ptr_eq(three, mem + sizeof(void*) * 2);
+    assert_ptr_eq(four, mem + sizeof(void*) * 3);
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+
+    mem_pool_mt_free(&pool, two);
+    mem_pool_mt_free(&pool, four);
+
+    // Freed objects are reused last in first out.
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), four);
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), two);
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+
+    return 1;
+}
+
+static void* stress_worker(void* arg)
+{
+    stress_ctx_t* ctx = arg;
+    uintptr_t* objs[STRESS_BATCH];
+
+    for (size_t i = 0; i < ctx->iterations; ++i)
+    {
+        size_t count = 0;
+
+        for (; count < STRESS_BATCH; ++count)
+        {
+            objs[count] = mem_pool_mt_alloc(ctx->pool);
+
+            if (objs[count] == NULL)
+            {
+                ctx->failures++;
+                break;
+            }
+
+            for (size_t w = 0; w < OBJ_SIZE / sizeof(uintptr_t); ++w)
+            {
+                objs[count][w] = ctx->id;
+            }
+        }
+
+        // An object handed to two threads at once would be overwritten by the other owner.
+        for (size_t j = 0; j < count; ++j)
+        {
+            for (size_t w = 0; w < OBJ_SIZE / sizeof(uintptr_t); ++w)
+            {
+                if (objs[j][w] != ctx->id)
+                {
+                    ctx->corrupt++;
+                }
+            }
+
+            mem_pool_mt_free(ctx->pool, objs[j]);
+        }
+    }
+
+    return NULL;
+}
+
+static void* locked_worker(void* arg)
+{
+    stress_ctx_t* ctx = arg;
+    void* objs[STRESS_BATCH];
+
+    for (size_t i = 0; i < ctx->iterations; ++i)
+    {
+        size_t count = 0;
+
+        for (; count < STRESS_BATCH; ++count)
+        {
+            pthread_mutex_lock(ctx->lock);
+            objs[count] = mem_pool_alloc(ctx->locked_pool);
+            pthread_mutex_unlock(ctx->lock);
+
+            if (objs[count] == NULL)
+            {
+                ctx->failures++;
+                break;
+            }
+        }
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            pthread_mutex_lock(ctx->lock);
+            mem_pool_free(ctx->locked_pool, objs[j]);
+            pthread_mutex_unlock(ctx->lock);
+        }
+    }
+
+    return NULL;
+}
+
+static double run_threads(void* (*worker)(void*), stress_ctx_t* ctxs, size_t thread_count)
+{
+    pthread_t threads[STRESS_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        pthread_create(&threads[i], NULL, worker, &ctxs[i]);
+    }
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+test(test_mem_pool_mt_stress)
+{
+    mem_pool_mt_t pool;
+    stress_ctx_t ctxs[STRESS_THREADS];
+    size_t failures = 0;
+    size_t corrupt = 0;
+
+    assert_int_eq(init_mem_pool_mt(OBJ_SIZE, stress_mem, sizeof(stress_mem), &pool), 0);
+
+    for (size_t i = 0; i < STRESS_THREADS; ++i)
+    {
+        ctxs[i] = (stress_ctx_t) {
+            .pool = &pool,
+            .id = i + 1,
+            .iterations = STRESS_ITERATIONS,
+        };
+    }
+
+    double secs = run_threads(stress_worker, ctxs, STRESS_THREADS);
+
+    for (size_t i = 0; i < STRESS_THREADS; ++i)
+    {
+        failures += ctxs[i].failures;
+        corrupt += ctxs[i].corrupt;
+    }
+
+    printf("\t\t%d threads, %.1f Mops/s, %zu exhausted batches\n", STRESS_THREADS,
+        STRESS_THREADS * STRESS_ITERATIONS * (double)STRESS_BATCH * 2 / secs / 1e6, failures);
+
+    assert_int_eq(corrupt, 0);
+
+    // Every object must be back on the free list exactly once.
+    void* objs[STRESS_OBJECTS];
+
+    for (size_t i = 0; i < STRESS_OBJECTS; ++i)
+    {
+        objs[i] = mem_pool_mt_alloc(&pool);
+        assert_int_eq(objs[i] != NULL, 1);
+
+        for (size_t j = 0; j < i; ++j)
+        {
+            assert_int_eq(objs[i] != objs[j], 1);
+        }
+    }
+
+    assert_ptr_eq(mem_pool_mt_alloc(&pool), NULL);
+
+    return 1;
+}
+
+test(test_mem_pool_mt_throughput)
+{
+    stress_ctx_t ctxs[STRESS_THREADS];
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    mem_pool_mt_t pool;
+    mem_pool_t locked_pool;
+
+    for (size_t threads = 1; threads <= STRESS_THREADS; threads *= 2)
+    {
+        assert_int_eq(init_mem_pool_mt(OBJ_SIZE, stress_mem, sizeof(stress_mem), &pool), 0);
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            ctxs[i] = (stress_ctx_t) {
+                .pool = &pool,
+                .id = i + 1,
+                .iterations = STRESS_ITERATIONS,
+            };
+        }
+
+        double lock_free = run_threads(stress_worker, ctxs, threads);
+
+        assert_int_eq(init_mem_pool(OBJ_SIZE, stress_mem, sizeof(stress_mem), &locked_pool), 0);
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            ctxs[i] = (stress_ctx_t) {
+                .lock = &lock,
+                .locked_pool = &locked_pool,
+                .iterations = STRESS_ITERATIONS,
+            };
+        }
+
+        double locked = run_threads(locked_worker, ctxs, threads);
+        double ops = threads * STRESS_ITERATIONS * (double)STRESS_BATCH * 2;
+
+        printf("\t\t%zu threads: lock-free %.1f Mops/s, mutex %.1f Mops/s\n", threads,
+            ops / lock_free / 1e6, ops / locked / 1e6);
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_mem_pool_mt_create_no_pool);
+    run_test(test_mem_pool_mt_alloc_free);
+    run_test(test_mem_pool_mt_stress);
+    run_test(test_mem_pool_mt_throughput);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include "queue.h"
 #include "test.h"
+#include <errno.h>
 #include <string.h>
 
 test(test_msg_fifo_init)
@@ -315,6 +316,88 @@ test(test_stream_fifo_pop_wraparound)
     return 1;
 }
 
+test(test_stream_fifo_push_full)
+{
+    stream_fifo_t queue;
+    uint8_t buf[64];
+    uint8_t msg[64];
+    uint8_t out_msg[64];
+
+    for (size_t i = 0; i < 64; ++i)
+    {
+        msg[i] = i;
+    }
+
+    assert_int_eq(stream_fifo_init(&queue, buf, 64), 0);
+
+    // Consecutive pushes use the free space, not the used space.
+    assert_int_eq(stream_fifo_push(&queue, msg, 16), 16);
+    assert_int_eq(stream_fifo_push(&queue, msg + 16, 40), 40);
+    assert_int_eq(stream_fifo_push(&queue, msg, 16), -ENOBUFS);
+    assert_int_eq(stream_fifo_push(&queue, msg + 56, 8), 8);
+    assert_int_eq(stream_fifo_length(&queue), 64);
+    assert_int_eq(stream_fifo_push(&queue, msg, 1), -ENOBUFS);
+
+    assert_int_eq(stream_fifo_pop(&queue, out_msg, 24), 24);
+    assert_int_eq(memcmp(out_msg, msg, 24), 0);
+
+    // Wraps around the end of the buffer.
+    assert_int_eq(stream_fifo_push(&queue, msg, 24), 24);
+    assert_int_eq(stream_fifo_length(&queue), 64);
+    assert_int_eq(stream_fifo_pop(&queue, out_msg, 64), 64);
+    assert_int_eq(memcmp(out_msg, msg + 24, 40), 0);
+    assert_int_eq(memcmp(out_msg + 40, msg, 24), 0);
+    assert_int_eq(stream_fifo_length(&queue), 0);
+
+    return 1;
+}
+
+test(test_stream_fifo_reserve_commit)
+{
+    stream_fifo_t queue;
+    uint8_t buf[64];
+    uint8_t out_msg[64];
+    size_t len;
+
+    assert_int_eq(stream_fifo_init(&queue, buf, 64), 0);
+
+    uint8_t* dest = stream_fifo_reserve(&queue, &len);
+    assert_ptr_eq(dest, buf);
+    assert_int_eq(len, 64);
+
+    memset(dest, 0x11, 40);
+    stream_fifo_commit(&queue, 40);
+    assert_int_eq(stream_fifo_length(&queue), 40);
+    assert_int_eq(stream_fifo_space(&queue), 24);
+
+    assert_int_eq(stream_fifo_pop(&queue, out_msg, 30), 30);
+
+    // Only the space up to the end of the buffer is contiguous.
+    dest = stream_fifo_reserve(&queue, &len);
+    assert_ptr_eq(dest, buf + 40);
+    assert_int_eq(len, 24);
+
+    memset(dest, 0x22, 24);
+    stream_fifo_commit(&queue, 24);
+
+    dest = stream_fifo_reserve(&queue, &len);
+    assert_ptr_eq(dest, buf);
+    assert_int_eq(len, 30);
+
+    memset(dest, 0x33, 30);
+    stream_fifo_commit(&queue, 30);
+
+    dest = stream_fifo_reserve(&queue, &len);
+    assert_int_eq(len, 0);
+
+    assert_int_eq(stream_fifo_pop(&queue, out_msg, 64), 64);
+    assert_int_eq(out_msg[0], 0x11);
+    assert_int_eq(out_msg[10], 0x22);
+    assert_int_eq(out_msg[34], 0x33);
+
+    return 1;
+}
+
 int main(void)
 {
     run_test(test_msg_fifo_init);
@@ -332,6 +415,8 @@ int main(void)
     run_test(test_stream_fifo_pop);
     run_test(test_stream_fifo_pop_empty);
     run_test(test_stream_fifo_pop_wraparound);
+    run_test(test_stream_fifo_push_full);
+    run_test(test_stream_fifo_reserve_commit);
 
     printf("Tests finished\n");
 
@@ -0,0 +1,127 @@
+#include "slab.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+test(test_slab_create_no_slab)
+{
+    uint64_t mem[16];
+    size_t counts[] = { 2 };
+
+    assert_int_eq(slab_init(NULL, mem, sizeof(mem), 8, counts, 1), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_slab_create_bad_min_size)
+{
+    slab_t slab;
+    uint64_t mem[16];
+    size_t counts[] = { 2 };
+
+    assert_int_eq(slab_init(&slab, mem, sizeof(mem), 12, counts, 1), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(slab_init(&slab, mem, sizeof(mem), sizeof(void*) / 2, counts, 1), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_slab_create_region_too_small)
+{
+    slab_t slab;
+    uint64_t mem[4];
+    size_t counts[] = { 2, 2 };
+
+    assert_int_eq(slab_region_size(8, counts, 2), 48);
+    assert_int_eq(slab_init(&slab, mem, sizeof(mem), 8, counts, 2), -1);
+    assert_int_eq(errno, ERANGE);
+
+    return 1;
+}
+
+test(test_slab_alloc_size_classes)
+{
+    slab_t slab;
+    uint64_t mem[64];
+    size_t counts[] = { 2, 2, 2 };
+
+    assert_int_eq(slab_init(&slab, mem, sizeof(mem), 8, counts, 3), 0);
+
+    void* small = slab_alloc(&slab, 3);
+    void* medium = slab_alloc(&slab, 9);
+    void* large = slab_alloc(&slab, 32);
+
+    assert_ptr_eq(small, mem);
+    assert_ptr_eq(medium, (uint8_t*)mem + 8 * 2);
+    assert_ptr_eq(large, (uint8_t*)mem + 8 * 2 + 16 * 2);
+    assert_int_eq(slab_obj_size(&slab, small), 8);
+    assert_int_eq(slab_obj_size(&slab, medium), 16);
+    assert_int_eq(slab_obj_size(&slab, large), 32);
+
+    assert_ptr_eq(slab_alloc(&slab, 33), NULL);
+    assert_int_eq(errno, ENOMEM);
+
+    slab_free(&slab, medium);
+
+    assert_ptr_eq(slab_alloc(&slab, 16), medium);
+
+    return 1;
+}
+
+test(test_slab_alloc_spill)
+{
+    slab_t slab;
+    uint64_t mem[64];
+    size_t counts[] = { 1, 1, 0, 1 };
+    slab_class_stats_t stats;
+
+    assert_int_eq(slab_init(&slab, mem, sizeof(mem), 8, counts, 4), 0);
+
+    void* one = slab_alloc(&slab, 8);
+    // The 8 byte class is exhausted, the request is served by the 16 byte class.
+    void* two = slab_alloc(&slab, 8);
+    // The 32 byte class is empty, the request is served by the 64 byte class.
+    void* three = slab_alloc(&slab, 20);
+
+    assert_int_eq(slab_obj_size(&slab, two), 16);
+    assert_int_eq(slab_obj_size(&slab, three), 64);
+    assert_ptr_eq(slab_alloc(&slab, 8), NULL);
+
+    assert_int_eq(slab_get_stats(&slab, 0, &stats), 0);
+    assert_int_eq(stats.obj_size, 8);
+    assert_int_eq(stats.capacity, 1);
+    assert_int_eq(stats.in_use, 1);
+    assert_int_eq(stats.spills, 1);
+    assert_int_eq(stats.failures, 1);
+
+    assert_int_eq(slab_get_stats(&slab, 1, &stats), 0);
+    assert_int_eq(stats.in_use, 1);
+    assert_int_eq(stats.peak, 1);
+
+    slab_free(&slab, two);
+
+    assert_int_eq(slab_get_stats(&slab, 1, &stats), 0);
+    assert_int_eq(stats.in_use, 0);
+    assert_int_eq(stats.peak, 1);
+
+    assert_int_eq(slab_get_stats(&slab, 4, &stats), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_slab_create_no_slab);
+    run_test(test_slab_create_bad_min_size);
+    run_test(test_slab_create_region_too_small);
+    run_test(test_slab_alloc_size_classes);
+    run_test(test_slab_alloc_spill);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include "slot_map.h"
+#include "test.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+test(test_slot_map_create_no_map)
+{
+    slot_map_entry_t entries[4];
+
+    assert_int_eq(slot_map_init(NULL, entries, 4), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_slot_map_create_no_entries)
+{
+    slot_map_t map;
+
+    assert_int_eq(slot_map_init(&map, NULL, 4), -1);
+    assert_int_eq(errno, EINVAL);
+    assert_int_eq(slot_map_init(&map, (slot_map_entry_t*)&map, 0), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_slot_map_insert_get)
+{
+    slot_map_t map;
+    slot_map_entry_t entries[4];
+    int a = 0;
+    int b = 1;
+
+    assert_int_eq(slot_map_init(&map, entries, 4), 0);
+
+    slot_handle_t ha = slot_map_insert(&map, &a);
+    slot_handle_t hb = slot_map_insert(&map, &b);
+
+    assert_int_eq(ha != SLOT_HANDLE_INVALID, 1);
+    assert_int_eq(hb != SLOT_HANDLE_INVALID, 1);
+    assert_int_eq(map.size, 2);
+    assert_ptr_eq(slot_map_get(&map, ha), &a);
+    assert_ptr_eq(slot_map_get(&map, hb), &b);
+    assert_ptr_eq(slot_map_get(&map, SLOT_HANDLE_INVALID), NULL);
+
+    return 1;
+}
+
+test(test_slot_map_stale_handle)
+{
+    slot_map_t map;
+    slot_map_entry_t entries[4];
+    int a = 0;
+    int b = 1;
+
+    assert_int_eq(slot_map_init(&map, entries, 4), 0);
+
+    slot_handle_t ha = slot_map_insert(&map, &a);
+
+    assert_ptr_eq(slot_map_remove(&map, ha), &a);
+    assert_ptr_eq(slot_map_get(&map, ha), NULL);
+    assert_ptr_eq(slot_map_remove(&map, ha), NULL);
+
+    // The slot is reused with a new generation, the old handle stays stale.
+    slot_handle_t hb = slot_map_insert(&map, &b);
+
+    assert_int_eq(SLOT_HANDLE_INDEX(hb), SLOT_HANDLE_INDEX(ha));
+    assert_int_eq(hb != ha, 1);
+    assert_ptr_eq(slot_map_get(&map, ha), NULL);
+    assert_ptr_eq(slot_map_get(&map, hb), &b);
+
+    return 1;
+}
+
+test(test_slot_map_full)
+{
+    slot_map_t map;
+    slot_map_entry_t entries[2];
+    int objs[3];
+
+    assert_int_eq(slot_map_init(&map, entries, 2), 0);
+
+    assert_int_eq(slot_map_insert(&map, &objs[0]) != SLOT_HANDLE_INVALID, 1);
+    assert_int_eq(slot_map_insert(&map, &objs[1]) != SLOT_HANDLE_INVALID, 1);
+    assert_int_eq(slot_map_insert(&map, &objs[2]), SLOT_HANDLE_INVALID);
+    assert_int_eq(errno, ENOMEM);
+
+    return 1;
+}
+
+test(test_slot_map_iterate_remove)
+{
+    slot_map_t map;
+    slot_map_entry_t entries[8];
+    int objs[8];
+    slot_handle_t handles[8];
+
+    assert_int_eq(slot_map_init(&map, entries, 8), 0);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        objs[i] = i;
+        handles[i] = slot_map_insert(&map, &objs[i]);
+    }
+
+    size_t i;
+    int visited = 0;
+    int sum = 0;
+
+    // Remove every odd object while iterating, every object must be visited once.
+    SLOT_MAP_FOREACH(&map, i)
+    {
+        int* obj = slot_map_at(&map, i);
+        visited++;
+        sum += *obj;
+
+        if (*obj % 2)
+        {
+            assert_ptr_eq(slot_map_remove(&map, slot_map_handle_at(&map, i)), obj);
+        }
+    }
+
+    assert_int_eq(visited, 8);
+    assert_int_eq(sum, 28);
+    assert_int_eq(map.size, 4);
+
+    for (int j = 0; j < 8; ++j)
+    {
+        assert_ptr_eq(slot_map_get(&map, handles[j]), (j % 2) ? NULL : &objs[j]);
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_slot_map_create_no_map);
+    run_test(test_slot_map_create_no_entries);
+    run_test(test_slot_map_insert_get);
+    run_test(test_slot_map_stale_handle);
+    run_test(test_slot_map_full);
+    run_test(test_slot_map_iterate_remove);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
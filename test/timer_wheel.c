@@ -0,0 +1,167 @@
+#include "test.h"
+#include "timer_wheel.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct item
+{
+    uint64_t fired_at;
+    size_t fired;
+    wheel_timer_t timer;
+} item_t;
+
+static timer_wheel_t wheel;
+
+static void on_expire(wheel_timer_t* timer)
+{
+    item_t* item = WHEEL_TIMER_ENTRY(timer, item_t, timer);
+
+    item->fired_at = wheel.now;
+    item->fired++;
+}
+
+static void init_item(item_t* item)
+{
+    item->fired_at = 0;
+    item->fired = 0;
+    item->timer = (wheel_timer_t) { .callback = on_expire };
+}
+
+test(test_timer_wheel_create_no_wheel)
+{
+    assert_int_eq(timer_wheel_init(NULL, 0), -1);
+    assert_int_eq(errno, EINVAL);
+
+    return 1;
+}
+
+test(test_timer_wheel_expire_in_order)
+{
+    static item_t items[5];
+    const uint64_t ticks[5] = { 1, 63, 64, 5000, 300000 };
+
+    assert_int_eq(timer_wheel_init(&wheel, 1000), 0);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        init_item(&items[i]);
+        timer_wheel_add(&wheel, &items[i].timer, 1000 + ticks[i]);
+        assert_int_eq(wheel_timer_armed(&items[i].timer), 1);
+    }
+
+    assert_int_eq(wheel.count, 5);
+
+    // Every timer is moved down the levels and expires exactly at its tick.
+    for (uint64_t now = 1000; now <= 1000 + 300000; now += 7)
+    {
+        timer_wheel_advance(&wheel, now);
+
+        for (size_t i = 0; i < 5; ++i)
+        {
+            assert_int_eq(items[i].fired, now >= 1000 + ticks[i]);
+        }
+    }
+
+    timer_wheel_advance(&wheel, 1000 + 300000);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        assert_int_eq(items[i].fired_at == 1000 + ticks[i], 1);
+        assert_int_eq(wheel_timer_armed(&items[i].timer), 0);
+    }
+
+    assert_int_eq(wheel.count, 0);
+
+    return 1;
+}
+
+test(test_timer_wheel_cancel_rearm)
+{
+    item_t a;
+    item_t b;
+
+    assert_int_eq(timer_wheel_init(&wheel, 0), 0);
+    init_item(&a);
+    init_item(&b);
+
+    timer_wheel_add(&wheel, &a.timer, 10);
+    timer_wheel_add(&wheel, &b.timer, 10);
+    wheel_timer_cancel(&a.timer);
+    wheel_timer_cancel(&a.timer);
+
+    // Adding an armed timer moves it, ticks that passed expire on the next advance.
+    timer_wheel_add(&wheel, &b.timer, 200);
+    timer_wheel_add(&wheel, &a.timer, 0);
+    assert_int_eq(wheel.count, 2);
+
+    assert_int_eq(timer_wheel_advance(&wheel, 1), 1);
+    assert_int_eq(a.fired, 1);
+    assert_int_eq(timer_wheel_advance(&wheel, 199), 0);
+    assert_int_eq(timer_wheel_advance(&wheel, 200), 1);
+    assert_int_eq(b.fired, 1);
+
+    return 1;
+}
+
+static item_t* cancel_in_callback;
+
+static void cancel_other(wheel_timer_t* timer)
+{
+    on_expire(timer);
+    wheel_timer_cancel(&cancel_in_callback->timer);
+}
+
+test(test_timer_wheel_cancel_from_callback)
+{
+    item_t a;
+    item_t b;
+
+    assert_int_eq(timer_wheel_init(&wheel, 0), 0);
+    init_item(&a);
+    init_item(&b);
+    a.timer.callback = cancel_other;
+    cancel_in_callback = &b;
+
+    // Both expire on the same tick, the first one cancels the second.
+    timer_wheel_add(&wheel, &a.timer, 5);
+    timer_wheel_add(&wheel, &b.timer, 5);
+
+    assert_int_eq(timer_wheel_advance(&wheel, 5), 1);
+    assert_int_eq(a.fired, 1);
+    assert_int_eq(b.fired, 0);
+    assert_int_eq(wheel.count, 0);
+
+    return 1;
+}
+
+test(test_timer_wheel_beyond_range)
+{
+    item_t a;
+    const uint64_t expires = TIMER_WHEEL_RANGE + 12345;
+
+    assert_int_eq(timer_wheel_init(&wheel, 0), 0);
+    init_item(&a);
+
+    // Timers further ahead than the wheel covers still expire at their own tick.
+    timer_wheel_add(&wheel, &a.timer, expires);
+
+    assert_int_eq(timer_wheel_advance(&wheel, expires - 1), 0);
+    assert_int_eq(timer_wheel_advance(&wheel, expires), 1);
+    assert_int_eq(a.fired_at == expires, 1);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_timer_wheel_create_no_wheel);
+    run_test(test_timer_wheel_expire_in_order);
+    run_test(test_timer_wheel_cancel_rearm);
+    run_test(test_timer_wheel_cancel_from_callback);
+    run_test(test_timer_wheel_beyond_range);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
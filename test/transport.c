@@ -0,0 +1,224 @@
+#include "test.h"
+#include "transport_loopback.h"
+#include "transport_sock.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static loopback_t loopback;
+
+static ssize_t write_buf(transport_t* transport, int conn, void* buf, size_t len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return transport_writev(transport, conn, &iov, 1, 0);
+}
+
+test(test_loopback_connect_accept)
+{
+    transport_t transport;
+    uint32_t addr = 1;
+
+    loopback_transport_init(&transport, &loopback);
+
+    assert_int_eq(transport_accept(&transport, &addr), -1);
+    assert_int_eq(errno, EAGAIN);
+
+    int client = loopback_connect(&loopback);
+    int server = transport_accept(&transport, &addr);
+
+    assert_int_eq(client >= 0, 1);
+    assert_int_eq(server >= 0, 1);
+    assert_int_eq(addr, 0);
+    assert_int_eq(transport_accept(&transport, &addr), -1);
+
+    // Every connection is in use.
+    for (size_t i = 1; i < LOOPBACK_MAX_CONNS; ++i)
+    {
+        assert_int_eq(loopback_connect(&loopback) >= 0, 1);
+    }
+
+    assert_int_eq(loopback_connect(&loopback), -1);
+    assert_int_eq(errno, ECONNREFUSED);
+
+    return 1;
+}
+
+test(test_loopback_send_recv)
+{
+    transport_t transport;
+    uint32_t addr;
+    uint8_t buf[16];
+
+    loopback_transport_init(&transport, &loopback);
+
+    int client = loopback_connect(&loopback);
+    int server = transport_accept(&transport, &addr);
+
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), -1);
+    assert_int_eq(errno, EAGAIN);
+    assert_int_eq(transport_poll(&transport, server, POLLIN | POLLOUT), POLLOUT);
+
+    struct iovec iov[2] = {
+        { .iov_base = "abc", .iov_len = 3 },
+        { .iov_base = "defg", .iov_len = 4 },
+    };
+
+    assert_int_eq(transport_writev(&transport, client, iov, 2, TRANSPORT_MORE), 7);
+    assert_int_eq(transport_poll(&transport, server, POLLIN), POLLIN);
+
+    // Peeked data is read again.
+    assert_int_eq(transport_recv(&transport, server, buf, 3, TRANSPORT_PEEK), 3);
+    assert_int_eq(memcmp(buf, "abc", 3), 0);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), 7);
+    assert_int_eq(memcmp(buf, "abcdefg", 7), 0);
+
+    // The other direction is independent.
+    assert_int_eq(write_buf(&transport, server, "xy", 2), 2);
+    assert_int_eq(transport_recv(&transport, client, buf, sizeof(buf), 0), 2);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), -1);
+
+    return 1;
+}
+
+test(test_loopback_full)
+{
+    static uint8_t data[LOOPBACK_BUF_SIZE + 100];
+    transport_t transport;
+    uint32_t addr;
+
+    loopback_transport_init(&transport, &loopback);
+
+    int client = loopback_connect(&loopback);
+    int server = transport_accept(&transport, &addr);
+
+    // Only what fits is sent, like a socket with a full send buffer.
+    assert_int_eq(write_buf(&transport, server, data, sizeof(data)), LOOPBACK_BUF_SIZE);
+    assert_int_eq(write_buf(&transport, server, data, 1), -1);
+    assert_int_eq(errno, EAGAIN);
+    assert_int_eq(transport_poll(&transport, server, POLLOUT), 0);
+
+    assert_int_eq(transport_recv(&transport, client, data, 100, 0), 100);
+    assert_int_eq(write_buf(&transport, server, data, sizeof(data)), 100);
+
+    return 1;
+}
+
+test(test_loopback_sendfile)
+{
+    char path[] = "/tmp/transport_XXXXXX";
+    transport_t transport;
+    uint32_t addr;
+    uint8_t buf[64];
+    off_t offset = 2;
+
+    int fd = mkstemp(path);
+    unlink(path);
+    assert_int_eq(write(fd, "0123456789", 10), 10);
+
+    loopback_transport_init(&transport, &loopback);
+
+    int client = loopback_connect(&loopback);
+    int server = transport_accept(&transport, &addr);
+
+    assert_int_eq(transport_sendfile(&transport, server, fd, &offset, 5), 5);
+    assert_int_eq(offset, 7);
+    assert_int_eq(transport_recv(&transport, client, buf, sizeof(buf), 0), 5);
+    assert_int_eq(memcmp(buf, "23456", 5), 0);
+
+    // The end of the file.
+    offset = 10;
+    assert_int_eq(transport_sendfile(&transport, server, fd, &offset, 5), 0);
+
+    close(fd);
+
+    return 1;
+}
+
+test(test_loopback_close)
+{
+    transport_t transport;
+    uint32_t addr;
+    uint8_t buf[4];
+
+    loopback_transport_init(&transport, &loopback);
+
+    int client = loopback_connect(&loopback);
+    int server = transport_accept(&transport, &addr);
+
+    assert_int_eq(write_buf(&transport, client, "ab", 2), 2);
+    transport_close(&transport, client);
+
+    // Data sent before closing is still read, then the end of the stream.
+    assert_int_eq(transport_poll(&transport, server, POLLIN), POLLIN | POLLHUP);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), 2);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), 0);
+    assert_int_eq(write_buf(&transport, server, "ab", 2), -1);
+    assert_int_eq(errno, EPIPE);
+
+    transport_close(&transport, server);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), -1);
+    assert_int_eq(errno, EBADF);
+
+    // Both ends are closed, the connection is reused.
+    assert_int_eq(loopback_connect(&loopback), client);
+
+    return 1;
+}
+
+test(test_sock_listen_unix)
+{
+    const char* path = "/tmp/transport_test.sock";
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    sock_transport_t sock;
+    transport_t transport;
+    uint32_t peer = 1;
+    uint8_t buf[4];
+
+    sock_transport_init(&transport, &sock);
+    assert_int_eq(sock_transport_listen_unix(&sock, path, 4), 0);
+    assert_int_eq(transport_accept(&transport, &peer), -1);
+    assert_int_eq(errno, EAGAIN);
+
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    strcpy(addr.sun_path, path);
+    assert_int_eq(connect(client, (struct sockaddr*)&addr, sizeof(addr)), 0);
+
+    int server = transport_accept(&transport, &peer);
+    assert_int_eq(server >= 0, 1);
+    assert_int_eq(peer, 0);
+
+    assert_int_eq(send(client, "ab", 2, 0), 2);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), TRANSPORT_PEEK), 2);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), 2);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), -1);
+    assert_int_eq(errno, EAGAIN);
+
+    close(client);
+    assert_int_eq(transport_recv(&transport, server, buf, sizeof(buf), 0), 0);
+
+    transport_close(&transport, server);
+    sock_transport_stop(&sock);
+    unlink(path);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_loopback_connect_accept);
+    run_test(test_loopback_send_recv);
+    run_test(test_loopback_full);
+    run_test(test_loopback_sendfile);
+    run_test(test_loopback_close);
+    run_test(test_sock_listen_unix);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1240 @@
+#include "test.h"
+#include "transport_loopback.h"
+#include "usbip.h"
+#include "usbip_types.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BULK_LENGTH (256 * 1024)
+#define SEND_PART   1000
+
+static usbip_server_t server;
+static vhci_handle_t vhci;
+static usb_dev_t dev;
+static usb_conf_t conf;
+static usb_if_group_t if_grp;
+static usb_if_t data_if;
+static usb_ep_t out_ep;
+static usb_ep_t in_ep;
+static usb_ep_t file_ep;
+static usb_ep_t int_ep;
+static usb_dev_t other_devs[VHCI_MAX_DEVICES - 1];
+
+static size_t out_total = 0;
+static size_t out_max_chunk = 0;
+static uint8_t out_next = 0;
+static int out_corrupt = 0;
+
+static void out_to_device(void* buf, size_t len)
+{
+    uint8_t* data = buf;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        out_corrupt |= data[i] != out_next++;
+    }
+
+    out_total += len;
+    out_max_chunk = (len > out_max_chunk) ? len : out_max_chunk;
+}
+
+static int in_nak = 0;
+
+static ssize_t in_to_host(void* buf, size_t len)
+{
+    uint8_t* data = buf;
+
+    if (in_nak)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        data[i] = i;
+    }
+
+    return len;
+}
+
+static ssize_t int_to_host(void* buf, size_t len)
+{
+    if (in_nak)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    memset(buf, 0xAA, len);
+
+    return len;
+}
+
+static int file_fd = -1;
+static off_t file_pos = 0;
+
+static ssize_t file_to_host(urb_file_region_t* region, size_t len)
+{
+    region->fd = file_fd;
+    region->offset = file_pos;
+    file_pos += len;
+
+    return len;
+}
+
+static int setup_server(void)
+{
+    usb_dev_desc_t desc = {
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 64,
+    };
+    memset(&conf, 0, sizeof(conf));
+    memset(&if_grp, 0, sizeof(if_grp));
+    memset(&data_if, 0, sizeof(data_if));
+    memset(&out_ep, 0, sizeof(out_ep));
+    memset(&in_ep, 0, sizeof(in_ep));
+    memset(&file_ep, 0, sizeof(file_ep));
+    memset(&int_ep, 0, sizeof(int_ep));
+
+    dev = usb_dev_create(&desc, LANG_ID_ENGLISH_US);
+    out_ep.desc.ep_nb = 1;
+    out_ep.desc.dir = USB_EP_OUT;
+    out_ep.desc.txfer_type = USB_EP_BULK;
+    out_ep.to_device = out_to_device;
+    in_ep.desc.ep_nb = 1;
+    in_ep.desc.dir = USB_EP_IN;
+    in_ep.desc.txfer_type = USB_EP_BULK;
+    in_ep.to_host = in_to_host;
+    file_ep.desc.ep_nb = 2;
+    file_ep.desc.dir = USB_EP_IN;
+    file_ep.desc.txfer_type = USB_EP_BULK;
+    file_ep.to_host_file = file_to_host;
+    int_ep.desc.ep_nb = 3;
+    int_ep.desc.dir = USB_EP_IN;
+    int_ep.desc.txfer_type = USB_EP_INT;
+    int_ep.to_host = int_to_host;
+
+    usb_dev_add_config(&dev, &conf);
+    usb_if_grp_add(&if_grp, &data_if);
+    usb_dev_add_if_grp(&dev, 0, &if_grp);
+    usb_if_add_ep(&data_if, &out_ep);
+    usb_if_add_ep(&data_if, &in_ep);
+    usb_if_add_ep(&data_if, &file_ep);
+    usb_if_add_ep(&data_if, &int_ep);
+    dev.cur_config = 0;
+
+    out_total = 0;
+    out_max_chunk = 0;
+    out_next = 0;
+    out_corrupt = 0;
+    in_nak = 0;
+
+    if (vhci_init(&vhci, &std_allocator) || vhci_register_dev(&vhci, &dev))
+    {
+        return -1;
+    }
+
+    return usbip_server_init(&server, &vhci, &std_allocator);
+}
+
+static int add_client(int* client_sock)
+{
+    int socks[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks)
+        || fcntl(socks[0], F_SETFL, fcntl(socks[0], F_GETFL) | O_NONBLOCK)
+        || usbip_server_add_client(&server, socks[0]))
+    {
+        return -1;
+    }
+
+    *client_sock = socks[1];
+
+    return 0;
+}
+
+static int setup(int* client_sock)
+{
+    return (setup_server() || add_client(client_sock)) ? -1 : 0;
+}
+
+// Connects the client over TCP loopback, which supports MSG_ZEROCOPY.
+static int setup_tcp(int* client_sock)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    socklen_t addr_len = sizeof(addr);
+    int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (setup_server() || bind(listen_sock, (struct sockaddr*)&addr, sizeof(addr))
+        || listen(listen_sock, 1)
+        || getsockname(listen_sock, (struct sockaddr*)&addr, &addr_len)
+        || connect(sock, (struct sockaddr*)&addr, sizeof(addr)))
+    {
+        return -1;
+    }
+
+    int server_sock = accept(listen_sock, NULL, NULL);
+    int no_delay = 1;
+    close(listen_sock);
+
+    server.zerocopy_min_bytes = 4096;
+
+    // Like accepted clients, small replies are not held back by Nagle.
+    if (server_sock == -1
+        || setsockopt(server_sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay))
+        || fcntl(server_sock, F_SETFL, fcntl(server_sock, F_GETFL) | O_NONBLOCK)
+        || usbip_server_add_client(&server, server_sock))
+    {
+        return -1;
+    }
+
+    *client_sock = sock;
+
+    return 0;
+}
+
+static void import_dev(int sock)
+{
+    uint8_t import[8 + 32] = { 0 };
+    uint8_t reply[8 + 312];
+    uint16_t* import_hdr = (uint16_t*)import;
+
+    import_hdr[0] = htons(USBIP_VERSION);
+    import_hdr[1] = htons(REQ_IMPORT);
+    strcpy((char*)import + 8, dev.busid);
+
+    send(sock, import, sizeof(import), 0);
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+    recv(sock, reply, sizeof(reply), MSG_DONTWAIT);
+}
+
+static void send_submit_dir(
+    int sock, uint32_t seq_num, uint32_t direction, uint32_t endpoint, uint32_t length)
+{
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)] = { 0 };
+
+    words[0] = htonl(USBIP_CMD_SUBMIT);
+    words[1] = htonl(seq_num);
+    words[3] = htonl(direction);
+    words[4] = htonl(endpoint);
+    words[6] = htonl(length);
+
+    send(sock, words, sizeof(words), 0);
+}
+
+static void send_submit(int sock, uint32_t seq_num, uint32_t endpoint, uint32_t length)
+{
+    send_submit_dir(sock, seq_num, USBIP_DIR_OUT, endpoint, length);
+}
+
+// Receives exactly len bytes, running the server while waiting for them.
+static size_t recv_all(int sock, uint8_t* buf, size_t len)
+{
+    size_t received = 0;
+
+    for (size_t idle = 0; received < len && idle < 100; ++idle)
+    {
+        usbip_server_handle_once(&server);
+
+        ssize_t bytes = recv(sock, buf + received, len - received, MSG_DONTWAIT);
+
+        if (bytes > 0)
+        {
+            received += bytes;
+            idle = 0;
+        }
+    }
+
+    return received;
+}
+
+// Sends the payload in parts, running the server between them.
+static void send_payload(int sock, uint32_t length)
+{
+    uint8_t part[SEND_PART];
+    uint8_t next = 0;
+
+    while (length > 0)
+    {
+        size_t count = (length < SEND_PART) ? length : SEND_PART;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            part[i] = next++;
+        }
+
+        send(sock, part, count, 0);
+        usbip_server_handle_once(&server);
+        length -= count;
+    }
+
+    usbip_server_handle_once(&server);
+}
+
+static int recv_ret_submit(int sock, uint32_t* seq_num, int32_t* status, uint32_t* length)
+{
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)];
+
+    if (recv(sock, words, sizeof(words), MSG_DONTWAIT) != sizeof(words)
+        || ntohl(words[0]) != USBIP_RET_SUBMIT)
+    {
+        return -1;
+    }
+
+    *seq_num = ntohl(words[1]);
+    *status = (int32_t)ntohl(words[5]);
+    *length = ntohl(words[6]);
+
+    return 0;
+}
+
+test(test_usbip_stream_bulk_out)
+{
+    int sock;
+    uint32_t seq_num;
+    int32_t status;
+    uint32_t length;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    send_submit(sock, 1, 1, BULK_LENGTH);
+    send_payload(sock, BULK_LENGTH);
+
+    // The payload reached the endpoint in parts no larger than the staging buffer.
+    assert_int_eq(out_total, BULK_LENGTH);
+    assert_int_eq(out_corrupt, 0);
+    assert_int_eq(out_max_chunk <= VHCI_URB_STREAM_CHUNK, 1);
+
+    assert_int_eq(recv_ret_submit(sock, &seq_num, &status, &length), 0);
+    assert_int_eq(seq_num, 1);
+    assert_int_eq(status, 0);
+    assert_int_eq(length, BULK_LENGTH);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_discard_payload)
+{
+    int sock;
+    uint32_t seq_num;
+    int32_t status;
+    uint32_t length;
+
+    assert_int_eq(setup(&sock), 0);
+
+    // Not imported yet, the payload is skipped.
+    send_submit(sock, 1, 1, 3000);
+    send_payload(sock, 3000);
+
+    assert_int_eq(recv_ret_submit(sock, &seq_num, &status, &length), 0);
+    assert_int_eq(seq_num, 1);
+    assert_int_eq(status, -ENODEV);
+
+    import_dev(sock);
+
+    // No such endpoint, the payload is skipped as well.
+    send_submit(sock, 2, 2, 3000);
+    send_payload(sock, 3000);
+
+    assert_int_eq(recv_ret_submit(sock, &seq_num, &status, &length), 0);
+    assert_int_eq(seq_num, 2);
+    assert_int_eq(status, -EPIPE);
+    assert_int_eq(out_total, 0);
+
+    // The stream is still in sync for the next command.
+    send_submit(sock, 3, 1, 3000);
+    send_payload(sock, 3000);
+
+    assert_int_eq(recv_ret_submit(sock, &seq_num, &status, &length), 0);
+    assert_int_eq(seq_num, 3);
+    assert_int_eq(status, 0);
+    assert_int_eq(out_total, 3000);
+    assert_int_eq(out_corrupt, 0);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_devlist_producer)
+{
+    static uint8_t reply[sizeof(hdr_rep_devlist_t) + VHCI_MAX_DEVICES * USB_DEV_RECORD_SIZE
+        + USB_IF_RECORD_SIZE];
+    uint8_t extra;
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+
+    for (size_t i = 0; i < VHCI_MAX_DEVICES - 1; ++i)
+    {
+        memset(&other_devs[i], 0, sizeof(usb_dev_t));
+        assert_int_eq(vhci_register_dev(&vhci, &other_devs[i]), 0);
+    }
+
+    // The reply is many times the send buffer, it is produced as the client reads it.
+    assert_int_eq(sizeof(reply) > 4 * sizeof(((usbip_client_t*)NULL)->data_stream), 1);
+
+    uint16_t req[4] = { htons(USBIP_VERSION), htons(REQ_DEVLIST), 0, 0 };
+    send(sock, req, sizeof(req), 0);
+
+    assert_int_eq(recv_all(sock, reply, sizeof(reply)), sizeof(reply));
+    assert_int_eq(recv(sock, &extra, 1, MSG_DONTWAIT), -1);
+    assert_int_eq(((usbip_client_t*)slot_map_at(&server.clients, 0))->out_queued, 0);
+
+    hdr_rep_devlist_t* hdr = (hdr_rep_devlist_t*)reply;
+    assert_int_eq(ntohs(hdr->hdr.op_code), REP_DEVLIST);
+    assert_int_eq(ntohl(hdr->dev_count), VHCI_MAX_DEVICES);
+
+    // Every device is listed once.
+    size_t found = 0;
+    uint8_t* record = reply + sizeof(hdr_rep_devlist_t);
+
+    for (size_t i = 0; i < VHCI_MAX_DEVICES; ++i)
+    {
+        uint8_t interfaces = record[USB_DEV_RECORD_SIZE - 1];
+
+        found += strncmp((char*)record + 256, dev.busid, 32) == 0;
+        record += USB_DEV_RECORD_SIZE + interfaces * USB_IF_RECORD_SIZE;
+    }
+
+    assert_int_eq(found, 1);
+    assert_ptr_eq(record, reply + sizeof(reply));
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_large_in_reply)
+{
+    static uint8_t reply[sizeof(hdr_cmd_t) + 4096];
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    send_submit_dir(sock, 7, USBIP_DIR_IN, 1, 4096);
+
+    // Header and data are sent straight from the URB, through a smaller send buffer.
+    assert_int_eq(recv_all(sock, reply, sizeof(reply)), sizeof(reply));
+
+    uint32_t* words = (uint32_t*)reply;
+    assert_int_eq(ntohl(words[0]), USBIP_RET_SUBMIT);
+    assert_int_eq(ntohl(words[1]), 7);
+    assert_int_eq(ntohl(words[5]), 0);
+    assert_int_eq(ntohl(words[6]), 4096);
+
+    for (size_t i = 0; i < 4096; ++i)
+    {
+        assert_int_eq(reply[sizeof(hdr_cmd_t) + i], (uint8_t)i);
+    }
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+// Sends CMD_SUBMIT for GET_DESCRIPTOR(DEVICE) on the control endpoint.
+static void send_get_dev_desc(int sock, uint32_t seq_num)
+{
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)] = { 0 };
+    const uint8_t setup[8] = { 0x80, DEV_REQ_GET_DESC, 0, USB_DESC_TYPE_DEV, 0, 0, 18, 0 };
+
+    words[0] = htonl(USBIP_CMD_SUBMIT);
+    words[1] = htonl(seq_num);
+    words[3] = htonl(USBIP_DIR_IN);
+    words[6] = htonl(18);
+    memcpy(&words[10], setup, sizeof(setup));
+
+    send(sock, words, sizeof(words), 0);
+}
+
+test(test_usbip_coalesce_replies)
+{
+    const size_t reply_size = sizeof(hdr_cmd_t) + 18;
+    uint8_t replies[4 * (sizeof(hdr_cmd_t) + 18)];
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    // A burst of requests is answered within a single iteration.
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        send_get_dev_desc(sock, seq_num);
+    }
+
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv(sock, replies, sizeof(replies), MSG_DONTWAIT), sizeof(replies));
+
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        uint32_t* words = (uint32_t*)(replies + (seq_num - 1) * reply_size);
+
+        assert_int_eq(ntohl(words[0]), USBIP_RET_SUBMIT);
+        assert_int_eq(ntohl(words[1]), seq_num);
+        assert_int_eq(ntohl(words[5]), 0);
+        assert_int_eq(ntohl(words[6]), 18);
+    }
+
+    // Below the minimum the replies are held back until the delay passes.
+    server.flush_min_bytes = 4096;
+    server.flush_max_delay_us = 200000;
+
+    for (uint32_t seq_num = 5; seq_num <= 8; ++seq_num)
+    {
+        send_get_dev_desc(sock, seq_num);
+    }
+
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv(sock, replies, sizeof(replies), MSG_DONTWAIT), -1);
+    assert_int_eq(errno == EAGAIN || errno == EWOULDBLOCK, 1);
+
+    usleep(250000);
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv(sock, replies, sizeof(replies), MSG_DONTWAIT), sizeof(replies));
+    assert_int_eq(ntohl(((uint32_t*)replies)[1]), 5);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_zerocopy_in_reply)
+{
+    const size_t reply_size = sizeof(hdr_cmd_t) + 4096;
+    static uint8_t replies[4 * (sizeof(hdr_cmd_t) + 4096)];
+    int sock;
+
+    assert_int_eq(setup_tcp(&sock), 0);
+
+    usbip_client_t* client = slot_map_at(&server.clients, 0);
+    assert_int_eq(client->zerocopy, 1);
+
+    import_dev(sock);
+
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        send_submit_dir(sock, seq_num, USBIP_DIR_IN, 1, 4096);
+    }
+
+    // The headers go through the send buffer, the data straight from the URBs.
+    assert_int_eq(recv_all(sock, replies, sizeof(replies)), sizeof(replies));
+    assert_int_eq(client->zerocopy_sends > 0, 1);
+
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        uint8_t* reply = replies + (seq_num - 1) * reply_size;
+        uint32_t* words = (uint32_t*)reply;
+
+        assert_int_eq(ntohl(words[0]), USBIP_RET_SUBMIT);
+        assert_int_eq(ntohl(words[1]), seq_num);
+        assert_int_eq(ntohl(words[6]), 4096);
+
+        for (size_t i = 0; i < 4096; ++i)
+        {
+            assert_int_eq(reply[sizeof(hdr_cmd_t) + i], (uint8_t)i);
+        }
+    }
+
+    // The URBs are freed once the kernel reports it no longer reads from them.
+    for (size_t i = 0; i < 100 && client->zerocopy_pending != NULL; ++i)
+    {
+        usleep(1000);
+        usbip_server_handle_once(&server);
+    }
+
+    assert_ptr_eq(client->zerocopy_pending, NULL);
+
+    // Loopback copies the data regardless, later replies take the copying path.
+    assert_int_eq(client->zerocopy, 0);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_file_in_reply)
+{
+    const size_t length = 64 * 1024;
+    static uint8_t reply[sizeof(hdr_cmd_t) + 64 * 1024];
+    static uint8_t data[2 * 64 * 1024];
+    char path[] = "/tmp/usbip_file_XXXXXX";
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    file_fd = mkstemp(path);
+    file_pos = 0;
+    assert_int_eq(file_fd != -1, 1);
+    unlink(path);
+
+    for (size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = i * 7;
+    }
+
+    assert_int_eq(write(file_fd, data, sizeof(data)), sizeof(data));
+
+    // Larger than any transfer buffer, the data never passes through one.
+    assert_int_eq(length > VHCI_URB_BUF_REGION_SIZE / 2, 1);
+
+    for (uint32_t seq_num = 1; seq_num <= 2; ++seq_num)
+    {
+        send_submit_dir(sock, seq_num, USBIP_DIR_IN, 2, length);
+
+        assert_int_eq(recv_all(sock, reply, sizeof(reply)), sizeof(reply));
+
+        uint32_t* words = (uint32_t*)reply;
+        assert_int_eq(ntohl(words[0]), USBIP_RET_SUBMIT);
+        assert_int_eq(ntohl(words[1]), seq_num);
+        assert_int_eq(ntohl(words[5]), 0);
+        assert_int_eq(ntohl(words[6]), length);
+        assert_int_eq(memcmp(reply + sizeof(hdr_cmd_t), data + (seq_num - 1) * length, length), 0);
+    }
+
+    close(sock);
+    close(file_fd);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_backpressure)
+{
+    uint8_t replies[6 * (sizeof(hdr_cmd_t) + 64)];
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    usbip_client_t* client = slot_map_at(&server.clients, 0);
+    server.urb_high_watermark = 4;
+    server.urb_low_watermark = 1;
+    in_nak = 1;
+
+    for (uint32_t seq_num = 1; seq_num <= 6; ++seq_num)
+    {
+        send_submit_dir(sock, seq_num, USBIP_DIR_IN, 1, 64);
+    }
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        usbip_server_handle_once(&server);
+    }
+
+    // Reading stopped at the high watermark, the other requests wait in the socket.
+    assert_int_eq(client->urbs, 4);
+    assert_int_eq(client->requests, 1 + 4);
+    assert_int_eq(client->throttled, 1);
+    assert_int_eq(client->stats.throttle_count, 1);
+
+    usleep(2000);
+    in_nak = 0;
+
+    // Once the URBs complete reading resumes and every request is answered.
+    assert_int_eq(recv_all(sock, replies, sizeof(replies)), sizeof(replies));
+
+    for (uint32_t seq_num = 1; seq_num <= 6; ++seq_num)
+    {
+        uint32_t* words = (uint32_t*)(replies + (seq_num - 1) * (sizeof(hdr_cmd_t) + 64));
+
+        assert_int_eq(ntohl(words[1]), seq_num);
+        assert_int_eq(ntohl(words[6]), 64);
+    }
+
+    assert_int_eq(client->throttled, 0);
+    assert_int_eq(client->stats.throttled_us >= 2000, 1);
+    assert_int_eq(client->urbs, 0);
+    assert_int_eq(client->out_queued, 0);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+// Counts the replies that are ready, without running the server.
+static size_t recv_count(int sock, size_t reply_size)
+{
+    static uint8_t buf[16 * 1024];
+    ssize_t bytes = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+
+    return (bytes > 0) ? bytes / reply_size : 0;
+}
+
+test(test_usbip_fair_share)
+{
+    int bulk_sock;
+    int hid_sock;
+
+    assert_int_eq(setup(&bulk_sock), 0);
+    assert_int_eq(add_client(&hid_sock), 0);
+
+    usbip_client_t* hid = slot_map_at(&server.clients, 1);
+    usbip_client_t* bulk = slot_map_at(&server.clients, 0);
+
+    // Both clients share the device, the bulk endpoint has no data yet.
+    import_dev(bulk_sock);
+    import_dev(hid_sock);
+    server.drr_quantum = 1024;
+    in_nak = 1;
+
+    for (uint32_t seq_num = 1; seq_num <= 8; ++seq_num)
+    {
+        send_submit_dir(bulk_sock, seq_num, USBIP_DIR_IN, 1, 4096);
+        send_get_dev_desc(hid_sock, seq_num);
+    }
+
+    usbip_server_handle_once(&server);
+
+    // The small requests are all answered, a large one is read once every few rounds.
+    assert_int_eq(recv_count(hid_sock, sizeof(hdr_cmd_t) + 18), 8);
+    assert_int_eq(hid->requests, 1 + 8);
+    // A request costs 4144 bytes, so 16 rounds of 1024 bytes read one in every fourth round.
+    assert_int_eq(bulk->requests, 1 + 4);
+    assert_int_eq(bulk->deficit < 0, 1);
+
+    close(bulk_sock);
+    close(hid_sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_rate_limit)
+{
+    uint8_t replies[1024];
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    // Two URBs at once, then one every 50 ms.
+    server.client_limit.urbs_per_sec = 20;
+    server.client_limit.urb_burst = 2;
+
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        send_get_dev_desc(sock, seq_num);
+    }
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        usbip_server_handle_once(&server);
+    }
+
+    // Requests over the limit stay in the socket.
+    assert_int_eq(recv_count(sock, sizeof(hdr_cmd_t) + 18), 2);
+
+    usleep(60000);
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv_count(sock, sizeof(hdr_cmd_t) + 18), 1);
+
+    // The device limit applies as well, 64 bytes at once refilled at 640 bytes per second.
+    server.client_limit.urbs_per_sec = 0;
+    server.dev_limit.bytes_per_sec = 640;
+    server.dev_limit.byte_burst = 64;
+
+    send_submit_dir(sock, 5, USBIP_DIR_IN, 1, 64);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        usbip_server_handle_once(&server);
+    }
+
+    // The last GET_DESCRIPTOR and the IN transfer fit the burst, the IN transfer overdraws it.
+    assert_int_eq(recv(sock, replies, sizeof(replies), MSG_DONTWAIT),
+        sizeof(hdr_cmd_t) + 18 + sizeof(hdr_cmd_t) + 64);
+
+    send_get_dev_desc(sock, 6);
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv_count(sock, sizeof(hdr_cmd_t) + 18), 0);
+
+    usleep(110000);
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+    assert_int_eq(recv_count(sock, sizeof(hdr_cmd_t) + 18), 1);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_out_classes)
+{
+    const size_t bulk_size = sizeof(hdr_cmd_t) + 4096;
+    static uint8_t replies[2 * (sizeof(hdr_cmd_t) + 4096) + sizeof(hdr_cmd_t) + 8];
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+
+    // Two bulk transfers and an interrupt transfer wait for data, in that order.
+    in_nak = 1;
+    send_submit_dir(sock, 1, USBIP_DIR_IN, 1, 4096);
+    send_submit_dir(sock, 2, USBIP_DIR_IN, 1, 4096);
+    send_submit_dir(sock, 3, USBIP_DIR_IN, 3, 8);
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        usbip_server_handle_once(&server);
+    }
+
+    // All complete at once, the interrupt reply only waits for the bulk reply already started.
+    in_nak = 0;
+    assert_int_eq(recv_all(sock, replies, sizeof(replies)), sizeof(replies));
+
+    uint32_t* first = (uint32_t*)replies;
+    uint32_t* second = (uint32_t*)(replies + bulk_size);
+    uint32_t* third = (uint32_t*)(replies + bulk_size + sizeof(hdr_cmd_t) + 8);
+
+    assert_int_eq(ntohl(first[1]), 1);
+    assert_int_eq(ntohl(second[1]), 3);
+    assert_int_eq(ntohl(second[6]), 8);
+    assert_int_eq(replies[bulk_size + sizeof(hdr_cmd_t)], 0xAA);
+    assert_int_eq(ntohl(third[1]), 2);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_admission)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int socks[5];
+
+    assert_int_eq(setup_server(), 0);
+    assert_int_eq(usbip_server_listen(&server, 0), 0);
+    assert_int_eq(
+        getsockname(server.sock_transport.listen_sock, (struct sockaddr*)&addr, &addr_len), 0);
+
+    server.accepts_per_iteration = 2;
+    server.max_clients_per_addr = 3;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        socks[i] = socket(AF_INET, SOCK_STREAM, 0);
+        assert_int_eq(connect(socks[i], (struct sockaddr*)&addr, sizeof(addr)), 0);
+    }
+
+    // The backlog is drained over iterations, a few connections at a time.
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 2);
+
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 3);
+    assert_int_eq(server.reject_count, 2);
+
+    // Connections over the limit get an error for their request instead of a reset.
+    for (size_t i = 3; i < 5; ++i)
+    {
+        uint16_t req[4] = { htons(USBIP_VERSION), htons(REQ_DEVLIST), 0, 0 };
+        hdr_common_t rep;
+        uint8_t extra;
+
+        send(socks[i], req, sizeof(req), 0);
+        usbip_server_handle_once(&server);
+
+        assert_int_eq(recv(socks[i], &rep, sizeof(rep), MSG_WAITALL), sizeof(rep));
+        assert_int_eq(ntohs(rep.op_code), REP_DEVLIST);
+        assert_int_eq(ntohl(rep.status), USBIP_STATUS_ERROR);
+        assert_int_eq(recv(socks[i], &extra, 1, 0), 0);
+    }
+
+    assert_int_eq(server.reject_count, 0);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        close(socks[i]);
+    }
+
+    // Closed clients make room for new connections from the same address.
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 0);
+    sock_transport_stop(&server.sock_transport);
+
+    return 1;
+}
+
+test(test_usbip_set_transport_busy)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    transport_t transport;
+    loopback_t loopback;
+    int socks[2];
+
+    assert_int_eq(setup_server(), 0);
+    assert_int_eq(usbip_server_listen(&server, 0), 0);
+    assert_int_eq(
+        getsockname(server.sock_transport.listen_sock, (struct sockaddr*)&addr, &addr_len), 0);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socks[0] = socket(AF_INET, SOCK_STREAM, 0);
+    assert_int_eq(connect(socks[0], (struct sockaddr*)&addr, sizeof(addr)), 0);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 1);
+
+    // A connected client keeps the transport, and the listening socket, as they are.
+    loopback_transport_init(&transport, &loopback);
+    assert_int_eq(usbip_server_set_transport(&server, &transport), -1);
+    assert_int_eq(errno, EBUSY);
+    assert_int_eq(usbip_server_set_transport(&server, NULL), -1);
+    assert_int_eq(errno, EBUSY);
+
+    socks[1] = socket(AF_INET, SOCK_STREAM, 0);
+    assert_int_eq(connect(socks[1], (struct sockaddr*)&addr, sizeof(addr)), 0);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 2);
+
+    close(socks[0]);
+    close(socks[1]);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 0);
+
+    // Without clients the socket transport is a no-op to select again.
+    assert_int_eq(usbip_server_set_transport(&server, NULL), 0);
+    assert_int_eq(server.sock_transport.listen_sock >= 0, 1);
+    sock_transport_stop(&server.sock_transport);
+
+    return 1;
+}
+
+test(test_usbip_idle_timeout)
+{
+    uint8_t extra;
+    int idle_sock;
+    int sock;
+
+    assert_int_eq(setup_server(), 0);
+    server.idle_timeout_ms = 20;
+    assert_int_eq(add_client(&idle_sock), 0);
+    assert_int_eq(add_client(&sock), 0);
+    import_dev(sock);
+
+    for (size_t i = 0; i < 100 && server.clients.size > 1; ++i)
+    {
+        usleep(1000);
+        usbip_server_handle_once(&server);
+    }
+
+    // The client that imported a device is left alone, the idle one is disconnected.
+    assert_int_eq(server.clients.size, 1);
+    assert_int_eq(((usbip_client_t*)slot_map_at(&server.clients, 0))->imported_devs != NULL, 1);
+    assert_int_eq(recv(idle_sock, &extra, 1, 0), 0);
+
+    usleep(30000);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 1);
+
+    close(idle_sock);
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_urb_timeout)
+{
+    uint32_t seq_num;
+    int32_t status;
+    uint32_t length;
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    server.urb_timeout_ms = 10;
+    import_dev(sock);
+
+    usbip_client_t* client = slot_map_at(&server.clients, 0);
+    in_nak = 1;
+
+    send_submit_dir(sock, 1, USBIP_DIR_IN, 1, 64);
+    usbip_server_handle_once(&server);
+    assert_int_eq(client->urbs, 1);
+
+    int received = -1;
+
+    for (size_t i = 0; i < 100 && received == -1; ++i)
+    {
+        usleep(1000);
+        usbip_server_handle_once(&server);
+        received = recv_ret_submit(sock, &seq_num, &status, &length);
+    }
+
+    // The URB the device never completed is given back to the host with an error.
+    assert_int_eq(received, 0);
+    assert_int_eq(seq_num, 1);
+    assert_int_eq(status, -ETIMEDOUT);
+    assert_int_eq(length, 0);
+    assert_int_eq(client->urbs, 0);
+
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+test(test_usbip_stop_unlinks_urbs)
+{
+    int sock;
+
+    assert_int_eq(setup(&sock), 0);
+    import_dev(sock);
+    in_nak = 1;
+
+    send_submit_dir(sock, 1, USBIP_DIR_IN, 1, 64);
+    send_submit_dir(sock, 2, USBIP_DIR_IN, 1, 64);
+    usbip_server_handle_once(&server);
+
+    vusb_dev_t* vdev = vhci_find_device(&vhci, dev.busid);
+    assert_int_eq(vdev->urb_list.next != NULL, 1);
+
+    // The URBs of a disconnected client do not wait for the device.
+    close(sock);
+    usbip_server_handle_once(&server);
+
+    assert_int_eq(server.clients.size, 0);
+    assert_ptr_eq(vdev->urb_list.next, NULL);
+
+    return 1;
+}
+
+static void send_unlink(int sock, uint32_t seq_num, uint32_t unlink_seq_num)
+{
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)] = { 0 };
+
+    words[0] = htonl(USBIP_CMD_UNLINK);
+    words[1] = htonl(seq_num);
+    words[5] = htonl(unlink_seq_num);
+
+    send(sock, words, sizeof(words), 0);
+}
+
+test(test_usbip_unlink_owner)
+{
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)];
+    uint32_t seq_num;
+    uint32_t length;
+    int32_t status;
+    int sock_a;
+    int sock_b;
+
+    assert_int_eq(setup(&sock_a), 0);
+    assert_int_eq(add_client(&sock_b), 0);
+
+    usbip_client_t* client_a = slot_map_at(&server.clients, 0);
+    usbip_client_t* client_b = slot_map_at(&server.clients, 1);
+
+    // Both clients share the device and pick the same sequence number.
+    import_dev(sock_a);
+    import_dev(sock_b);
+    in_nak = 1;
+
+    send_submit_dir(sock_b, 1, USBIP_DIR_IN, 1, 64);
+    usbip_server_handle_once(&server);
+    send_submit_dir(sock_a, 1, USBIP_DIR_IN, 1, 64);
+    usbip_server_handle_once(&server);
+    assert_int_eq(client_a->urbs, 1);
+    assert_int_eq(client_b->urbs, 1);
+
+    // Only the URB of the unlinking client is unlinked.
+    send_unlink(sock_a, 2, 1);
+    usbip_server_handle_once(&server);
+
+    assert_int_eq(recv(sock_a, words, sizeof(words), MSG_DONTWAIT), sizeof(words));
+    assert_int_eq(ntohl(words[0]), USBIP_RET_UNLINK);
+    assert_int_eq((int32_t)ntohl(words[5]), -ECONNRESET);
+    assert_int_eq(client_a->urbs, 0);
+    assert_int_eq(client_b->urbs, 1);
+
+    in_nak = 0;
+    usbip_server_handle_once(&server);
+    usbip_server_handle_once(&server);
+
+    assert_int_eq(recv_ret_submit(sock_b, &seq_num, &status, &length), 0);
+    assert_int_eq(seq_num, 1);
+    assert_int_eq(status, 0);
+    assert_int_eq(length, 64);
+    assert_int_eq(recv(sock_a, words, sizeof(words), MSG_DONTWAIT), -1);
+
+    // Every URB freed counts for its owner only.
+    assert_int_eq(client_a->urbs, 0);
+    assert_int_eq(client_b->urbs, 0);
+
+    close(sock_a);
+    close(sock_b);
+    usbip_server_handle_once(&server);
+
+    return 1;
+}
+
+static loopback_t loopback;
+static transport_t loopback_transport;
+
+static void loopback_send(int conn, void* buf, size_t len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    transport_writev(&loopback_transport, conn, &iov, 1, 0);
+}
+
+// Receives exactly len bytes from a loopback connection, running the server while waiting.
+static size_t loopback_recv_all(int conn, uint8_t* buf, size_t len)
+{
+    size_t received = 0;
+
+    for (size_t idle = 0; received < len && idle < 100; ++idle)
+    {
+        usbip_server_handle_once(&server);
+
+        ssize_t bytes
+            = transport_recv(&loopback_transport, conn, buf + received, len - received, 0);
+
+        if (bytes > 0)
+        {
+            received += bytes;
+            idle = 0;
+        }
+    }
+
+    return received;
+}
+
+test(test_usbip_loopback)
+{
+    const size_t length = 64 * 1024;
+    static uint8_t reply[sizeof(hdr_cmd_t) + 64 * 1024];
+    static uint8_t data[64 * 1024];
+    char path[] = "/tmp/usbip_file_XXXXXX";
+    uint8_t import[8 + 32] = { 0 };
+    uint8_t import_reply[8 + 312];
+    uint16_t* import_hdr = (uint16_t*)import;
+
+    assert_int_eq(setup_server(), 0);
+    loopback_transport_init(&loopback_transport, &loopback);
+    assert_int_eq(usbip_server_set_transport(&server, &loopback_transport), 0);
+
+    int conn = loopback_connect(&loopback);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 1);
+
+    import_hdr[0] = htons(USBIP_VERSION);
+    import_hdr[1] = htons(REQ_IMPORT);
+    strcpy((char*)import + 8, dev.busid);
+    loopback_send(conn, import, sizeof(import));
+
+    assert_int_eq(loopback_recv_all(conn, import_reply, sizeof(import_reply)),
+        sizeof(import_reply));
+    assert_int_eq(ntohl(((uint32_t*)import_reply)[1]), 0);
+
+    // URB data is sent from the transfer buffers.
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)] = { 0 };
+
+        words[0] = htonl(USBIP_CMD_SUBMIT);
+        words[1] = htonl(seq_num);
+        words[3] = htonl(USBIP_DIR_IN);
+        words[4] = htonl(1);
+        words[6] = htonl(4096);
+        loopback_send(conn, words, sizeof(words));
+    }
+
+    for (uint32_t seq_num = 1; seq_num <= 4; ++seq_num)
+    {
+        assert_int_eq(loopback_recv_all(conn, reply, sizeof(hdr_cmd_t) + 4096),
+            sizeof(hdr_cmd_t) + 4096);
+        assert_int_eq(ntohl(((uint32_t*)reply)[1]), seq_num);
+        assert_int_eq(reply[sizeof(hdr_cmd_t) + 4095], (uint8_t)4095);
+    }
+
+    file_fd = mkstemp(path);
+    file_pos = 0;
+    unlink(path);
+
+    for (size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = i * 7;
+    }
+
+    assert_int_eq(write(file_fd, data, sizeof(data)), sizeof(data));
+
+    // File data is read straight into the loopback, in parts as it is read by the host.
+    uint32_t words[sizeof(hdr_cmd_t) / sizeof(uint32_t)] = { 0 };
+
+    words[0] = htonl(USBIP_CMD_SUBMIT);
+    words[1] = htonl(5);
+    words[3] = htonl(USBIP_DIR_IN);
+    words[4] = htonl(2);
+    words[6] = htonl(length);
+    loopback_send(conn, words, sizeof(words));
+
+    assert_int_eq(loopback_recv_all(conn, reply, sizeof(reply)), sizeof(reply));
+    assert_int_eq(ntohl(((uint32_t*)reply)[6]), length);
+    assert_int_eq(memcmp(reply + sizeof(hdr_cmd_t), data, length), 0);
+
+    // Closing the host end stops the client.
+    transport_close(&loopback_transport, conn);
+    usbip_server_handle_once(&server);
+    assert_int_eq(server.clients.size, 0);
+
+    close(file_fd);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_usbip_stream_bulk_out);
+    run_test(test_usbip_discard_payload);
+    run_test(test_usbip_devlist_producer);
+    run_test(test_usbip_large_in_reply);
+    run_test(test_usbip_coalesce_replies);
+    run_test(test_usbip_zerocopy_in_reply);
+    run_test(test_usbip_file_in_reply);
+    run_test(test_usbip_backpressure);
+    run_test(test_usbip_fair_share);
+    run_test(test_usbip_rate_limit);
+    run_test(test_usbip_out_classes);
+    run_test(test_usbip_admission);
+    run_test(test_usbip_set_transport_busy);
+    run_test(test_usbip_idle_timeout);
+    run_test(test_usbip_urb_timeout);
+    run_test(test_usbip_stop_unlinks_urbs);
+    run_test(test_usbip_unlink_owner);
+    run_test(test_usbip_loopback);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+#include "test.h"
+#include "transport_loopback.h"
+#include "transport_sock.h"
+#include "usbip.h"
+#include "usbip_types.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Throughput of the protocol engine over the loopback transport compared with a Unix domain
+ * socket pair. The host pipelines bulk IN URBs and reads their replies, so the difference is the
+ * cost of the kernel round trips.
+ */
+
+#define URBS  20000
+#define BATCH 8
+
+static usbip_server_t server;
+static vhci_handle_t vhci;
+static usb_dev_t dev;
+static usb_conf_t conf;
+static usb_if_group_t if_grp;
+static usb_if_t data_if;
+static usb_ep_t in_ep;
+
+static loopback_t loopback;
+
+static ssize_t in_to_host(void* buf, size_t len)
+{
+    memset(buf, 0x5A, len);
+
+    return len;
+}
+
+static int setup_server(void)
+{
+    usb_dev_desc_t desc = {
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 64,
+    };
+    memset(&conf, 0, sizeof(conf));
+    memset(&if_grp, 0, sizeof(if_grp));
+    memset(&data_if, 0, sizeof(data_if));
+    memset(&in_ep, 0, sizeof(in_ep));
+
+    dev = usb_dev_create(&desc, LANG_ID_ENGLISH_US);
+    in_ep.desc.ep_nb = 1;
+    in_ep.desc.dir = USB_EP_IN;
+    in_ep.desc.txfer_type = USB_EP_BULK;
+    in_ep.to_host = in_to_host;
+
+    usb_dev_add_config(&dev, &conf);
+    usb_if_grp_add(&if_grp, &data_if);
+    usb_dev_add_if_grp(&dev, 0, &if_grp);
+    usb_if_add_ep(&data_if, &in_ep);
+    dev.cur_config = 0;
+
+    if (vhci_init(&vhci, &std_allocator) || vhci_register_dev(&vhci, &dev))
+    {
+        return -1;
+    }
+
+    return usbip_server_init(&server, &vhci, &std_allocator);
+}
+
+static void host_send(transport_t* host, int conn, void* buf, size_t len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    while (len > 0)
+    {
+        ssize_t bytes = transport_writev(host, conn, &iov, 1, 0);
+
+        if (bytes > 0)
+        {
+            iov.iov_base = (uint8_t*)iov.iov_base + bytes;
+            iov.iov_len -= bytes;
+            len -= bytes;
+        }
+        else
+        {
+            usbip_server_handle_once(&server);
+        }
+    }
+}
+
+static void host_recv(transport_t* host, int conn, uint8_t* buf, size_t len)
+{
+    size_t received = 0;
+
+    while (received < len)
+    {
+        usbip_server_handle_once(&server);
+
+        ssize_t bytes = transport_recv(host, conn, buf + received, len - received, 0);
+
+        if (bytes > 0)
+        {
+            received += bytes;
+        }
+    }
+}
+
+static void host_import(transport_t* host, int conn)
+{
+    uint8_t import[8 + 32] = { 0 };
+    uint8_t reply[8 + 312];
+    uint16_t* import_hdr = (uint16_t*)import;
+
+    import_hdr[0] = htons(USBIP_VERSION);
+    import_hdr[1] = htons(REQ_IMPORT);
+    strcpy((char*)import + 8, dev.busid);
+
+    host_send(host, conn, import, sizeof(import));
+    host_recv(host, conn, reply, sizeof(reply));
+}
+
+// Nanoseconds per URB, from submitting it to reading its reply.
+static double bench_run(transport_t* host, int conn, uint32_t length)
+{
+    static uint8_t replies[BATCH * (sizeof(hdr_cmd_t) + 4096)];
+    uint32_t words[BATCH][sizeof(hdr_cmd_t) / sizeof(uint32_t)];
+    struct timespec start, end;
+    uint32_t seq_num = 0;
+
+    memset(words, 0, sizeof(words));
+    host_import(host, conn);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t urb = 0; urb < URBS; urb += BATCH)
+    {
+        for (size_t i = 0; i < BATCH; ++i)
+        {
+            words[i][0] = htonl(USBIP_CMD_SUBMIT);
+            words[i][1] = htonl(++seq_num);
+            words[i][3] = htonl(USBIP_DIR_IN);
+            words[i][4] = htonl(1);
+            words[i][6] = htonl(length);
+        }
+
+        host_send(host, conn, words, sizeof(words));
+        host_recv(host, conn, replies, BATCH * (sizeof(hdr_cmd_t) + length));
+
+        uint32_t* last = (uint32_t*)(replies + (BATCH - 1) * (sizeof(hdr_cmd_t) + length));
+        assert_int_eq(ntohl(last[1]), seq_num);
+        assert_int_eq(ntohl(last[6]), length);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (double)URBS;
+}
+
+static double bench_loopback(uint32_t length)
+{
+    transport_t transport;
+
+    assert_int_eq(setup_server(), 0);
+    loopback_transport_init(&transport, &loopback);
+    assert_int_eq(usbip_server_set_transport(&server, &transport), 0);
+
+    int conn = loopback_connect(&loopback);
+    double ns_per_urb = bench_run(&transport, conn, length);
+
+    transport_close(&transport, conn);
+    usbip_server_handle_once(&server);
+
+    return ns_per_urb;
+}
+
+static double bench_unix(uint32_t length)
+{
+    sock_transport_t sock;
+    transport_t transport;
+    int socks[2];
+
+    assert_int_eq(setup_server(), 0);
+    sock_transport_init(&transport, &sock);
+    assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, socks), 0);
+    fcntl(socks[0], F_SETFL, fcntl(socks[0], F_GETFL) | O_NONBLOCK);
+    assert_int_eq(usbip_server_add_client(&server, socks[0]), 0);
+
+    double ns_per_urb = bench_run(&transport, socks[1], length);
+
+    close(socks[1]);
+    usbip_server_handle_once(&server);
+
+    return ns_per_urb;
+}
+
+test(test_usbip_bench_transports)
+{
+    const uint32_t lengths[] = { 64, 4096 };
+
+    printf("\t\t%-10s %10s %10s\n", "transport", "length", "ns/urb");
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+    {
+        printf("\t\t%-10s %10u %10.1f\n", "loopback", lengths[i], bench_loopback(lengths[i]));
+        printf("\t\t%-10s %10u %10.1f\n", "unix", lengths[i], bench_unix(lengths[i]));
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_usbip_bench_transports);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include "test.h"
+#include "usbip_static.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static vhci_handle_t vhci;
+static usb_dev_t devs[VHCI_MAX_DEVICES + 1];
+
+test(test_usbip_static_footprint)
+{
+    usbip_static_footprint_t footprint;
+
+    usbip_static_footprint(&footprint);
+
+    assert_int_eq(footprint.clients, MEM_POOL_SIZE(usbip_client_t, USBIP_MAX_CLIENTS));
+    assert_int_eq(footprint.imported_devs, MEM_POOL_SIZE(imported_dev_t, USBIP_MAX_IMPORTS));
+    assert_int_eq(footprint.devices, MEM_POOL_SIZE(vusb_dev_t, VHCI_MAX_DEVICES));
+    assert_int_eq(footprint.urb_bufs, VHCI_URB_BUF_REGION_SIZE);
+    assert_int_eq(footprint.vhci + footprint.urb_bufs, sizeof(vhci_handle_t));
+    assert_int_eq(footprint.total,
+        footprint.clients + footprint.imported_devs + footprint.devices + footprint.urb_bufs
+            + footprint.server + footprint.vhci);
+
+    printf("\t\tStatic footprint %zu bytes\n", footprint.total);
+
+    return 1;
+}
+
+test(test_usbip_static_devices)
+{
+    memset(devs, 0, sizeof(devs));
+
+    assert_int_eq(vhci_init(&vhci, usbip_static_allocator()), 0);
+
+    for (size_t i = 0; i < VHCI_MAX_DEVICES; ++i)
+    {
+        assert_int_eq(vhci_register_dev(&vhci, &devs[i]), 0);
+    }
+
+    // The device pool is exhausted, registration fails instead of falling back to malloc.
+    assert_int_eq(vhci_register_dev(&vhci, &devs[VHCI_MAX_DEVICES]), -1);
+    assert_int_eq(errno, ENOMEM);
+
+    assert_int_eq(vhci_remove_device(&vhci, &devs[3]), 0);
+    assert_int_eq(vhci_register_dev(&vhci, &devs[VHCI_MAX_DEVICES]), 0);
+
+    for (size_t i = 0; i <= VHCI_MAX_DEVICES; ++i)
+    {
+        if (i != 3)
+        {
+            assert_int_eq(vhci_remove_device(&vhci, &devs[i]), 0);
+        }
+    }
+
+    return 1;
+}
+
+test(test_usbip_static_pools)
+{
+    const allocator_t* allocator = usbip_static_allocator();
+    void* clients[USBIP_MAX_CLIENTS];
+    void* imports[USBIP_MAX_IMPORTS];
+
+    for (size_t i = 0; i < USBIP_MAX_CLIENTS; ++i)
+    {
+        clients[i] = allocator_alloc(allocator, sizeof(usbip_client_t), _Alignof(usbip_client_t));
+        assert_int_eq(clients[i] != NULL, 1);
+    }
+
+    assert_ptr_eq(
+        allocator_alloc(allocator, sizeof(usbip_client_t), _Alignof(usbip_client_t)), NULL);
+
+    // Other pools keep their own budget.
+    for (size_t i = 0; i < USBIP_MAX_IMPORTS; ++i)
+    {
+        imports[i] = allocator_alloc(allocator, sizeof(imported_dev_t), _Alignof(imported_dev_t));
+        assert_int_eq(imports[i] != NULL, 1);
+    }
+
+    assert_ptr_eq(
+        allocator_alloc(allocator, sizeof(imported_dev_t), _Alignof(imported_dev_t)), NULL);
+
+    allocator_free(allocator, clients[5], sizeof(usbip_client_t));
+    assert_ptr_eq(
+        allocator_alloc(allocator, sizeof(usbip_client_t), _Alignof(usbip_client_t)), clients[5]);
+
+    for (size_t i = 0; i < USBIP_MAX_CLIENTS; ++i)
+    {
+        allocator_free(allocator, clients[i], sizeof(usbip_client_t));
+    }
+
+    for (size_t i = 0; i < USBIP_MAX_IMPORTS; ++i)
+    {
+        allocator_free(allocator, imports[i], sizeof(imported_dev_t));
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_usbip_static_footprint);
+    run_test(test_usbip_static_devices);
+    run_test(test_usbip_static_pools);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+#include "test.h"
+#include "usb/vhci.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static vhci_handle_t vhci;
+static usb_dev_t dev;
+static usb_conf_t conf;
+static usb_if_group_t if_grp;
+static usb_if_t data_if;
+static usb_ep_t in_ep;
+static usb_ep_t out_ep;
+
+static int in_ready = 0;
+static size_t completions = 0;
+static urb_state_t completed_state;
+static int completed_status;
+static uint32_t completed_length;
+
+static ssize_t in_to_host(void* buf, size_t len)
+{
+    if (!in_ready)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    memset(buf, 0xA5, len);
+    return len;
+}
+
+static ssize_t in_to_host_file(urb_file_region_t* region, size_t len)
+{
+    region->fd = 42;
+    region->offset = 4096;
+
+    return len / 2;
+}
+
+static size_t out_total = 0;
+static size_t out_max_chunk = 0;
+
+static void out_to_device(void* buf, size_t len)
+{
+    out_total += len;
+    out_max_chunk = (len > out_max_chunk) ? len : out_max_chunk;
+}
+
+static void complete(urb_t* urb, void* context)
+{
+    completions++;
+    completed_state = urb->state;
+    completed_status = urb->status;
+    completed_length = urb->actual_length;
+
+    // Without a Host controller the URB is kept for inspection.
+    if (context != NULL)
+    {
+        vhci_urb_free(context, urb);
+    }
+}
+
+static vusb_dev_t* setup(void)
+{
+    usb_dev_desc_t desc = {
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 64,
+        .idVendor = 0x1234,
+    };
+
+    memset(&conf, 0, sizeof(conf));
+    memset(&if_grp, 0, sizeof(if_grp));
+    memset(&data_if, 0, sizeof(data_if));
+    memset(&in_ep, 0, sizeof(in_ep));
+    memset(&out_ep, 0, sizeof(out_ep));
+
+    dev = usb_dev_create(&desc, LANG_ID_ENGLISH_US);
+    conf.desc.bConfigurationValue = 0;
+    in_ep.desc.ep_nb = 1;
+    in_ep.desc.dir = USB_EP_IN;
+    in_ep.desc.txfer_type = USB_EP_BULK;
+    in_ep.to_host = in_to_host;
+    out_ep.desc.ep_nb = 1;
+    out_ep.desc.dir = USB_EP_OUT;
+    out_ep.desc.txfer_type = USB_EP_BULK;
+    out_ep.to_device = out_to_device;
+
+    usb_dev_add_config(&dev, &conf);
+    usb_if_grp_add(&if_grp, &data_if);
+    usb_dev_add_if_grp(&dev, 0, &if_grp);
+    usb_if_add_ep(&data_if, &in_ep);
+    usb_if_add_ep(&data_if, &out_ep);
+    dev.cur_config = 0;
+
+    in_ready = 0;
+    completions = 0;
+    out_total = 0;
+    out_max_chunk = 0;
+
+    if (vhci_init(&vhci, &std_allocator) || vhci_register_dev(&vhci, &dev))
+    {
+        return NULL;
+    }
+
+    return vhci_find_device(&vhci, dev.busid);
+}
+
+test(test_vhci_urb_alloc)
+{
+    vusb_dev_t* vdev = setup();
+    urb_t* urbs[VHCI_MAX_URBS];
+
+    assert_int_eq(vdev != NULL, 1);
+
+    // Small control transfers use the buffer embedded in the URB.
+    urb_t* urb = vhci_urb_alloc(&vhci, vdev, URB_INLINE_BUF_SIZE);
+    assert_ptr_eq(urb->transfer_buffer, urb->inline_buf);
+    assert_int_eq(urb->state, URB_STATE_ALLOCATED);
+    assert_int_eq(urb->transfer_flags & URB_FREE_BUFFER, 0);
+    vhci_urb_free(&vhci, urb);
+
+    urb = vhci_urb_alloc(&vhci, vdev, URB_INLINE_BUF_SIZE + 1);
+    assert_int_eq(urb->transfer_buffer != urb->inline_buf, 1);
+    assert_int_eq(urb->transfer_flags & URB_FREE_BUFFER, URB_FREE_BUFFER);
+    vhci_urb_free(&vhci, urb);
+
+    urb = vhci_urb_alloc(&vhci, vdev, 0);
+    assert_ptr_eq(urb->transfer_buffer, NULL);
+    vhci_urb_free(&vhci, urb);
+
+    for (size_t i = 0; i < VHCI_MAX_URBS; ++i)
+    {
+        urbs[i] = vhci_urb_alloc(&vhci, vdev, 8);
+        assert_int_eq(urbs[i] != NULL, 1);
+    }
+
+    // The pool is sized for the maximum number of URBs in flight.
+    assert_ptr_eq(vhci_urb_alloc(&vhci, vdev, 8), NULL);
+    assert_int_eq(errno, ENOMEM);
+
+    vhci_urb_free(&vhci, urbs[7]);
+    assert_ptr_eq(vhci_urb_alloc(&vhci, vdev, 8), urbs[7]);
+
+    for (size_t i = 0; i < VHCI_MAX_URBS; ++i)
+    {
+        vhci_urb_free(&vhci, urbs[i]);
+    }
+
+    return 1;
+}
+
+test(test_vhci_urb_buf_per_handle)
+{
+    static vhci_handle_t other;
+    static usb_dev_t other_dev;
+    vusb_dev_t* vdev = setup();
+    const size_t length = URB_INLINE_BUF_SIZE + 1;
+
+    memset(&other_dev, 0, sizeof(other_dev));
+    assert_int_eq(vdev != NULL, 1);
+    assert_int_eq(vhci_init(&other, &std_allocator), 0);
+    assert_int_eq(vhci_register_dev(&other, &other_dev), 0);
+
+    vusb_dev_t* other_vdev = vhci_find_device(&other, other_dev.busid);
+
+    // Every Host controller carves the transfer buffers from its own region.
+    urb_t* urb = vhci_urb_alloc(&vhci, vdev, length);
+    urb_t* other_urb = vhci_urb_alloc(&other, other_vdev, length);
+
+    assert_int_eq(urb != NULL && other_urb != NULL, 1);
+
+    uint8_t* buf = urb->transfer_buffer;
+    uint8_t* other_buf = other_urb->transfer_buffer;
+
+    assert_int_eq(buf + length <= other_buf || other_buf + length <= buf, 1);
+
+    vhci_urb_free(&other, other_urb);
+    vhci_urb_free(&vhci, urb);
+    assert_int_eq(vhci_remove_device(&other, &other_dev), 0);
+
+    return 1;
+}
+
+test(test_vhci_urb_submit_ctrl)
+{
+    vusb_dev_t* vdev = setup();
+
+    assert_int_eq(vdev != NULL, 1);
+
+    // GET_DESCRIPTOR(DEVICE) for the first 8 bytes only.
+    urb_t* urb = vhci_urb_alloc(&vhci, vdev, 8);
+    urb->pipe = PIPE_IN;
+    urb->setup_packet.bRequest = DEV_REQ_GET_DESC;
+    urb->setup_packet.wValue = USB_DESC_TYPE_DEV << 8;
+    urb->setup_packet.wLength = 8;
+    urb->complete = complete;
+    urb->context = &vhci;
+
+    // Control transfers complete before submission returns.
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+    assert_int_eq(completions, 1);
+    assert_int_eq(completed_state, URB_STATE_COMPLETED);
+    assert_int_eq(completed_status, 0);
+    assert_int_eq(completed_length, 8);
+
+    // Only allocated URBs can be submitted.
+    urb = vhci_urb_alloc(&vhci, vdev, 8);
+    urb->state = URB_STATE_SUBMITTED;
+    assert_int_eq(vhci_submit_urb(&vhci, urb), -1);
+    assert_int_eq(errno, EINVAL);
+    vhci_urb_free(&vhci, urb);
+
+    return 1;
+}
+
+test(test_vhci_urb_pending)
+{
+    vusb_dev_t* vdev = setup();
+
+    assert_int_eq(vdev != NULL, 1);
+
+    for (uint32_t seq_num = 1; seq_num <= 3; ++seq_num)
+    {
+        urb_t* urb = vhci_urb_alloc(&vhci, vdev, 512);
+        urb->pipe = PIPE_IN | PIPE_EP_SET(1);
+        urb->seq_num = seq_num;
+        urb->complete = complete;
+        urb->context = &vhci;
+
+        assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+        assert_int_eq(urb->state, URB_STATE_SUBMITTED);
+    }
+
+    // The endpoint has no data, the URBs stay pending.
+    vhci_run_once(&vhci);
+    assert_int_eq(completions, 0);
+
+    // Unlinked URBs are freed without completion.
+    assert_int_eq(vhci_unlink_urb(&vhci, vdev, 2, 1), -1);
+    assert_int_eq(errno, ENOENT);
+    assert_int_eq(vhci_unlink_urb(&vhci, vdev, 2, 0), 0);
+    assert_int_eq(vhci_unlink_urb(&vhci, vdev, 2, 0), -1);
+    assert_int_eq(errno, ENOENT);
+
+    in_ready = 1;
+    vhci_run_once(&vhci);
+    assert_int_eq(completions, 2);
+    assert_int_eq(completed_status, 0);
+    assert_int_eq(completed_length, 512);
+    assert_ptr_eq(vdev->urb_list.next, NULL);
+
+    // Unknown endpoints stall.
+    urb_t* urb = vhci_urb_alloc(&vhci, vdev, 8);
+    urb->pipe = PIPE_IN | PIPE_EP_SET(2);
+    urb->complete = complete;
+    urb->context = &vhci;
+
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+    assert_int_eq(completions, 3);
+    assert_int_eq(completed_status, -EPIPE);
+
+    return 1;
+}
+
+test(test_vhci_urb_remove_device)
+{
+    vusb_dev_t* vdev = setup();
+
+    assert_int_eq(vdev != NULL, 1);
+
+    urb_t* urb = vhci_urb_alloc(&vhci, vdev, 64);
+    urb->pipe = PIPE_IN | PIPE_EP_SET(1);
+    urb->complete = complete;
+    urb->context = &vhci;
+
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+    assert_int_eq(completions, 0);
+
+    // Pending URBs are completed when their device goes away.
+    assert_int_eq(vhci_remove_device(&vhci, &dev), 0);
+    assert_int_eq(completions, 1);
+    assert_int_eq(completed_status, -ESHUTDOWN);
+
+    return 1;
+}
+
+test(test_vhci_urb_stream)
+{
+    vusb_dev_t* vdev = setup();
+    const uint32_t length = 64 * 1024;
+
+    assert_int_eq(vdev != NULL, 1);
+
+    // Only a staging buffer is allocated for the transfer.
+    urb_t* urb = vhci_urb_alloc_stream(&vhci, vdev, length);
+    assert_int_eq(urb != NULL, 1);
+    assert_int_eq(urb->transfer_flags & URB_INTERNAL_PARTIAL_URB, URB_INTERNAL_PARTIAL_URB);
+    urb->pipe = PIPE_OUT | PIPE_EP_SET(1);
+    urb->complete = complete;
+    urb->context = &vhci;
+
+    // Data can only be streamed once submitted.
+    assert_int_eq(vhci_urb_stream(&vhci, urb, 100), -1);
+    assert_int_eq(errno, EINVAL);
+
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+
+    uint32_t sent = 0;
+
+    while (sent < length)
+    {
+        uint32_t part = (length - sent < 100) ? length - sent : 100;
+
+        assert_int_eq(vhci_urb_stream(&vhci, urb, part), 0);
+        sent += part;
+
+        // Parts reach the endpoint as they are passed, the URB completes with the last one.
+        assert_int_eq(out_total, sent);
+        assert_int_eq(completions, (sent == length) ? 1 : 0);
+    }
+
+    assert_int_eq(completed_status, 0);
+    assert_int_eq(completed_length, length);
+    assert_int_eq(out_max_chunk, 100);
+
+    // Streaming needs an OUT endpoint that accepts data.
+    urb = vhci_urb_alloc_stream(&vhci, vdev, length);
+    urb->pipe = PIPE_OUT | PIPE_EP_SET(2);
+    assert_int_eq(vhci_submit_urb(&vhci, urb), -1);
+    assert_int_eq(errno, EPIPE);
+    vhci_urb_free(&vhci, urb);
+
+    return 1;
+}
+
+test(test_vhci_urb_file)
+{
+    vusb_dev_t* vdev = setup();
+
+    assert_int_eq(vdev != NULL, 1);
+
+    // No transfer buffer is allocated, whatever the length.
+    urb_t* urb = vhci_urb_alloc_file(&vhci, vdev, 1024 * 1024);
+    assert_int_eq(urb != NULL, 1);
+    assert_ptr_eq(urb->transfer_buffer, NULL);
+    assert_int_eq(urb->transfer_flags & URB_FILE_REGION, URB_FILE_REGION);
+    urb->pipe = PIPE_IN | PIPE_EP_SET(1);
+    urb->complete = complete;
+    urb->context = &vhci;
+
+    // The endpoint only reads into memory.
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+    assert_int_eq(completions, 1);
+    assert_int_eq(completed_status, -EPIPE);
+
+    in_ep.to_host_file = in_to_host_file;
+
+    urb = vhci_urb_alloc_file(&vhci, vdev, 1024 * 1024);
+    urb->pipe = PIPE_IN | PIPE_EP_SET(1);
+    urb->complete = complete;
+    urb->context = NULL;
+
+    // The endpoint tells where the data is instead of copying it.
+    assert_int_eq(vhci_submit_urb(&vhci, urb), 0);
+    assert_int_eq(completions, 2);
+    assert_int_eq(completed_status, 0);
+    assert_int_eq(completed_length, 512 * 1024);
+    assert_int_eq(urb->file_region.fd, 42);
+    assert_int_eq(urb->file_region.offset, 4096);
+    vhci_urb_free(&vhci, urb);
+
+    return 1;
+}
+
+int main(void)
+{
+    run_test(test_vhci_urb_alloc);
+    run_test(test_vhci_urb_buf_per_handle);
+    run_test(test_vhci_urb_submit_ctrl);
+    run_test(test_vhci_urb_pending);
+    run_test(test_vhci_urb_remove_device);
+    run_test(test_vhci_urb_stream);
+    run_test(test_vhci_urb_file);
+
+    printf("Tests finished\n");
+
+    return EXIT_SUCCESS;
+}